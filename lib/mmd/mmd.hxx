@@ -37,6 +37,7 @@
 
 #include "util/macro.inc"
 
+#include <cerrno>
 #include <cmath>
 #include <cstddef>
 #include <cstdio>
@@ -59,9 +60,20 @@
 
 #include <exception>
 
+#include <locale.h>
 #ifndef MMD_WINDOWS
 #include <iconv.h>
 #endif
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+#ifdef MMD_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "util/dwarf.inl"
 #include "util/math.inl"
@@ -86,6 +98,10 @@ namespace mmd {
 
 #include "model/model.inl"
 #include "motion/motion.inl"
+#include "motion/baked_motion.inl"
+#include "motion/compressed_motion.inl"
+#include "motion/retarget_map.inl"
+#include "motion/rig.inl"
 #include "motion/poser.inl"
 
 #include "motion/physics.inl"
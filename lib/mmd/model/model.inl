@@ -333,146 +333,112 @@ namespace mmd {
 
         class Morph {
         public:
-            union MorphData {
+            class GroupMorph {
             public:
-                class GroupMorph {
-                public:
-                    size_t GetMorphIndex() const;
-                    void SetMorphIndex(size_t index);
-
-                    float GetMorphRate() const;
-                    void SetMorphRate(float rate);
-
-                private:
-                    size_t morph_index_;
-                    float morph_rate_;
-                };
+                size_t GetMorphIndex() const;
+                void SetMorphIndex(size_t index);
 
-                class VertexMorph {
-                public:
-                    size_t GetVertexIndex() const;
-                    void SetVertexIndex(size_t index);
+                float GetMorphRate() const;
+                void SetMorphRate(float rate);
 
-                    const Vector3f &GetOffset() const;
-                    void SetOffset(const Vector3f &offset);
+            private:
+                size_t morph_index_;
+                float morph_rate_;
+            };
 
-                private:
-                    size_t vertex_index_;
-                    Vector3f offset_;
-                };
+            class BoneMorph {
+            public:
+                size_t GetBoneIndex() const;
+                void SetBoneIndex(size_t index);
 
-                class BoneMorph {
-                public:
-                    size_t GetBoneIndex() const;
-                    void SetBoneIndex(size_t index);
+                const Vector3f &GetTranslation() const;
+                void SetTranslation(const Vector3f &translation);
 
-                    const Vector3f &GetTranslation() const;
-                    void SetTranslation(const Vector3f &translation);
+                const Vector4f &GetRotation() const;
+                void SetRotation(const Vector4f &rotation);
 
-                    const Vector4f &GetRotation() const;
-                    void SetRotation(const Vector4f &rotation);
+            private:
+                size_t bone_index_;
+                Vector3f translation_;
+                Vector4f rotation_;
+            };
 
-                private:
-                    size_t bone_index_;
-                    Vector3f translation_;
-                    Vector4f rotation_;
-                };
+            class UVMorph {
+            public:
+                size_t GetVertexIndex() const;
+                void SetVertexIndex(size_t index);
 
-                class UVMorph {
-                public:
-                    size_t GetVertexIndex() const;
-                    void SetVertexIndex(size_t index);
+                const Vector4f &GetOffset() const;
+                void SetOffset(const Vector4f &offset);
 
-                    const Vector4f &GetOffset() const;
-                    void SetOffset(const Vector4f &offset);
+            private:
+                size_t vertex_index_;
+                Vector4f offset_;
+            };
 
-                private:
-                    size_t vertex_index_;
-                    Vector4f offset_;
+            class MaterialMorph {
+            public:
+                enum MaterialMorphMethod {
+                    MORPH_MAT_MUL = 0x00,
+                    MORPH_MAT_ADD = 0x01
                 };
 
-                class MaterialMorph {
-                public:
-                    enum MaterialMorphMethod {
-                        MORPH_MAT_MUL = 0x00,
-                        MORPH_MAT_ADD = 0x01
-                    };
-
-                    size_t GetMaterialIndex() const;
-                    void SetMaterialIndex(size_t index);
+                size_t GetMaterialIndex() const;
+                void SetMaterialIndex(size_t index);
 
-                    bool IsGlobal() const;
-                    void SetGlobal(bool global);
+                bool IsGlobal() const;
+                void SetGlobal(bool global);
 
-                    MaterialMorphMethod GetMethod() const;
-                    void SetMethod(MaterialMorphMethod method);
+                MaterialMorphMethod GetMethod() const;
+                void SetMethod(MaterialMorphMethod method);
 
-                    const Vector4f &GetDiffuse() const;
-                    void SetDiffuse(const Vector3f &diffuse);
-                    void SetDiffuse(const Vector4f &diffuse);
+                const Vector4f &GetDiffuse() const;
+                void SetDiffuse(const Vector3f &diffuse);
+                void SetDiffuse(const Vector4f &diffuse);
 
-                    const Vector4f &GetSpecular() const;
-                    void SetSpecular(const Vector3f &specular);
-                    void SetSpecular(const Vector4f &specular);
+                const Vector4f &GetSpecular() const;
+                void SetSpecular(const Vector3f &specular);
+                void SetSpecular(const Vector4f &specular);
 
-                    const Vector4f &GetAmbient() const;
-                    void SetAmbient(const Vector3f &ambient);
-                    void SetAmbient(const Vector4f &ambient);
+                const Vector4f &GetAmbient() const;
+                void SetAmbient(const Vector3f &ambient);
+                void SetAmbient(const Vector4f &ambient);
 
-                    float GetShininess() const;
-                    void SetShininess(float shininess);
+                float GetShininess() const;
+                void SetShininess(float shininess);
 
-                    const Vector4f &GetEdgeColor() const;
-                    void SetEdgeColor(const Vector3f &edge_color);
-                    void SetEdgeColor(const Vector4f &edge_color);
+                const Vector4f &GetEdgeColor() const;
+                void SetEdgeColor(const Vector3f &edge_color);
+                void SetEdgeColor(const Vector4f &edge_color);
 
-                    float GetEdgeSize() const;
-                    void SetEdgeSize(float edge_size);
+                float GetEdgeSize() const;
+                void SetEdgeSize(float edge_size);
 
-                    const Vector4f &GetTexture() const;
-                    void SetTexture(const Vector3f &texture);
-                    void SetTexture(const Vector4f &texture);
+                const Vector4f &GetTexture() const;
+                void SetTexture(const Vector3f &texture);
+                void SetTexture(const Vector4f &texture);
 
-                    const Vector4f &GetSubTexture() const;
-                    void SetSubTexture(const Vector3f &sub_texture);
-                    void SetSubTexture(const Vector4f &sub_texture);
+                const Vector4f &GetSubTexture() const;
+                void SetSubTexture(const Vector3f &sub_texture);
+                void SetSubTexture(const Vector4f &sub_texture);
 
-                    const Vector4f &GetToonTexture() const;
-                    void SetToonTexture(const Vector3f &toon_texture);
-                    void SetToonTexture(const Vector4f &toon_texture);
+                const Vector4f &GetToonTexture() const;
+                void SetToonTexture(const Vector3f &toon_texture);
+                void SetToonTexture(const Vector4f &toon_texture);
 
-                private:
-                    size_t material_index_;
-                    bool global_;
-                    MaterialMorphMethod method_;
-                    Vector4f diffuse_;
-                    Vector4f specular_;
-                    Vector4f ambient_;
-                    float shininess_;
-                    Vector4f edge_color_;
-                    float edge_size_;
-                    Vector4f texture_;
-                    Vector4f sub_texture_;
-                    Vector4f toon_texture_;
-                };
-
-                GroupMorph &GetGroupMorph();
-                VertexMorph &GetVertexMorph();
-                BoneMorph &GetBoneMorph();
-                UVMorph &GetUVMorph();
-                MaterialMorph &GetMaterialMorph();
-
-                const GroupMorph &GetGroupMorph() const;
-                const VertexMorph &GetVertexMorph() const;
-                const BoneMorph &GetBoneMorph() const;
-                const UVMorph &GetUVMorph() const;
-                const MaterialMorph &GetMaterialMorph() const;
             private:
-                GroupMorph group_morph_;
-                VertexMorph vertex_morph_;
-                BoneMorph bone_morph_;
-                UVMorph uv_morph_;
-                MaterialMorph material_morph_;
+                size_t material_index_;
+                bool global_;
+                MaterialMorphMethod method_;
+                Vector4f diffuse_;
+                Vector4f specular_;
+                Vector4f ambient_;
+                float shininess_;
+                Vector4f edge_color_;
+                float edge_size_;
+                Vector4f texture_;
+                Vector4f sub_texture_;
+                Vector4f toon_texture_;
             };
 
             enum MorphCategory {
@@ -505,15 +471,44 @@ namespace mmd {
             void SetType(MorphType type);
 
             size_t GetMorphDataNum() const;
-            const MorphData &GetMorphData(size_t index) const;
-            MorphData &GetMorphData(size_t index);
-            MorphData &NewMorphData();
+
+            const GroupMorph &GetGroupMorph(size_t index) const;
+            GroupMorph &GetGroupMorph(size_t index);
+            GroupMorph &NewGroupMorph();
+
+            size_t GetVertexIndex(size_t index) const;
+            void SetVertexIndex(size_t index, size_t vertex_index);
+            const Vector3f &GetVertexOffset(size_t index) const;
+            void SetVertexOffset(size_t index, const Vector3f &offset);
+            void NewVertexMorph(size_t vertex_index, const Vector3f &offset);
+            void ReserveVertexMorphs(size_t num);
+            const std::uint32_t *GetVertexIndexPointer() const;
+            const Vector3f *GetVertexOffsetPointer() const;
+
+            const BoneMorph &GetBoneMorph(size_t index) const;
+            BoneMorph &GetBoneMorph(size_t index);
+            BoneMorph &NewBoneMorph();
+
+            const UVMorph &GetUVMorph(size_t index) const;
+            UVMorph &GetUVMorph(size_t index);
+            UVMorph &NewUVMorph();
+
+            const MaterialMorph &GetMaterialMorph(size_t index) const;
+            MaterialMorph &GetMaterialMorph(size_t index);
+            MaterialMorph &NewMaterialMorph();
         private:
             std::wstring name_;
             std::wstring name_en_;
             MorphCategory category_;
             MorphType type_;
-            std::vector<MorphData> morph_data_;
+            /* one array per kind, only the one matching type_ is used;
+               vertex morphs are kept as parallel index/offset arrays */
+            std::vector<GroupMorph> group_morphs_;
+            std::vector<std::uint32_t> vertex_indices_;
+            std::vector<Vector3f> vertex_offsets_;
+            std::vector<BoneMorph> bone_morphs_;
+            std::vector<UVMorph> uv_morphs_;
+            std::vector<MaterialMorph> material_morphs_;
         };
 
         class RigidBody {
@@ -667,11 +662,14 @@ namespace mmd {
         Vertex<cref> GetVertex(size_t index) const;
         Vertex<ref> GetVertex(size_t index);
         Vertex<ref> NewVertex();
+        /** Makes room for num vertices in all, for readers that know the count. **/
+        void ReserveVertices(size_t num);
 
         size_t GetTriangleNum() const;
         const Vector3D<std::uint32_t> &GetTriangle(size_t index) const;
         Vector3D<std::uint32_t> &GetTriangle(size_t index);
         Vector3D<std::uint32_t> &NewTriangle();
+        void ReserveTriangles(size_t num);
 
         size_t GetPartNum() const;
         const Part &GetPart(size_t index) const;
@@ -225,6 +225,18 @@ Model::NewVertex() {
     return GetVertex(GetVertexNum()-1);
 }
 
+inline void
+Model::ReserveVertices(size_t num) {
+    vertex_info_.coordinates_.reserve(num);
+    vertex_info_.normals_.reserve(num);
+    vertex_info_.uv_coords_.reserve(num);
+    for(size_t i=0;i<GetExtraUVNumber();++i) {
+        vertex_info_.extra_uv_coords_[i].reserve(num);
+    }
+    vertex_info_.skinning_operators_.reserve(num);
+    vertex_info_.edge_scales_.reserve(num);
+}
+
 //// omember: triangle
 inline size_t
 Model::GetTriangleNum() const {
@@ -247,6 +259,11 @@ Model::NewTriangle() {
     return triangles_.back();
 }
 
+inline void
+Model::ReserveTriangles(size_t num) {
+    triangles_.reserve(num);
+}
+
 //// omember: part
 inline size_t
 Model::GetPartNum() const {
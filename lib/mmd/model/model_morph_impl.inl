@@ -10,255 +10,233 @@
 
 //// vmember: morph_index[GroupMorph]
 inline size_t
-Model::Morph::MorphData::GroupMorph::GetMorphIndex() const {
+Model::Morph::GroupMorph::GetMorphIndex() const {
     return morph_index_;
 }
 
 inline void
-Model::Morph::MorphData::GroupMorph::SetMorphIndex(size_t index) {
+Model::Morph::GroupMorph::SetMorphIndex(size_t index) {
     morph_index_ = index;
 }
 
 //// vmember: morph_rate[GroupMorph]
 inline float
-Model::Morph::MorphData::GroupMorph::GetMorphRate() const {
+Model::Morph::GroupMorph::GetMorphRate() const {
     return morph_rate_;
 }
 
 inline void
-Model::Morph::MorphData::GroupMorph::SetMorphRate(float rate) {
+Model::Morph::GroupMorph::SetMorphRate(float rate) {
     morph_rate_ = rate;
 }
 
-//// vmember: vertex_index[VertexMorph]
-inline size_t
-Model::Morph::MorphData::VertexMorph::GetVertexIndex() const {
-    return vertex_index_;
-}
-
-inline void
-Model::Morph::MorphData::VertexMorph::SetVertexIndex(size_t index) {
-    vertex_index_ = index;
-}
-
-//// vmember: offset[VertexMorph]
-inline const Vector3f&
-Model::Morph::MorphData::VertexMorph::GetOffset() const {
-    return offset_;
-}
-
-inline void
-Model::Morph::MorphData::VertexMorph::SetOffset(const Vector3f &offset) {
-    offset_ = offset;
-}
-
 //// vmember: bone_index[BoneMorph]
 inline size_t
-Model::Morph::MorphData::BoneMorph::GetBoneIndex() const {
+Model::Morph::BoneMorph::GetBoneIndex() const {
     return bone_index_;
 }
 
 inline void
-Model::Morph::MorphData::BoneMorph::SetBoneIndex(size_t index) {
+Model::Morph::BoneMorph::SetBoneIndex(size_t index) {
     bone_index_ = index;
 }
 
 //// vmember: translation[BoneMorph]
 inline const Vector3f&
-Model::Morph::MorphData::BoneMorph::GetTranslation() const {
+Model::Morph::BoneMorph::GetTranslation() const {
     return translation_;
 }
 
 inline void
-Model::Morph::MorphData::BoneMorph::SetTranslation(const Vector3f &translation) {
+Model::Morph::BoneMorph::SetTranslation(const Vector3f &translation) {
     translation_ = translation;
 }
 
 //// vmember: rotation[BoneMorph]
 inline const Vector4f&
-Model::Morph::MorphData::BoneMorph::GetRotation() const {
+Model::Morph::BoneMorph::GetRotation() const {
     return rotation_;
 }
 
 inline void
-Model::Morph::MorphData::BoneMorph::SetRotation(const Vector4f &rotation) {
+Model::Morph::BoneMorph::SetRotation(const Vector4f &rotation) {
     rotation_ = rotation;
 }
 
 //// vmember: vertex_index[UVMorph]
 inline size_t
-Model::Morph::MorphData::UVMorph::GetVertexIndex() const {
+Model::Morph::UVMorph::GetVertexIndex() const {
     return vertex_index_;
 }
 
 inline void
-Model::Morph::MorphData::UVMorph::SetVertexIndex(size_t index) {
+Model::Morph::UVMorph::SetVertexIndex(size_t index) {
     vertex_index_ = index;
 }
 
 //// vmember: offset[UVMorph]
 inline const Vector4f&
-Model::Morph::MorphData::UVMorph::GetOffset() const {
+Model::Morph::UVMorph::GetOffset() const {
     return offset_;
 }
 
 inline void
-Model::Morph::MorphData::UVMorph::SetOffset(const Vector4f &offset) {
+Model::Morph::UVMorph::SetOffset(const Vector4f &offset) {
     offset_ = offset;
 }
 
 //// vmember: material_index[MaterialMorph]
 inline size_t
-Model::Morph::MorphData::MaterialMorph::GetMaterialIndex() const {
+Model::Morph::MaterialMorph::GetMaterialIndex() const {
     return material_index_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetMaterialIndex(size_t index) {
+Model::Morph::MaterialMorph::SetMaterialIndex(size_t index) {
     material_index_ = index;
 }
 
 //// vmember: global[MaterialMorph]
 inline bool
-Model::Morph::MorphData::MaterialMorph::IsGlobal() const {
+Model::Morph::MaterialMorph::IsGlobal() const {
     return global_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetGlobal(bool global) {
+Model::Morph::MaterialMorph::SetGlobal(bool global) {
     global_ = global;
 }
 
 //// vmember: method[MaterialMorph]
-inline Model::Morph::MorphData::MaterialMorph::MaterialMorphMethod
-Model::Morph::MorphData::MaterialMorph::GetMethod() const {
+inline Model::Morph::MaterialMorph::MaterialMorphMethod
+Model::Morph::MaterialMorph::GetMethod() const {
     return method_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetMethod(
-    Model::Morph::MorphData::MaterialMorph::MaterialMorphMethod method
+Model::Morph::MaterialMorph::SetMethod(
+    Model::Morph::MaterialMorph::MaterialMorphMethod method
 ) {
     method_ = method;
 }
 
 //// vmember: diffuse[MaterialMorph]
 inline const Vector4f&
-Model::Morph::MorphData::MaterialMorph::GetDiffuse() const {
+Model::Morph::MaterialMorph::GetDiffuse() const {
     return diffuse_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetDiffuse(const Vector3f &diffuse) {
+Model::Morph::MaterialMorph::SetDiffuse(const Vector3f &diffuse) {
     diffuse_.c = diffuse.c;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetDiffuse(const Vector4f &diffuse) {
+Model::Morph::MaterialMorph::SetDiffuse(const Vector4f &diffuse) {
     diffuse_ = diffuse;
 }
 
 //// vmember: specular[MaterialMorph]
 inline const Vector4f&
-Model::Morph::MorphData::MaterialMorph::GetSpecular() const {
+Model::Morph::MaterialMorph::GetSpecular() const {
     return specular_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetSpecular(const Vector3f &specular) {
+Model::Morph::MaterialMorph::SetSpecular(const Vector3f &specular) {
     specular_.c = specular.c;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetSpecular(const Vector4f &specular) {
+Model::Morph::MaterialMorph::SetSpecular(const Vector4f &specular) {
     specular_ = specular;
 }
 
 //// vmember: ambient[MaterialMorph]
 inline const Vector4f&
-Model::Morph::MorphData::MaterialMorph::GetAmbient() const {
+Model::Morph::MaterialMorph::GetAmbient() const {
     return ambient_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetAmbient(const Vector3f &ambient) {
+Model::Morph::MaterialMorph::SetAmbient(const Vector3f &ambient) {
     ambient_.c = ambient.c;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetAmbient(const Vector4f &ambient) {
+Model::Morph::MaterialMorph::SetAmbient(const Vector4f &ambient) {
     ambient_ = ambient;
 }
 
 //// vmember: shininess[MaterialMorph]
 inline float
-Model::Morph::MorphData::MaterialMorph::GetShininess() const {
+Model::Morph::MaterialMorph::GetShininess() const {
     return shininess_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetShininess(float shininess) {
+Model::Morph::MaterialMorph::SetShininess(float shininess) {
     shininess_ = shininess;
 }
 
 //// vmember: edge_color[MaterialMorph]
 inline const Vector4f&
-Model::Morph::MorphData::MaterialMorph::GetEdgeColor() const {
+Model::Morph::MaterialMorph::GetEdgeColor() const {
     return edge_color_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetEdgeColor(const Vector3f &edge_color) {
+Model::Morph::MaterialMorph::SetEdgeColor(const Vector3f &edge_color) {
     edge_color_.c = edge_color.c;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetEdgeColor(const Vector4f &edge_color) {
+Model::Morph::MaterialMorph::SetEdgeColor(const Vector4f &edge_color) {
     edge_color_ = edge_color;
 }
 
 //// vmember: edge_size[MaterialMorph]
 inline float
-Model::Morph::MorphData::MaterialMorph::GetEdgeSize() const {
+Model::Morph::MaterialMorph::GetEdgeSize() const {
     return edge_size_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetEdgeSize(float edge_size) {
+Model::Morph::MaterialMorph::SetEdgeSize(float edge_size) {
     edge_size_ = edge_size;
 }
 
 //// vmember: texture[MaterialMorph]
 inline const
-Vector4f& Model::Morph::MorphData::MaterialMorph::GetTexture() const {
+Vector4f& Model::Morph::MaterialMorph::GetTexture() const {
     return texture_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetTexture(const Vector3f &texture) {
+Model::Morph::MaterialMorph::SetTexture(const Vector3f &texture) {
     texture_.c = texture.c;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetTexture(const Vector4f &texture) {
+Model::Morph::MaterialMorph::SetTexture(const Vector4f &texture) {
     texture_ = texture;
 }
 
 //// vmember: sub_texture[MaterialMorph]
 inline const Vector4f&
-Model::Morph::MorphData::MaterialMorph::GetSubTexture() const {
+Model::Morph::MaterialMorph::GetSubTexture() const {
     return sub_texture_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetSubTexture(
+Model::Morph::MaterialMorph::SetSubTexture(
     const Vector3f &sub_texture
 ) {
     sub_texture_.c = sub_texture.c;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetSubTexture(
+Model::Morph::MaterialMorph::SetSubTexture(
     const Vector4f &sub_texture
 ) {
     sub_texture_ = sub_texture;
@@ -266,79 +244,24 @@ Model::Morph::MorphData::MaterialMorph::SetSubTexture(
 
 //// vmember: toon_texture[MaterialMorph]
 inline const Vector4f&
-Model::Morph::MorphData::MaterialMorph::GetToonTexture() const {
+Model::Morph::MaterialMorph::GetToonTexture() const {
     return toon_texture_;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetToonTexture(
+Model::Morph::MaterialMorph::SetToonTexture(
     const Vector3f &toon_texture
 ) {
     toon_texture_.c = toon_texture.c;
 }
 
 inline void
-Model::Morph::MorphData::MaterialMorph::SetToonTexture(
+Model::Morph::MaterialMorph::SetToonTexture(
     const Vector4f &toon_texture
 ) {
     toon_texture_ = toon_texture;
 }
 
-//// omember: group_morph
-inline Model::Morph::MorphData::GroupMorph&
-Model::Morph::MorphData::GetGroupMorph() {
-    return group_morph_;
-}
-
-inline const Model::Morph::MorphData::GroupMorph&
-Model::Morph::MorphData::GetGroupMorph() const {
-    return group_morph_;
-}
-
-//// omember: vertex_morph
-inline Model::Morph::MorphData::VertexMorph&
-Model::Morph::MorphData::GetVertexMorph() {
-    return vertex_morph_;
-}
-
-inline const Model::Morph::MorphData::VertexMorph&
-Model::Morph::MorphData::GetVertexMorph() const {
-    return vertex_morph_;
-}
-
-//// omember: bone_morph
-inline Model::Morph::MorphData::BoneMorph&
-Model::Morph::MorphData::GetBoneMorph() {
-    return bone_morph_;
-}
-
-inline const Model::Morph::MorphData::BoneMorph&
-Model::Morph::MorphData::GetBoneMorph() const {
-    return bone_morph_;
-}
-
-//// omember: uv_morph
-inline Model::Morph::MorphData::UVMorph&
-Model::Morph::MorphData::GetUVMorph() {
-    return uv_morph_;
-}
-
-inline const Model::Morph::MorphData::UVMorph&
-Model::Morph::MorphData::GetUVMorph() const {
-    return uv_morph_;
-}
-
-//// omember: material_morph
-inline Model::Morph::MorphData::MaterialMorph&
-Model::Morph::MorphData::GetMaterialMorph() {
-    return material_morph_;
-}
-
-inline const Model::Morph::MorphData::MaterialMorph&
-Model::Morph::MorphData::GetMaterialMorph() const {
-    return material_morph_;
-}
-
 //// vmember: name
 inline const std::wstring&
 Model::Morph::GetName() const {
@@ -386,23 +309,123 @@ Model::Morph::SetType(Model::Morph::MorphType type) {
 //// vmember: morph_data_num
 inline size_t
 Model::Morph::GetMorphDataNum() const {
-    return morph_data_.size();
+    return group_morphs_.size()+vertex_indices_.size()+bone_morphs_.size()
+        +uv_morphs_.size()+material_morphs_.size();
+}
+
+//// omember: group_morph
+inline const Model::Morph::GroupMorph&
+Model::Morph::GetGroupMorph(size_t index) const {
+    return group_morphs_[index];
+}
+
+inline Model::Morph::GroupMorph&
+Model::Morph::GetGroupMorph(size_t index) {
+    return group_morphs_[index];
+}
+
+//// omember: group_morph[new]
+inline Model::Morph::GroupMorph&
+Model::Morph::NewGroupMorph() {
+    group_morphs_.push_back(Model::Morph::GroupMorph());
+    return group_morphs_.back();
+}
+
+//// vmember: vertex_index[vertex_morph]
+inline size_t
+Model::Morph::GetVertexIndex(size_t index) const {
+    return vertex_indices_[index];
+}
+
+inline void
+Model::Morph::SetVertexIndex(size_t index, size_t vertex_index) {
+    vertex_indices_[index] = (std::uint32_t)vertex_index;
+}
+
+//// vmember: vertex_offset[vertex_morph]
+inline const Vector3f&
+Model::Morph::GetVertexOffset(size_t index) const {
+    return vertex_offsets_[index];
+}
+
+inline void
+Model::Morph::SetVertexOffset(size_t index, const Vector3f &offset) {
+    vertex_offsets_[index] = offset;
+}
+
+//// omember: vertex_morph[new]
+inline void
+Model::Morph::NewVertexMorph(size_t vertex_index, const Vector3f &offset) {
+    vertex_indices_.push_back((std::uint32_t)vertex_index);
+    vertex_offsets_.push_back(offset);
+}
+
+inline void
+Model::Morph::ReserveVertexMorphs(size_t num) {
+    vertex_indices_.reserve(num);
+    vertex_offsets_.reserve(num);
+}
+
+inline const std::uint32_t*
+Model::Morph::GetVertexIndexPointer() const {
+    return vertex_indices_.empty()?NULL:&vertex_indices_[0];
+}
+
+inline const Vector3f*
+Model::Morph::GetVertexOffsetPointer() const {
+    return vertex_offsets_.empty()?NULL:&vertex_offsets_[0];
+}
+
+//// omember: bone_morph
+inline const Model::Morph::BoneMorph&
+Model::Morph::GetBoneMorph(size_t index) const {
+    return bone_morphs_[index];
+}
+
+inline Model::Morph::BoneMorph&
+Model::Morph::GetBoneMorph(size_t index) {
+    return bone_morphs_[index];
 }
 
-//// omember: morph_member
-inline const Model::Morph::MorphData&
-Model::Morph::GetMorphData(size_t index) const {
-    return morph_data_[index];
+//// omember: bone_morph[new]
+inline Model::Morph::BoneMorph&
+Model::Morph::NewBoneMorph() {
+    bone_morphs_.push_back(Model::Morph::BoneMorph());
+    return bone_morphs_.back();
+}
+
+//// omember: uv_morph
+inline const Model::Morph::UVMorph&
+Model::Morph::GetUVMorph(size_t index) const {
+    return uv_morphs_[index];
+}
+
+inline Model::Morph::UVMorph&
+Model::Morph::GetUVMorph(size_t index) {
+    return uv_morphs_[index];
+}
+
+//// omember: uv_morph[new]
+inline Model::Morph::UVMorph&
+Model::Morph::NewUVMorph() {
+    uv_morphs_.push_back(Model::Morph::UVMorph());
+    return uv_morphs_.back();
+}
+
+//// omember: material_morph
+inline const Model::Morph::MaterialMorph&
+Model::Morph::GetMaterialMorph(size_t index) const {
+    return material_morphs_[index];
 }
 
-inline Model::Morph::MorphData&
-Model::Morph::GetMorphData(size_t index) {
-    return morph_data_[index];
+inline Model::Morph::MaterialMorph&
+Model::Morph::GetMaterialMorph(size_t index) {
+    return material_morphs_[index];
 }
 
-//// omember: morph_member[new]
-inline Model::Morph::MorphData&
-Model::Morph::NewMorphData() {
-    morph_data_.push_back(Model::Morph::MorphData());
-    return morph_data_.back();
+//// omember: material_morph[new]
+inline Model::Morph::MaterialMorph&
+Model::Morph::NewMaterialMorph() {
+    material_morphs_.push_back(Model::Morph::MaterialMorph());
+    return material_morphs_.back();
 }
@@ -0,0 +1,143 @@
+
+/**
+             Copyright itsuhane@gmail.com, 2012.
+  Distributed under the Boost Software License, Version 1.0.
+      (See accompanying file LICENSE_1_0.txt or copy at
+            http://www.boost.org/LICENSE_1_0.txt)
+**/
+
+#ifndef __BAKED_MOTION_HXX_3B8E5D0C7A41F29E6D15B8C04F7A2E93_INCLUDED__
+#define __BAKED_MOTION_HXX_3B8E5D0C7A41F29E6D15B8C04F7A2E93_INCLUDED__
+
+namespace mmd {
+
+    /**
+      A Motion sampled at every frame (of its frame rate) into dense, quantized
+      tables: rotations as 4 x int16, translations and morph weights as
+      uint16 in a per-track range. A track that does not change is stored
+      as a single frame. Sampling reads the two neighbouring frames and
+      lerps, so curves between frames are approximated linearly.
+
+      All tables live in one contiguous block that is also the file
+      format (native byte order), so a saved bake can be used in place
+      from a mapped file via Attach().
+    **/
+    class BakedMotion {
+    public:
+        BakedMotion();
+        BakedMotion(const Motion &motion);
+
+        void Bake(const Motion &motion);
+
+        void Load(const std::wstring &filename);
+        void Save(const std::wstring &filename) const;
+
+        /**
+          Uses a bake already in memory without copying it. The data must
+          be 4-byte aligned and outlive this object (or the next Bake(),
+          Load(), Attach() or Clear()).
+        **/
+        void Attach(const void *data, size_t size);
+
+        const void *GetData() const;
+        size_t GetSize() const;
+
+        void Clear();
+
+        size_t GetFrameNum() const;
+        double GetFrameRate() const;
+
+        size_t GetBoneTrackNum() const;
+        size_t GetMorphTrackNum() const;
+
+        std::wstring GetBoneName(size_t track) const;
+        std::wstring GetMorphName(size_t track) const;
+
+        /** Returns nil when the motion has no track of that name. **/
+        size_t FindBoneTrack(const std::wstring &bone_name) const;
+        size_t FindMorphTrack(const std::wstring &morph_name) const;
+
+        Motion::BonePose GetBonePose(size_t track, size_t frame) const;
+        Motion::BonePose GetBonePose(size_t track, double time) const;
+
+        Motion::MorphPose GetMorphPose(size_t track, size_t frame) const;
+        Motion::MorphPose GetMorphPose(size_t track, double time) const;
+
+        /**
+          Quantizes count values of step floats each to uint16 in a
+          per-channel [base, base+65535*scale]. Returns the stride in
+          records: 1, or 0 when every channel is constant and out holds
+          a single record.
+        **/
+        static std::uint32_t Quantize(
+            const float *values, size_t count, size_t step,
+            float *base, float *scale, std::vector<std::uint16_t> &out
+        );
+
+    private:
+        enum { VERSION = 2 };
+
+        static const std::uint8_t *GetMagic();
+        static size_t Align(size_t offset);
+
+        struct Header {
+            std::uint8_t magic_[8];
+            std::uint32_t version_;
+            std::uint32_t size_;
+            std::uint32_t frame_num_;
+            std::uint32_t bone_track_num_;
+            std::uint32_t morph_track_num_;
+            std::uint32_t bone_table_offset_;
+            std::uint32_t morph_table_offset_;
+            std::uint32_t name_offset_;
+            float frame_rate_;
+        };
+
+        /* offsets are in bytes from the start of the block, names in UTF-16 code units from name_offset_ */
+        struct BoneTrack {
+            std::uint32_t name_begin_;
+            std::uint32_t name_length_;
+            std::uint32_t rotation_offset_;
+            std::uint32_t rotation_stride_;
+            std::uint32_t translation_offset_;
+            std::uint32_t translation_stride_;
+            float translation_base_[3];
+            float translation_scale_[3];
+        };
+
+        struct MorphTrack {
+            std::uint32_t name_begin_;
+            std::uint32_t name_length_;
+            std::uint32_t weight_offset_;
+            std::uint32_t weight_stride_;
+            float weight_base_;
+            float weight_scale_;
+        };
+
+        void Index();
+
+        const Header &GetHeader() const;
+        const BoneTrack &GetBoneTrack(size_t track) const;
+        const MorphTrack &GetMorphTrack(size_t track) const;
+        std::wstring GetName(std::uint32_t begin, std::uint32_t length) const;
+
+        Vector3f GetTranslation(const BoneTrack &track, size_t frame) const;
+        Vector4f GetRotation(const BoneTrack &track, size_t frame) const;
+        float GetWeight(const MorphTrack &track, size_t frame) const;
+
+        buffer_type buffer_;
+        const std::uint8_t *data_;
+        size_t size_;
+
+        std::map<std::wstring, size_t> bone_name_map_;
+        std::map<std::wstring, size_t> morph_name_map_;
+
+        BakedMotion(const BakedMotion&);
+        BakedMotion &operator=(const BakedMotion&);
+    };
+
+#include "baked_motion_impl.inl"
+
+} /* End of namespace mmd */
+
+#endif /* __BAKED_MOTION_HXX_3B8E5D0C7A41F29E6D15B8C04F7A2E93_INCLUDED__ */
@@ -0,0 +1,407 @@
+
+/**
+             Copyright itsuhane@gmail.com, 2012.
+  Distributed under the Boost Software License, Version 1.0.
+      (See accompanying file LICENSE_1_0.txt or copy at
+            http://www.boost.org/LICENSE_1_0.txt)
+**/
+
+inline const std::uint8_t *BakedMotion::GetMagic() {
+    static const std::uint8_t magic[8] = {'M', 'M', 'D', 'B', 'A', 'K', 'E', 0};
+    return magic;
+}
+
+inline size_t BakedMotion::Align(size_t offset) {
+    return (offset+3)&~size_t(3);
+}
+
+inline std::uint32_t BakedMotion::Quantize(
+    const float *values, size_t count, size_t step,
+    float *base, float *scale, std::vector<std::uint16_t> &out
+) {
+    bool constant = true;
+    for(size_t c=0;c<step;++c) {
+        float lo = values[c];
+        float hi = values[c];
+        for(size_t f=1;f<count;++f) {
+            lo = std::min(lo, values[f*step+c]);
+            hi = std::max(hi, values[f*step+c]);
+        }
+        base[c] = lo;
+        scale[c] = (hi-lo)/65535.0f;
+        if(hi>lo) {
+            constant = false;
+        }
+    }
+    size_t num = constant?1:count;
+    out.resize(num*step);
+    for(size_t f=0;f<num;++f) {
+        for(size_t c=0;c<step;++c) {
+            float q = scale[c]>0.0f?(values[f*step+c]-base[c])/scale[c]:0.0f;
+            out[f*step+c] = (std::uint16_t)std::min(65535.0f, std::floor(q+0.5f));
+        }
+    }
+    return constant?0:1;
+}
+
+inline BakedMotion::BakedMotion() : data_(NULL), size_(0) {}
+
+inline BakedMotion::BakedMotion(const Motion &motion) : data_(NULL), size_(0) {
+    Bake(motion);
+}
+
+inline void BakedMotion::Bake(const Motion &motion) {
+    Clear();
+
+    size_t frame_num = motion.GetLength()+1;
+    std::vector<std::wstring> bone_names = motion.GetBoneNames();
+    std::vector<std::wstring> morph_names = motion.GetMorphNames();
+
+    std::vector<BoneTrack> bone_tracks(bone_names.size());
+    std::vector<MorphTrack> morph_tracks(morph_names.size());
+    std::vector<std::uint16_t> names;
+
+    std::vector<std::vector<std::int16_t>> rotations(bone_names.size());
+    std::vector<std::vector<std::uint16_t>> translations(bone_names.size());
+    std::vector<std::vector<std::uint16_t>> weights(morph_names.size());
+
+    std::vector<float> frame_translations(frame_num*3);
+    std::vector<Vector4f> frame_rotations(frame_num);
+    for(size_t i=0;i<bone_names.size();++i) {
+        const Motion::BoneTrack &track = *motion.FindBoneTrack(bone_names[i]);
+        BoneTrack &baked = bone_tracks[i];
+
+        baked.name_begin_ = (std::uint32_t)names.size();
+        baked.name_length_ = (std::uint32_t)bone_names[i].size();
+        names.insert(names.end(), bone_names[i].begin(), bone_names[i].end());
+
+        size_t cursor = 0;
+        for(size_t f=0;f<frame_num;++f) {
+            Motion::BonePose pose = Motion::GetBonePose(track, f, cursor);
+            for(size_t c=0;c<3;++c) {
+                frame_translations[f*3+c] = pose.GetTranslation().v[c];
+            }
+            frame_rotations[f] = pose.GetRotation().Normalize();
+            /* keep neighbouring frames in one hemisphere so sampling can lerp blindly */
+            if(f>0&&frame_rotations[f]*frame_rotations[f-1]<0.0f) {
+                frame_rotations[f] = -frame_rotations[f];
+            }
+        }
+
+        baked.rotation_stride_ = 0;
+        for(size_t f=1;f<frame_num;++f) {
+            if(frame_rotations[f]!=frame_rotations[0]) {
+                baked.rotation_stride_ = 1;
+                break;
+            }
+        }
+        size_t rotation_num = baked.rotation_stride_?frame_num:1;
+        rotations[i].resize(rotation_num*4);
+        for(size_t f=0;f<rotation_num;++f) {
+            for(size_t c=0;c<4;++c) {
+                rotations[i][f*4+c] = (std::int16_t)std::floor(frame_rotations[f].v[c]*32767.0f+0.5f);
+            }
+        }
+
+        baked.translation_stride_ = Quantize(
+            &frame_translations[0], frame_num, 3,
+            baked.translation_base_, baked.translation_scale_, translations[i]
+        );
+    }
+
+    std::vector<float> frame_weights(frame_num);
+    for(size_t i=0;i<morph_names.size();++i) {
+        const Motion::MorphTrack &track = *motion.FindMorphTrack(morph_names[i]);
+        MorphTrack &baked = morph_tracks[i];
+
+        baked.name_begin_ = (std::uint32_t)names.size();
+        baked.name_length_ = (std::uint32_t)morph_names[i].size();
+        names.insert(names.end(), morph_names[i].begin(), morph_names[i].end());
+
+        size_t cursor = 0;
+        for(size_t f=0;f<frame_num;++f) {
+            frame_weights[f] = Motion::GetMorphPose(track, f, cursor).GetWeight();
+        }
+
+        baked.weight_stride_ = Quantize(
+            &frame_weights[0], frame_num, 1,
+            &baked.weight_base_, &baked.weight_scale_, weights[i]
+        );
+    }
+
+    /* header, track tables, names, then the frame arrays, each 4-byte aligned */
+    Header header;
+    std::memcpy(header.magic_, GetMagic(), sizeof(header.magic_));
+    header.version_ = VERSION;
+    header.frame_num_ = (std::uint32_t)frame_num;
+    header.frame_rate_ = (float)motion.GetFrameRate();
+    header.bone_track_num_ = (std::uint32_t)bone_tracks.size();
+    header.morph_track_num_ = (std::uint32_t)morph_tracks.size();
+
+    size_t offset = sizeof(Header);
+    header.bone_table_offset_ = (std::uint32_t)offset;
+    offset += bone_tracks.size()*sizeof(BoneTrack);
+    header.morph_table_offset_ = (std::uint32_t)offset;
+    offset += morph_tracks.size()*sizeof(MorphTrack);
+    header.name_offset_ = (std::uint32_t)offset;
+    offset = Align(offset+names.size()*sizeof(std::uint16_t));
+    for(size_t i=0;i<bone_tracks.size();++i) {
+        bone_tracks[i].rotation_offset_ = (std::uint32_t)offset;
+        offset += rotations[i].size()*sizeof(std::int16_t);
+        bone_tracks[i].translation_offset_ = (std::uint32_t)offset;
+        offset = Align(offset+translations[i].size()*sizeof(std::uint16_t));
+    }
+    for(size_t i=0;i<morph_tracks.size();++i) {
+        morph_tracks[i].weight_offset_ = (std::uint32_t)offset;
+        offset = Align(offset+weights[i].size()*sizeof(std::uint16_t));
+    }
+    if(offset>0xFFFFFFFFu) {
+        throw exception(std::string("BakedMotion: Motion too large to bake."));
+    }
+    header.size_ = (std::uint32_t)offset;
+
+    buffer_.assign(offset, 0);
+    std::memcpy(&buffer_[0], &header, sizeof(Header));
+    if(!bone_tracks.empty()) {
+        std::memcpy(&buffer_[header.bone_table_offset_], &bone_tracks[0], bone_tracks.size()*sizeof(BoneTrack));
+    }
+    if(!morph_tracks.empty()) {
+        std::memcpy(&buffer_[header.morph_table_offset_], &morph_tracks[0], morph_tracks.size()*sizeof(MorphTrack));
+    }
+    if(!names.empty()) {
+        std::memcpy(&buffer_[header.name_offset_], &names[0], names.size()*sizeof(std::uint16_t));
+    }
+    for(size_t i=0;i<bone_tracks.size();++i) {
+        std::memcpy(&buffer_[bone_tracks[i].rotation_offset_], &rotations[i][0], rotations[i].size()*sizeof(std::int16_t));
+        std::memcpy(&buffer_[bone_tracks[i].translation_offset_], &translations[i][0], translations[i].size()*sizeof(std::uint16_t));
+    }
+    for(size_t i=0;i<morph_tracks.size();++i) {
+        std::memcpy(&buffer_[morph_tracks[i].weight_offset_], &weights[i][0], weights[i].size()*sizeof(std::uint16_t));
+    }
+
+    data_ = &buffer_[0];
+    size_ = buffer_.size();
+    Index();
+}
+
+inline void BakedMotion::Load(const std::wstring &filename) {
+    FileReader file(filename, false);
+    Clear();
+    buffer_.swap(file.GetBuffer());
+    data_ = &buffer_[0];
+    size_ = buffer_.size();
+    try {
+        Index();
+    } catch(...) {
+        Clear();
+        throw;
+    }
+}
+
+inline void BakedMotion::Save(const std::wstring &filename) const {
+    if(data_==NULL) {
+        throw exception(std::string("BakedMotion: Nothing to save."));
+    }
+#ifdef MMD_WINDOWS
+    FILE *f = _wfopen(filename.c_str(), L"wb");
+#else
+    FILE *f = fopen(UTF16ToNativeString(filename).c_str(), "wb");
+#endif
+    if(f==NULL) {
+        throw exception(std::string("BakedMotion: Cannot open file."));
+    }
+    size_t written = fwrite(data_, 1, size_, f);
+    fclose(f);
+    if(written!=size_) {
+        throw exception(std::string("BakedMotion: Cannot write file."));
+    }
+}
+
+inline void BakedMotion::Attach(const void *data, size_t size) {
+    Clear();
+    data_ = static_cast<const std::uint8_t*>(data);
+    size_ = size;
+    try {
+        Index();
+    } catch(...) {
+        Clear();
+        throw;
+    }
+}
+
+inline const void *BakedMotion::GetData() const {
+    return data_;
+}
+
+inline size_t BakedMotion::GetSize() const {
+    return size_;
+}
+
+inline void BakedMotion::Clear() {
+    buffer_type().swap(buffer_);
+    data_ = NULL;
+    size_ = 0;
+    bone_name_map_.clear();
+    morph_name_map_.clear();
+}
+
+inline void BakedMotion::Index() {
+    if(size_<sizeof(Header)) {
+        throw exception(std::string("BakedMotion: Truncated data."));
+    }
+    const Header &header = GetHeader();
+    if(std::memcmp(header.magic_, GetMagic(), sizeof(header.magic_))!=0) {
+        throw exception(std::string("BakedMotion: Not a baked motion."));
+    }
+    if(header.version_!=VERSION) {
+        throw exception(std::string("BakedMotion: Unsupported version."));
+    }
+    if(header.size_>size_||header.frame_num_==0||!(header.frame_rate_>0.0f)
+        ||header.bone_table_offset_+(size_t)header.bone_track_num_*sizeof(BoneTrack)>header.size_
+        ||header.morph_table_offset_+(size_t)header.morph_track_num_*sizeof(MorphTrack)>header.size_) {
+        throw exception(std::string("BakedMotion: Truncated data."));
+    }
+
+    for(size_t i=0;i<header.bone_track_num_;++i) {
+        const BoneTrack &track = GetBoneTrack(i);
+        size_t frame_num = track.rotation_stride_?header.frame_num_:1;
+        if(track.rotation_offset_+frame_num*4*sizeof(std::int16_t)>header.size_) {
+            throw exception(std::string("BakedMotion: Truncated data."));
+        }
+        frame_num = track.translation_stride_?header.frame_num_:1;
+        if(track.translation_offset_+frame_num*3*sizeof(std::uint16_t)>header.size_) {
+            throw exception(std::string("BakedMotion: Truncated data."));
+        }
+        bone_name_map_[GetName(track.name_begin_, track.name_length_)] = i;
+    }
+    for(size_t i=0;i<header.morph_track_num_;++i) {
+        const MorphTrack &track = GetMorphTrack(i);
+        size_t frame_num = track.weight_stride_?header.frame_num_:1;
+        if(track.weight_offset_+frame_num*sizeof(std::uint16_t)>header.size_) {
+            throw exception(std::string("BakedMotion: Truncated data."));
+        }
+        morph_name_map_[GetName(track.name_begin_, track.name_length_)] = i;
+    }
+}
+
+inline const BakedMotion::Header &BakedMotion::GetHeader() const {
+    return *reinterpret_cast<const Header*>(data_);
+}
+
+inline const BakedMotion::BoneTrack &BakedMotion::GetBoneTrack(size_t track) const {
+    return reinterpret_cast<const BoneTrack*>(data_+GetHeader().bone_table_offset_)[track];
+}
+
+inline const BakedMotion::MorphTrack &BakedMotion::GetMorphTrack(size_t track) const {
+    return reinterpret_cast<const MorphTrack*>(data_+GetHeader().morph_table_offset_)[track];
+}
+
+inline std::wstring BakedMotion::GetName(std::uint32_t begin, std::uint32_t length) const {
+    const Header &header = GetHeader();
+    if(header.name_offset_+((size_t)begin+length)*sizeof(std::uint16_t)>header.size_) {
+        throw exception(std::string("BakedMotion: Truncated data."));
+    }
+    const std::uint16_t *name = reinterpret_cast<const std::uint16_t*>(data_+header.name_offset_)+begin;
+    return std::wstring(name, name+length);
+}
+
+inline size_t BakedMotion::GetFrameNum() const {
+    return data_!=NULL?GetHeader().frame_num_:0;
+}
+
+inline double BakedMotion::GetFrameRate() const {
+    return data_!=NULL?GetHeader().frame_rate_:MMD_FRAME_RATE;
+}
+
+inline size_t BakedMotion::GetBoneTrackNum() const {
+    return data_!=NULL?GetHeader().bone_track_num_:0;
+}
+
+inline size_t BakedMotion::GetMorphTrackNum() const {
+    return data_!=NULL?GetHeader().morph_track_num_:0;
+}
+
+inline std::wstring BakedMotion::GetBoneName(size_t track) const {
+    const BoneTrack &baked = GetBoneTrack(track);
+    return GetName(baked.name_begin_, baked.name_length_);
+}
+
+inline std::wstring BakedMotion::GetMorphName(size_t track) const {
+    const MorphTrack &baked = GetMorphTrack(track);
+    return GetName(baked.name_begin_, baked.name_length_);
+}
+
+inline size_t BakedMotion::FindBoneTrack(const std::wstring &bone_name) const {
+    std::map<std::wstring, size_t>::const_iterator i = bone_name_map_.find(bone_name);
+    return i!=bone_name_map_.end()?i->second:nil;
+}
+
+inline size_t BakedMotion::FindMorphTrack(const std::wstring &morph_name) const {
+    std::map<std::wstring, size_t>::const_iterator i = morph_name_map_.find(morph_name);
+    return i!=morph_name_map_.end()?i->second:nil;
+}
+
+inline Vector3f BakedMotion::GetTranslation(const BoneTrack &track, size_t frame) const {
+    const std::uint16_t *q = reinterpret_cast<const std::uint16_t*>(data_+track.translation_offset_)+frame*track.translation_stride_*3;
+    Vector3f translation;
+    translation.p.x = track.translation_base_[0]+q[0]*track.translation_scale_[0];
+    translation.p.y = track.translation_base_[1]+q[1]*track.translation_scale_[1];
+    translation.p.z = track.translation_base_[2]+q[2]*track.translation_scale_[2];
+    return translation;
+}
+
+inline Vector4f BakedMotion::GetRotation(const BoneTrack &track, size_t frame) const {
+    const std::int16_t *q = reinterpret_cast<const std::int16_t*>(data_+track.rotation_offset_)+frame*track.rotation_stride_*4;
+    Vector4f rotation;
+    rotation.p.x = q[0];
+    rotation.p.y = q[1];
+    rotation.p.z = q[2];
+    rotation.p.w = q[3];
+    return rotation;
+}
+
+inline float BakedMotion::GetWeight(const MorphTrack &track, size_t frame) const {
+    const std::uint16_t *q = reinterpret_cast<const std::uint16_t*>(data_+track.weight_offset_)+frame*track.weight_stride_;
+    return track.weight_base_+q[0]*track.weight_scale_;
+}
+
+inline Motion::BonePose BakedMotion::GetBonePose(size_t track, size_t frame) const {
+    const BoneTrack &baked = GetBoneTrack(track);
+    frame = std::min(frame, GetFrameNum()-1);
+    return Motion::BonePose(GetTranslation(baked, frame), GetRotation(baked, frame).Normalize());
+}
+
+inline Motion::BonePose BakedMotion::GetBonePose(size_t track, double time) const {
+    const BoneTrack &baked = GetBoneTrack(track);
+    double dframe = time*GetHeader().frame_rate_;
+    size_t last = GetFrameNum()-1;
+    if(dframe<=0.0) {
+        return GetBonePose(track, size_t(0));
+    } else if(dframe>=(double)last) {
+        return GetBonePose(track, last);
+    }
+    size_t frame = (size_t)dframe;
+    float lambda = (float)(dframe-frame);
+    Vector3f translation = GetTranslation(baked, frame)*(1.0f-lambda)+GetTranslation(baked, frame+1)*lambda;
+    Vector4f rotation = GetRotation(baked, frame)*(1.0f-lambda)+GetRotation(baked, frame+1)*lambda;
+    return Motion::BonePose(translation, rotation.Normalize());
+}
+
+inline Motion::MorphPose BakedMotion::GetMorphPose(size_t track, size_t frame) const {
+    frame = std::min(frame, GetFrameNum()-1);
+    return Motion::MorphPose(GetWeight(GetMorphTrack(track), frame));
+}
+
+inline Motion::MorphPose BakedMotion::GetMorphPose(size_t track, double time) const {
+    const MorphTrack &baked = GetMorphTrack(track);
+    double dframe = time*GetHeader().frame_rate_;
+    size_t last = GetFrameNum()-1;
+    if(dframe<=0.0) {
+        return GetMorphPose(track, size_t(0));
+    } else if(dframe>=(double)last) {
+        return GetMorphPose(track, last);
+    }
+    size_t frame = (size_t)dframe;
+    float lambda = (float)(dframe-frame);
+    return Motion::MorphPose(GetWeight(baked, frame)*(1.0f-lambda)+GetWeight(baked, frame+1)*lambda);
+}
@@ -0,0 +1,127 @@
+
+/**
+             Copyright itsuhane@gmail.com, 2012.
+  Distributed under the Boost Software License, Version 1.0.
+      (See accompanying file LICENSE_1_0.txt or copy at
+            http://www.boost.org/LICENSE_1_0.txt)
+**/
+
+#ifndef __COMPRESSED_MOTION_HXX_5E0A7C91D24B6F38A1C97E20B58D4F63_INCLUDED__
+#define __COMPRESSED_MOTION_HXX_5E0A7C91D24B6F38A1C97E20B58D4F63_INCLUDED__
+
+namespace mmd {
+
+    /**
+      The keyframes of a Motion in a compact form that is decoded while
+      sampling, with the same interpolation as the Motion. Rotations are
+      smallest-three quaternions in 48 bits (the index of the dropped
+      largest component and the other three in 15 bits each), translations
+      and morph weights are uint16 in a per-track range, and a track whose
+      translation never changes keeps a single one. Curve ids are only
+      kept for tracks that have a non-linear curve.
+
+      Run Motion::Reduce() on the source first to drop the keyframes that
+      capture tools emit on every frame.
+    **/
+    class CompressedMotion {
+    public:
+        CompressedMotion();
+        CompressedMotion(const Motion &motion);
+
+        void Compress(const Motion &motion);
+        void Clear();
+
+        size_t GetLength() const;
+        double GetFrameRate() const;
+        /** Bytes held by the keyframe and curve tables. **/
+        size_t GetMemorySize() const;
+
+        size_t GetBoneTrackNum() const;
+        size_t GetMorphTrackNum() const;
+
+        const std::wstring &GetBoneName(size_t track) const;
+        const std::wstring &GetMorphName(size_t track) const;
+
+        /** Returns nil when the motion has no track of that name. **/
+        size_t FindBoneTrack(const std::wstring &bone_name) const;
+        size_t FindMorphTrack(const std::wstring &morph_name) const;
+
+        Motion::BonePose GetBonePose(size_t track, size_t frame) const;
+        Motion::BonePose GetBonePose(size_t track, double time) const;
+        Motion::MorphPose GetMorphPose(size_t track, size_t frame) const;
+        Motion::MorphPose GetMorphPose(size_t track, double time) const;
+
+        /** Sequential sampling, see Motion::KeyframeTrack::Locate(). **/
+        Motion::BonePose GetBonePose(size_t track, size_t frame, size_t &cursor) const;
+        Motion::BonePose GetBonePose(size_t track, double time, size_t &cursor) const;
+        Motion::MorphPose GetMorphPose(size_t track, size_t frame, size_t &cursor) const;
+        Motion::MorphPose GetMorphPose(size_t track, double time, size_t &cursor) const;
+
+        /** packed holds 3 values; the sign of the rotation is not kept. **/
+        static void EncodeRotation(const Vector4f &rotation, std::uint16_t *packed);
+        static Vector4f DecodeRotation(const std::uint16_t *packed);
+
+    private:
+        /* keyframes of a track are [key_begin_, key_begin_+key_num_) of its frame table */
+        struct BoneTrack {
+            size_t key_begin_;
+            size_t key_num_;
+            size_t translation_begin_;
+            size_t translation_stride_;
+            /* nil when every curve is linear */
+            size_t curve_begin_;
+            float translation_base_[3];
+            float translation_scale_[3];
+        };
+
+        struct MorphTrack {
+            size_t key_begin_;
+            size_t key_num_;
+            size_t curve_begin_;
+            float weight_base_;
+            float weight_scale_;
+        };
+
+        Vector3f GetTranslation(const BoneTrack &track, size_t index) const;
+        Vector4f GetRotation(const BoneTrack &track, size_t index) const;
+        float GetWeight(const MorphTrack &track, size_t index) const;
+        /** channel is 0-3 for the x, y, z and rotation curve. **/
+        std::uint16_t GetBoneCurve(const BoneTrack &track, size_t index, size_t channel) const;
+        std::uint16_t GetMorphCurve(const MorphTrack &track, size_t index) const;
+        float EvaluateCurve(std::uint16_t curve, float x) const;
+
+        Motion::BonePose SampleBonePose(const BoneTrack &track, double dframe, size_t &cursor) const;
+        Motion::MorphPose SampleMorphPose(const MorphTrack &track, double dframe, size_t &cursor) const;
+        Motion::BonePose InterpolateBonePose(const BoneTrack &track, size_t left, float bary_pos) const;
+        Motion::MorphPose InterpolateMorphPose(const MorphTrack &track, size_t left, float bary_pos) const;
+
+        size_t length_;
+        double frame_rate_;
+
+        std::vector<BoneTrack> bone_tracks_;
+        std::vector<std::uint32_t> bone_frames_;
+        /* 3 per keyframe */
+        std::vector<std::uint16_t> rotations_;
+        /* 3 per keyframe, or 3 per track when constant */
+        std::vector<std::uint16_t> translations_;
+        /* x, y, z and rotation curve of each keyframe of tracks with curves */
+        std::vector<std::uint16_t> bone_curves_;
+
+        std::vector<MorphTrack> morph_tracks_;
+        std::vector<std::uint32_t> morph_frames_;
+        std::vector<std::uint16_t> weights_;
+        std::vector<std::uint16_t> morph_curves_;
+
+        std::vector<interpolator> curves_;
+
+        std::vector<std::wstring> bone_names_;
+        std::vector<std::wstring> morph_names_;
+        std::map<std::wstring, size_t> bone_name_map_;
+        std::map<std::wstring, size_t> morph_name_map_;
+    };
+
+#include "compressed_motion_impl.inl"
+
+} /* End of namespace mmd */
+
+#endif /* __COMPRESSED_MOTION_HXX_5E0A7C91D24B6F38A1C97E20B58D4F63_INCLUDED__ */
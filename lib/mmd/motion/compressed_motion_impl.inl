@@ -0,0 +1,357 @@
+
+/**
+             Copyright itsuhane@gmail.com, 2012.
+  Distributed under the Boost Software License, Version 1.0.
+      (See accompanying file LICENSE_1_0.txt or copy at
+            http://www.boost.org/LICENSE_1_0.txt)
+**/
+
+inline CompressedMotion::CompressedMotion() : length_(0), frame_rate_(MMD_FRAME_RATE) {}
+
+inline CompressedMotion::CompressedMotion(const Motion &motion) : length_(0), frame_rate_(MMD_FRAME_RATE) {
+    Compress(motion);
+}
+
+inline void CompressedMotion::Compress(const Motion &motion) {
+    Clear();
+
+    length_ = motion.GetLength();
+    frame_rate_ = motion.GetFrameRate();
+    for(size_t i=0;i<motion.GetCurveNum();++i) {
+        curves_.push_back(motion.GetCurve(i));
+    }
+
+    bone_names_ = motion.GetBoneNames();
+    bone_tracks_.resize(bone_names_.size());
+    std::vector<float> key_translations;
+    std::vector<std::uint16_t> quantized;
+    for(size_t i=0;i<bone_names_.size();++i) {
+        const Motion::BoneTrack &track = *motion.FindBoneTrack(bone_names_[i]);
+        BoneTrack &compressed = bone_tracks_[i];
+        size_t n = track.GetKeyframeNum();
+
+        compressed.key_begin_ = bone_frames_.size();
+        compressed.key_num_ = n;
+        compressed.curve_begin_ = nil;
+        key_translations.resize(n*3);
+        for(size_t k=0;k<n;++k) {
+            bone_frames_.push_back((std::uint32_t)track.GetFrame(k));
+
+            std::uint16_t packed[3];
+            EncodeRotation(track.GetRotation(k), packed);
+            rotations_.insert(rotations_.end(), packed, packed+3);
+
+            for(size_t c=0;c<3;++c) {
+                key_translations[k*3+c] = track.GetTranslation(k).v[c];
+            }
+
+            if(track.GetXCurve(k)!=Motion::LINEAR_CURVE||track.GetYCurve(k)!=Motion::LINEAR_CURVE
+                ||track.GetZCurve(k)!=Motion::LINEAR_CURVE||track.GetRCurve(k)!=Motion::LINEAR_CURVE) {
+                compressed.curve_begin_ = 0;
+            }
+        }
+
+        compressed.translation_begin_ = translations_.size();
+        compressed.translation_stride_ = 0;
+        if(n>0) {
+            compressed.translation_stride_ = BakedMotion::Quantize(
+                &key_translations[0], n, 3,
+                compressed.translation_base_, compressed.translation_scale_, quantized
+            );
+            translations_.insert(translations_.end(), quantized.begin(), quantized.end());
+        }
+
+        if(compressed.curve_begin_!=nil) {
+            compressed.curve_begin_ = bone_curves_.size();
+            for(size_t k=0;k<n;++k) {
+                bone_curves_.push_back(track.GetXCurve(k));
+                bone_curves_.push_back(track.GetYCurve(k));
+                bone_curves_.push_back(track.GetZCurve(k));
+                bone_curves_.push_back(track.GetRCurve(k));
+            }
+        }
+        bone_name_map_[bone_names_[i]] = i;
+    }
+
+    morph_names_ = motion.GetMorphNames();
+    morph_tracks_.resize(morph_names_.size());
+    std::vector<float> key_weights;
+    for(size_t i=0;i<morph_names_.size();++i) {
+        const Motion::MorphTrack &track = *motion.FindMorphTrack(morph_names_[i]);
+        MorphTrack &compressed = morph_tracks_[i];
+        size_t n = track.GetKeyframeNum();
+
+        compressed.key_begin_ = morph_frames_.size();
+        compressed.key_num_ = n;
+        compressed.curve_begin_ = nil;
+        key_weights.resize(n);
+        for(size_t k=0;k<n;++k) {
+            morph_frames_.push_back((std::uint32_t)track.GetFrame(k));
+            key_weights[k] = track.GetWeight(k);
+            if(track.GetWeightCurve(k)!=Motion::LINEAR_CURVE) {
+                compressed.curve_begin_ = 0;
+            }
+        }
+
+        /* weights keep one value per keyframe so that they share the frame index */
+        compressed.weight_base_ = 0.0f;
+        compressed.weight_scale_ = 0.0f;
+        if(n>0) {
+            BakedMotion::Quantize(&key_weights[0], n, 1, &compressed.weight_base_, &compressed.weight_scale_, quantized);
+            quantized.resize(n, quantized[0]);
+            weights_.insert(weights_.end(), quantized.begin(), quantized.end());
+        }
+
+        if(compressed.curve_begin_!=nil) {
+            compressed.curve_begin_ = morph_curves_.size();
+            for(size_t k=0;k<n;++k) {
+                morph_curves_.push_back(track.GetWeightCurve(k));
+            }
+        }
+        morph_name_map_[morph_names_[i]] = i;
+    }
+}
+
+inline void CompressedMotion::Clear() {
+    length_ = 0;
+    frame_rate_ = MMD_FRAME_RATE;
+    bone_tracks_.clear();
+    bone_frames_.clear();
+    rotations_.clear();
+    translations_.clear();
+    bone_curves_.clear();
+    morph_tracks_.clear();
+    morph_frames_.clear();
+    weights_.clear();
+    morph_curves_.clear();
+    curves_.clear();
+    bone_names_.clear();
+    morph_names_.clear();
+    bone_name_map_.clear();
+    morph_name_map_.clear();
+}
+
+inline size_t CompressedMotion::GetLength() const {
+    return length_;
+}
+
+inline double CompressedMotion::GetFrameRate() const {
+    return frame_rate_;
+}
+
+inline size_t CompressedMotion::GetMemorySize() const {
+    return bone_tracks_.size()*sizeof(BoneTrack)
+        +bone_frames_.size()*sizeof(std::uint32_t)
+        +rotations_.size()*sizeof(std::uint16_t)
+        +translations_.size()*sizeof(std::uint16_t)
+        +bone_curves_.size()*sizeof(std::uint16_t)
+        +morph_tracks_.size()*sizeof(MorphTrack)
+        +morph_frames_.size()*sizeof(std::uint32_t)
+        +weights_.size()*sizeof(std::uint16_t)
+        +morph_curves_.size()*sizeof(std::uint16_t)
+        +curves_.size()*sizeof(interpolator);
+}
+
+inline size_t CompressedMotion::GetBoneTrackNum() const {
+    return bone_tracks_.size();
+}
+
+inline size_t CompressedMotion::GetMorphTrackNum() const {
+    return morph_tracks_.size();
+}
+
+inline const std::wstring &CompressedMotion::GetBoneName(size_t track) const {
+    return bone_names_[track];
+}
+
+inline const std::wstring &CompressedMotion::GetMorphName(size_t track) const {
+    return morph_names_[track];
+}
+
+inline size_t CompressedMotion::FindBoneTrack(const std::wstring &bone_name) const {
+    std::map<std::wstring, size_t>::const_iterator i = bone_name_map_.find(bone_name);
+    return i!=bone_name_map_.end()?i->second:nil;
+}
+
+inline size_t CompressedMotion::FindMorphTrack(const std::wstring &morph_name) const {
+    std::map<std::wstring, size_t>::const_iterator i = morph_name_map_.find(morph_name);
+    return i!=morph_name_map_.end()?i->second:nil;
+}
+
+inline void CompressedMotion::EncodeRotation(const Vector4f &rotation, std::uint16_t *packed) {
+    Vector4f q = rotation.Normalize();
+    size_t largest = 0;
+    for(size_t c=1;c<4;++c) {
+        if(math::abs(q.v[c])>math::abs(q.v[largest])) {
+            largest = c;
+        }
+    }
+    /* q and -q are the same rotation, so the dropped component is made positive */
+    float sign = q.v[largest]<0.0f?-1.0f:1.0f;
+    const float bound = float(mmd_math_const_sqrt2)*0.5f;
+    const float scale = 32767.0f/(2.0f*bound);
+    size_t k = 0;
+    for(size_t c=0;c<4;++c) {
+        if(c==largest) {
+            continue;
+        }
+        float u = math::clamp(std::floor((q.v[c]*sign+bound)*scale+0.5f), 0.0f, 32767.0f);
+        packed[k] = (std::uint16_t)u;
+        ++k;
+    }
+    packed[0] |= std::uint16_t((largest&1)<<15);
+    packed[1] |= std::uint16_t((largest>>1)<<15);
+}
+
+inline Vector4f CompressedMotion::DecodeRotation(const std::uint16_t *packed) {
+    size_t largest = (packed[0]>>15)|((packed[1]>>15)<<1);
+    const float bound = float(mmd_math_const_sqrt2)*0.5f;
+    const float scale = 2.0f*bound/32767.0f;
+    Vector4f q;
+    float sum = 0.0f;
+    size_t k = 0;
+    for(size_t c=0;c<4;++c) {
+        if(c==largest) {
+            continue;
+        }
+        q.v[c] = (packed[k]&0x7FFF)*scale-bound;
+        sum += q.v[c]*q.v[c];
+        ++k;
+    }
+    q.v[largest] = std::sqrt(std::max(0.0f, 1.0f-sum));
+    return q;
+}
+
+inline Vector3f CompressedMotion::GetTranslation(const BoneTrack &track, size_t index) const {
+    const std::uint16_t *q = &translations_[track.translation_begin_+index*track.translation_stride_*3];
+    Vector3f translation;
+    translation.p.x = track.translation_base_[0]+q[0]*track.translation_scale_[0];
+    translation.p.y = track.translation_base_[1]+q[1]*track.translation_scale_[1];
+    translation.p.z = track.translation_base_[2]+q[2]*track.translation_scale_[2];
+    return translation;
+}
+
+inline Vector4f CompressedMotion::GetRotation(const BoneTrack &track, size_t index) const {
+    return DecodeRotation(&rotations_[(track.key_begin_+index)*3]);
+}
+
+inline float CompressedMotion::GetWeight(const MorphTrack &track, size_t index) const {
+    return track.weight_base_+weights_[track.key_begin_+index]*track.weight_scale_;
+}
+
+inline std::uint16_t CompressedMotion::GetBoneCurve(const BoneTrack &track, size_t index, size_t channel) const {
+    return track.curve_begin_!=nil?bone_curves_[track.curve_begin_+index*4+channel]:std::uint16_t(Motion::LINEAR_CURVE);
+}
+
+inline std::uint16_t CompressedMotion::GetMorphCurve(const MorphTrack &track, size_t index) const {
+    return track.curve_begin_!=nil?morph_curves_[track.curve_begin_+index]:std::uint16_t(Motion::LINEAR_CURVE);
+}
+
+inline float CompressedMotion::EvaluateCurve(std::uint16_t curve, float x) const {
+    return curve!=Motion::LINEAR_CURVE?curves_[curve][x]:x;
+}
+
+inline Motion::BonePose CompressedMotion::GetBonePose(size_t track, size_t frame) const {
+    size_t cursor = nil;
+    return GetBonePose(track, frame, cursor);
+}
+
+inline Motion::BonePose CompressedMotion::GetBonePose(size_t track, double time) const {
+    size_t cursor = nil;
+    return GetBonePose(track, time, cursor);
+}
+
+inline Motion::BonePose CompressedMotion::GetBonePose(size_t track, size_t frame, size_t &cursor) const {
+    return SampleBonePose(bone_tracks_[track], (double)frame, cursor);
+}
+
+inline Motion::BonePose CompressedMotion::GetBonePose(size_t track, double time, size_t &cursor) const {
+    return SampleBonePose(bone_tracks_[track], time*frame_rate_, cursor);
+}
+
+inline Motion::BonePose CompressedMotion::SampleBonePose(const BoneTrack &compressed, double dframe, size_t &cursor) const {
+    size_t n = compressed.key_num_;
+    if(n==0) {
+        Vector4f rot;
+        rot.q.MakeIdentity();
+        return Motion::BonePose(Vector3f(), rot);
+    }
+
+    const std::uint32_t *frames = &bone_frames_[compressed.key_begin_];
+
+    if(frames[0]>=dframe) {
+        return Motion::BonePose(GetTranslation(compressed, 0), GetRotation(compressed, 0));
+    } else if(frames[n-1]<=dframe) {
+        return Motion::BonePose(GetTranslation(compressed, n-1), GetRotation(compressed, n-1));
+    } else {
+        size_t left = LocateKeyframe(frames, n, size_t(dframe), cursor);
+        size_t left_frame = frames[left];
+        size_t right_frame = frames[left+1];
+
+        float bary_pos
+            = (float)((dframe-left_frame)/(right_frame-left_frame));
+        return InterpolateBonePose(compressed, left, bary_pos);
+    }
+}
+
+inline Motion::BonePose CompressedMotion::InterpolateBonePose(const BoneTrack &track, size_t left, float bary_pos) const {
+    Vector3f l_translation = GetTranslation(track, left);
+    Vector4f l_rotation = GetRotation(track, left);
+    Vector3f r_translation = GetTranslation(track, left+1);
+    Vector4f r_rotation = GetRotation(track, left+1);
+
+    Vector3f translation;
+    for(size_t c=0;c<3;++c) {
+        float lambda = EvaluateCurve(GetBoneCurve(track, left, c), bary_pos);
+        translation.v[c] = l_translation.v[c]*(1-lambda)+r_translation.v[c]*lambda;
+    }
+
+    float lambda = EvaluateCurve(GetBoneCurve(track, left, 3), bary_pos);
+    return Motion::BonePose(translation, NLerp(l_rotation, r_rotation)[lambda]);
+}
+
+inline Motion::MorphPose CompressedMotion::GetMorphPose(size_t track, size_t frame) const {
+    size_t cursor = nil;
+    return GetMorphPose(track, frame, cursor);
+}
+
+inline Motion::MorphPose CompressedMotion::GetMorphPose(size_t track, double time) const {
+    size_t cursor = nil;
+    return GetMorphPose(track, time, cursor);
+}
+
+inline Motion::MorphPose CompressedMotion::GetMorphPose(size_t track, size_t frame, size_t &cursor) const {
+    return SampleMorphPose(morph_tracks_[track], (double)frame, cursor);
+}
+
+inline Motion::MorphPose CompressedMotion::GetMorphPose(size_t track, double time, size_t &cursor) const {
+    return SampleMorphPose(morph_tracks_[track], time*frame_rate_, cursor);
+}
+
+inline Motion::MorphPose CompressedMotion::SampleMorphPose(const MorphTrack &compressed, double dframe, size_t &cursor) const {
+    size_t n = compressed.key_num_;
+    if(n==0) {
+        return Motion::MorphPose(0.0f);
+    }
+
+    const std::uint32_t *frames = &morph_frames_[compressed.key_begin_];
+
+    if(frames[0]>=dframe) {
+        return Motion::MorphPose(GetWeight(compressed, 0));
+    } else if(frames[n-1]<=dframe) {
+        return Motion::MorphPose(GetWeight(compressed, n-1));
+    } else {
+        size_t left = LocateKeyframe(frames, n, size_t(dframe), cursor);
+        size_t left_frame = frames[left];
+        size_t right_frame = frames[left+1];
+
+        float bary_pos
+            = (float)((dframe-left_frame)/(right_frame-left_frame));
+        return InterpolateMorphPose(compressed, left, bary_pos);
+    }
+}
+
+inline Motion::MorphPose CompressedMotion::InterpolateMorphPose(const MorphTrack &track, size_t left, float bary_pos) const {
+    float lambda = EvaluateCurve(GetMorphCurve(track, left), bary_pos);
+    return Motion::MorphPose(GetWeight(track, left)*(1-lambda)+GetWeight(track, left+1)*lambda);
+}
@@ -11,6 +11,15 @@
 
 namespace mmd {
 
+    /**
+      Returns the index of the last of n sorted frames at or before frame,
+      or 0 if it precedes them all. cursor is the index returned for the
+      previous sample: forward playback only steps past a few frames from
+      it and anything else falls back to a binary search. Shared by the
+      motion and camera tracks.
+    **/
+    size_t LocateKeyframe(const std::uint32_t *frames, size_t n, size_t frame, size_t &cursor);
+
     class Motion {
     public:
         class BonePose {
@@ -71,16 +80,128 @@ namespace mmd {
             interpolator w_interpolator_;
         };
 
+        /**
+          Keyframe curves are interned into a table per motion and tracks
+          only keep their index in it. Linear curves are not stored and
+          use LINEAR_CURVE instead.
+        **/
+        enum { LINEAR_CURVE = 0xFFFF };
+
+        /**
+          A track holds every keyframe of one bone or morph, sorted by frame
+          and stored as parallel arrays. Locate() returns the keyframe at or
+          before a frame. It takes a cursor, the index it returned for the
+          previous sample: forward playback then only steps past a few
+          keyframes and a seek falls back to a binary search. A cursor of 0
+          is always valid.
+
+          Track handles returned by FindBoneTrack/FindMorphTrack stay valid
+          until that track is unregistered or the motion is cleared, and
+          sampling through them skips the name lookup.
+        **/
+        class KeyframeTrack {
+            friend class Motion;
+        public:
+            KeyframeTrack();
+
+            size_t GetKeyframeNum() const;
+            size_t GetFrame(size_t index) const;
+
+            /** Returns nil if there is no keyframe at the frame. **/
+            size_t Find(size_t frame) const;
+            /** Returns 0 if the frame precedes every keyframe. **/
+            size_t Locate(size_t frame, size_t &cursor) const;
+
+            float EvaluateCurve(std::uint16_t curve, float x) const;
+            /** The frame rate of the motion holding the track. **/
+            double GetFrameRate() const;
+
+        protected:
+            /** Index of the keyframe at the frame, inserted if missing. **/
+            size_t Insert(size_t frame, bool &inserted);
+
+            interpolator GetCurve(std::uint16_t curve) const;
+
+            std::vector<std::uint32_t> frames_;
+            const Motion *motion_;
+        };
+
+        class BoneTrack : public KeyframeTrack {
+            friend class Motion;
+        public:
+            const Vector3f &GetTranslation(size_t index) const;
+            const Vector4f &GetRotation(size_t index) const;
+            std::uint16_t GetXCurve(size_t index) const;
+            std::uint16_t GetYCurve(size_t index) const;
+            std::uint16_t GetZCurve(size_t index) const;
+            std::uint16_t GetRCurve(size_t index) const;
+
+            BoneKeyframe GetKeyframe(size_t index) const;
+            /** curves are the x, y, z and rotation curve. **/
+            void SetKeyframe(
+                size_t frame, const Vector3f &translation,
+                const Vector4f &rotation, const std::uint16_t *curves
+            );
+            /** num keyframes at once, appended when the frames ascend; 4 curves each. **/
+            void SetKeyframes(
+                size_t num, const std::uint32_t *frames, const Vector3f *translations,
+                const Vector4f *rotations, const std::uint16_t *curves
+            );
+
+        private:
+            /** Keeps only the keyframes at the given ascending indices. **/
+            void Retain(const std::vector<size_t> &indices);
+
+            std::vector<Vector3f> translations_;
+            std::vector<Vector4f> rotations_;
+            /* x, y, z and rotation curve of each keyframe */
+            std::vector<std::uint16_t> curve_ids_;
+        };
+
+        class MorphTrack : public KeyframeTrack {
+            friend class Motion;
+        public:
+            float GetWeight(size_t index) const;
+            std::uint16_t GetWeightCurve(size_t index) const;
+
+            MorphKeyframe GetKeyframe(size_t index) const;
+            void SetKeyframe(size_t frame, float weight, std::uint16_t curve);
+            void SetKeyframes(
+                size_t num, const std::uint32_t *frames, const float *weights,
+                const std::uint16_t *curves
+            );
+
+        private:
+            void Retain(const std::vector<size_t> &indices);
+
+            std::vector<float> weights_;
+            std::vector<std::uint16_t> curve_ids_;
+        };
+
         Motion();
+        Motion(const Motion &motion);
+        Motion &operator=(const Motion &motion);
 
         const std::wstring &GetName() const;
         void SetName(const std::wstring &name);
 
-        const BoneKeyframe &GetBoneKeyframe(
+        BoneKeyframe GetBoneKeyframe(
             const std::wstring &bone_name, size_t frame
         ) const;
-        BoneKeyframe &GetBoneKeyframe(
-            const std::wstring &bone_name, size_t frame
+        void SetBoneKeyframe(
+            const std::wstring &bone_name, size_t frame,
+            const BoneKeyframe &keyframe
+        );
+        void SetBoneKeyframe(
+            const std::wstring &bone_name, size_t frame,
+            const Vector3f &translation, const Vector4f &rotation,
+            const std::uint16_t *curves
+        );
+        /** See BoneTrack::SetKeyframes(). **/
+        void SetBoneKeyframes(
+            const std::wstring &bone_name, size_t num,
+            const std::uint32_t *frames, const Vector3f *translations,
+            const Vector4f *rotations, const std::uint16_t *curves
         );
 
         BonePose GetBonePose(
@@ -90,12 +211,31 @@ namespace mmd {
             const std::wstring &bone_name, double time
         ) const;
 
-        const MorphKeyframe &GetMorphKeyframe(
+        MorphKeyframe GetMorphKeyframe(
             const std::wstring &morph_name, size_t frame
         ) const;
-        MorphKeyframe &GetMorphKeyframe(
-            const std::wstring &morph_name, size_t frame
+        void SetMorphKeyframe(
+            const std::wstring &morph_name, size_t frame,
+            const MorphKeyframe &keyframe
         );
+        void SetMorphKeyframe(
+            const std::wstring &morph_name, size_t frame,
+            float weight, std::uint16_t curve
+        );
+        void SetMorphKeyframes(
+            const std::wstring &morph_name, size_t num,
+            const std::uint32_t *frames, const float *weights,
+            const std::uint16_t *curves
+        );
+
+        /** Returns the id of the curve, adding it to the table if new. **/
+        std::uint16_t InternCurve(const Vector2f &c_0, const Vector2f &c_1);
+        std::uint16_t InternCurve(const interpolator &curve);
+        size_t GetCurveNum() const;
+        const interpolator &GetCurve(size_t curve) const;
+
+        /** Curves are evaluated from one flat table of their presamples. **/
+        float EvaluateCurve(std::uint16_t curve, float x) const;
 
         MorphPose GetMorphPose(
             const std::wstring &morph_name, size_t frame
@@ -104,6 +244,20 @@ namespace mmd {
             const std::wstring &morph_name, double time
         ) const;
 
+        const BoneTrack *FindBoneTrack(const std::wstring &bone_name) const;
+        const MorphTrack *FindMorphTrack(const std::wstring &morph_name) const;
+
+        static BonePose GetBonePose(const BoneTrack &track, size_t frame);
+        static BonePose GetBonePose(const BoneTrack &track, double time);
+        static MorphPose GetMorphPose(const MorphTrack &track, size_t frame);
+        static MorphPose GetMorphPose(const MorphTrack &track, double time);
+
+        /** Sequential sampling, see KeyframeTrack::Locate(). **/
+        static BonePose GetBonePose(const BoneTrack &track, size_t frame, size_t &cursor);
+        static BonePose GetBonePose(const BoneTrack &track, double time, size_t &cursor);
+        static MorphPose GetMorphPose(const MorphTrack &track, size_t frame, size_t &cursor);
+        static MorphPose GetMorphPose(const MorphTrack &track, double time, size_t &cursor);
+
         void RegisterBone(const std::wstring &bone_name);
         void RegisterMorph(const std::wstring &morph_name);
 
@@ -113,6 +267,9 @@ namespace mmd {
         bool IsBoneRegistered(const std::wstring &bone_name) const;
         bool IsMorphRegistered(const std::wstring &morph_name) const;
 
+        std::vector<std::wstring> GetBoneNames() const;
+        std::vector<std::wstring> GetMorphNames() const;
+
         size_t QueryBoneKeyframeForward(const std::wstring &bone_name, size_t frame) const;
         size_t QueryBoneKeyframeBackward(const std::wstring &bone_name, size_t frame) const;
 
@@ -122,11 +279,53 @@ namespace mmd {
         size_t GetLength() const;
         void Clear();
 
+        /** Frames per second of the keyframe numbers, MMD_FRAME_RATE by default. **/
+        double GetFrameRate() const;
+        void SetFrameRate(double frame_rate);
+
+        /**
+          Drops every keyframe the remaining ones reproduce at each frame
+          within the bounds: rotation_error in radians, translation_error
+          in model units and weight_error in morph weight. The first and
+          last keyframe of a track are kept. Returns the number dropped.
+        **/
+        size_t Reduce(float rotation_error, float translation_error, float weight_error);
+
     private:
+        static BonePose InterpolateBonePose(const BoneTrack &track, size_t left, size_t right, float bary_pos);
+        static MorphPose InterpolateMorphPose(const MorphTrack &track, size_t left, size_t right, float bary_pos);
+
+        template <typename Track, typename Pose> static size_t ReduceTrack(Track &track, float bound_0, float bound_1);
+        template <typename Track, typename Pose> static bool IsSpanRedundant(
+            const Track &track, size_t left, size_t right,
+            const std::vector<Pose> &reference, float bound_0, float bound_1
+        );
+        static BonePose SampleTrack(const BoneTrack &track, size_t frame, size_t &cursor);
+        static MorphPose SampleTrack(const MorphTrack &track, size_t frame, size_t &cursor);
+        static BonePose InterpolateTrack(const BoneTrack &track, size_t left, size_t right, float bary_pos);
+        static MorphPose InterpolateTrack(const MorphTrack &track, size_t left, size_t right, float bary_pos);
+        /* bound_0 is the cosine of half the rotation error and bound_1 the squared translation error for bones, bound_0 the weight error for morphs */
+        static bool IsPoseClose(const BonePose &pose, const BonePose &reference, float bound_0, float bound_1);
+        static bool IsPoseClose(const MorphPose &pose, const MorphPose &reference, float bound_0, float bound_1);
+
+        void BindTracks();
+
+        struct CurveKey {
+            CurveKey(const Vector2f &c_0, const Vector2f &c_1);
+            bool operator<(const CurveKey &key) const;
+            float c_[4];
+        };
+
         std::wstring name_;
         size_t length_;
-        std::map<std::wstring, std::map<size_t, BoneKeyframe>> bone_motions_;
-        std::map<std::wstring, std::map<size_t, MorphKeyframe>> morph_motions_;
+        double frame_rate_;
+        std::map<std::wstring, BoneTrack> bone_motions_;
+        std::map<std::wstring, MorphTrack> morph_motions_;
+
+        std::vector<interpolator> curves_;
+        /* presamples of every curve back to back, for EvaluateCurve() */
+        std::vector<float> curve_samples_;
+        std::map<CurveKey, std::uint16_t> curve_map_;
     };
 
     class Pose {
@@ -6,6 +6,23 @@
             http://www.boost.org/LICENSE_1_0.txt)
 **/
 
+inline size_t LocateKeyframe(const std::uint32_t *frames, size_t n, size_t frame, size_t &cursor) {
+    size_t i = cursor;
+    if(i<n&&frames[i]<=frame) {
+        /* playback passes at most a few keyframes per sample */
+        for(size_t step=0;step<4;++step) {
+            if(i+1==n||frames[i+1]>frame) {
+                cursor = i;
+                return i;
+            }
+            ++i;
+        }
+    }
+    i = std::upper_bound(frames, frames+n, frame)-frames;
+    cursor = i>0?i-1:0;
+    return cursor;
+}
+
 inline
 Motion::BonePose::BonePose(
     const Vector3f &translation, const Vector4f &rotation
@@ -110,14 +127,234 @@ Motion::MorphKeyframe::GetWeightInterpolator() {
     return w_interpolator_;
 }
 
+inline
+Motion::KeyframeTrack::KeyframeTrack() : motion_(NULL) {}
+
+inline size_t
+Motion::KeyframeTrack::GetKeyframeNum() const {
+    return frames_.size();
+}
+
+inline size_t
+Motion::KeyframeTrack::GetFrame(size_t index) const {
+    return frames_[index];
+}
+
+inline size_t
+Motion::KeyframeTrack::Find(size_t frame) const {
+    std::vector<std::uint32_t>::const_iterator i = std::lower_bound(frames_.begin(), frames_.end(), frame);
+    if(i!=frames_.end()&&*i==frame) {
+        return i-frames_.begin();
+    } else {
+        return nil;
+    }
+}
+
+inline size_t
+Motion::KeyframeTrack::Locate(size_t frame, size_t &cursor) const {
+    return LocateKeyframe(frames_.empty()?NULL:&frames_[0], frames_.size(), frame, cursor);
+}
+
+inline size_t
+Motion::KeyframeTrack::Insert(size_t frame, bool &inserted) {
+    /* keyframes mostly arrive in order, which appends */
+    if(frames_.empty()||frames_.back()<frame) {
+        inserted = true;
+        frames_.push_back(std::uint32_t(frame));
+        return frames_.size()-1;
+    }
+    std::vector<std::uint32_t>::iterator i = std::lower_bound(frames_.begin(), frames_.end(), frame);
+    size_t index = i-frames_.begin();
+    inserted = (*i!=frame);
+    if(inserted) {
+        frames_.insert(i, std::uint32_t(frame));
+    }
+    return index;
+}
+
+inline float
+Motion::KeyframeTrack::EvaluateCurve(std::uint16_t curve, float x) const {
+    return motion_->EvaluateCurve(curve, x);
+}
+
+inline double
+Motion::KeyframeTrack::GetFrameRate() const {
+    return motion_->GetFrameRate();
+}
+
+inline interpolator
+Motion::KeyframeTrack::GetCurve(std::uint16_t curve) const {
+    if(curve==LINEAR_CURVE) {
+        return interpolator();
+    } else {
+        return motion_->GetCurve(curve);
+    }
+}
+
+inline const Vector3f&
+Motion::BoneTrack::GetTranslation(size_t index) const {
+    return translations_[index];
+}
+
+inline const Vector4f&
+Motion::BoneTrack::GetRotation(size_t index) const {
+    return rotations_[index];
+}
+
+inline std::uint16_t
+Motion::BoneTrack::GetXCurve(size_t index) const {
+    return curve_ids_[index*4];
+}
+
+inline std::uint16_t
+Motion::BoneTrack::GetYCurve(size_t index) const {
+    return curve_ids_[index*4+1];
+}
+
+inline std::uint16_t
+Motion::BoneTrack::GetZCurve(size_t index) const {
+    return curve_ids_[index*4+2];
+}
+
+inline std::uint16_t
+Motion::BoneTrack::GetRCurve(size_t index) const {
+    return curve_ids_[index*4+3];
+}
+
+inline Motion::BoneKeyframe
+Motion::BoneTrack::GetKeyframe(size_t index) const {
+    BoneKeyframe keyframe;
+    keyframe.SetTranslation(translations_[index]);
+    keyframe.SetRotation(rotations_[index]);
+    keyframe.GetXInterpolator() = GetCurve(curve_ids_[index*4]);
+    keyframe.GetYInterpolator() = GetCurve(curve_ids_[index*4+1]);
+    keyframe.GetZInterpolator() = GetCurve(curve_ids_[index*4+2]);
+    keyframe.GetRInterpolator() = GetCurve(curve_ids_[index*4+3]);
+    return keyframe;
+}
+
+inline void
+Motion::BoneTrack::SetKeyframe(size_t frame, const Vector3f &translation, const Vector4f &rotation, const std::uint16_t *curves) {
+    bool inserted;
+    size_t index = Insert(frame, inserted);
+    if(inserted) {
+        translations_.insert(translations_.begin()+index, translation);
+        rotations_.insert(rotations_.begin()+index, rotation);
+        curve_ids_.insert(curve_ids_.begin()+index*4, curves, curves+4);
+    } else {
+        translations_[index] = translation;
+        rotations_[index] = rotation;
+        std::copy(curves, curves+4, curve_ids_.begin()+index*4);
+    }
+}
+
+inline void
+Motion::BoneTrack::SetKeyframes(size_t num, const std::uint32_t *frames, const Vector3f *translations, const Vector4f *rotations, const std::uint16_t *curves) {
+    frames_.reserve(frames_.size()+num);
+    translations_.reserve(translations_.size()+num);
+    rotations_.reserve(rotations_.size()+num);
+    curve_ids_.reserve(curve_ids_.size()+num*4);
+    for(size_t i=0;i<num;++i) {
+        SetKeyframe(frames[i], translations[i], rotations[i], curves+i*4);
+    }
+}
+
+inline void
+Motion::BoneTrack::Retain(const std::vector<size_t> &indices) {
+    for(size_t i=0;i<indices.size();++i) {
+        size_t index = indices[i];
+        frames_[i] = frames_[index];
+        translations_[i] = translations_[index];
+        rotations_[i] = rotations_[index];
+        std::copy(curve_ids_.begin()+index*4, curve_ids_.begin()+index*4+4, curve_ids_.begin()+i*4);
+    }
+    frames_.resize(indices.size());
+    translations_.resize(indices.size());
+    rotations_.resize(indices.size());
+    curve_ids_.resize(indices.size()*4);
+}
+
+inline float
+Motion::MorphTrack::GetWeight(size_t index) const {
+    return weights_[index];
+}
+
+inline std::uint16_t
+Motion::MorphTrack::GetWeightCurve(size_t index) const {
+    return curve_ids_[index];
+}
+
+inline Motion::MorphKeyframe
+Motion::MorphTrack::GetKeyframe(size_t index) const {
+    MorphKeyframe keyframe;
+    keyframe.SetWeight(weights_[index]);
+    keyframe.GetWeightInterpolator() = GetCurve(curve_ids_[index]);
+    return keyframe;
+}
+
+inline void
+Motion::MorphTrack::SetKeyframe(size_t frame, float weight, std::uint16_t curve) {
+    bool inserted;
+    size_t index = Insert(frame, inserted);
+    if(inserted) {
+        weights_.insert(weights_.begin()+index, weight);
+        curve_ids_.insert(curve_ids_.begin()+index, curve);
+    } else {
+        weights_[index] = weight;
+        curve_ids_[index] = curve;
+    }
+}
+
+inline void
+Motion::MorphTrack::SetKeyframes(size_t num, const std::uint32_t *frames, const float *weights, const std::uint16_t *curves) {
+    frames_.reserve(frames_.size()+num);
+    weights_.reserve(weights_.size()+num);
+    curve_ids_.reserve(curve_ids_.size()+num);
+    for(size_t i=0;i<num;++i) {
+        SetKeyframe(frames[i], weights[i], curves[i]);
+    }
+}
+
+inline void
+Motion::MorphTrack::Retain(const std::vector<size_t> &indices) {
+    for(size_t i=0;i<indices.size();++i) {
+        frames_[i] = frames_[indices[i]];
+        weights_[i] = weights_[indices[i]];
+        curve_ids_[i] = curve_ids_[indices[i]];
+    }
+    frames_.resize(indices.size());
+    weights_.resize(indices.size());
+    curve_ids_.resize(indices.size());
+}
+
+inline const Motion::BoneTrack*
+Motion::FindBoneTrack(const std::wstring &bone_name) const {
+    std::map<std::wstring, BoneTrack>::const_iterator i = bone_motions_.find(bone_name);
+    if(i!=bone_motions_.end()) {
+        return &i->second;
+    } else {
+        return NULL;
+    }
+}
+
+inline const Motion::MorphTrack*
+Motion::FindMorphTrack(const std::wstring &morph_name) const {
+    std::map<std::wstring, MorphTrack>::const_iterator i = morph_motions_.find(morph_name);
+    if(i!=morph_motions_.end()) {
+        return &i->second;
+    } else {
+        return NULL;
+    }
+}
+
 inline void
 Motion::RegisterBone(const std::wstring &bone_name) {
-    bone_motions_.insert(std::make_pair(bone_name, std::map<size_t, BoneKeyframe>()));
+    bone_motions_[bone_name].motion_ = this;
 }
 
 inline void
 Motion::RegisterMorph(const std::wstring &morph_name) {
-    morph_motions_.insert(std::make_pair(morph_name, std::map<size_t, MorphKeyframe>()));
+    morph_motions_[morph_name].motion_ = this;
 }
 
 inline void
@@ -140,13 +377,37 @@ Motion::IsMorphRegistered(const std::wstring &morph_name) const {
     return (morph_motions_.count(morph_name)>0);
 }
 
+inline std::vector<std::wstring>
+Motion::GetBoneNames() const {
+    std::vector<std::wstring> names;
+    names.reserve(bone_motions_.size());
+    for(std::map<std::wstring, BoneTrack>::const_iterator i=bone_motions_.begin();i!=bone_motions_.end();++i) {
+        names.push_back(i->first);
+    }
+    return names;
+}
+
+inline std::vector<std::wstring>
+Motion::GetMorphNames() const {
+    std::vector<std::wstring> names;
+    names.reserve(morph_motions_.size());
+    for(std::map<std::wstring, MorphTrack>::const_iterator i=morph_motions_.begin();i!=morph_motions_.end();++i) {
+        names.push_back(i->first);
+    }
+    return names;
+}
+
 inline size_t
 Motion::QueryBoneKeyframeForward(const std::wstring &bone_name, size_t frame) const {
-    std::map<std::wstring, std::map<size_t, BoneKeyframe>>::const_iterator i = bone_motions_.find(bone_name);
-    if(i!=bone_motions_.end()) {
-        std::map<size_t, BoneKeyframe>::const_iterator j = i->second.lower_bound(frame);
-        if(j!=i->second.end()) {
-            return j->first;
+    const BoneTrack *track = FindBoneTrack(bone_name);
+    if(track!=NULL) {
+        size_t cursor = 0;
+        size_t i = track->Locate(frame, cursor);
+        if(i<track->GetKeyframeNum()&&track->GetFrame(i)<frame) {
+            ++i;
+        }
+        if(i<track->GetKeyframeNum()) {
+            return track->GetFrame(i);
         } else {
             return nil;
         }
@@ -157,11 +418,12 @@ Motion::QueryBoneKeyframeForward(const std::wstring &bone_name, size_t frame) co
 
 inline size_t
 Motion::QueryBoneKeyframeBackward(const std::wstring &bone_name, size_t frame) const {
-    std::map<std::wstring, std::map<size_t, BoneKeyframe>>::const_iterator i = bone_motions_.find(bone_name);
-    if(i!=bone_motions_.end()) {
-        std::map<size_t, BoneKeyframe>::const_iterator j = i->second.upper_bound(frame);
-        if(j!=i->second.begin()) {
-            return (--j)->first;
+    const BoneTrack *track = FindBoneTrack(bone_name);
+    if(track!=NULL&&track->GetKeyframeNum()>0) {
+        size_t cursor = 0;
+        size_t i = track->Locate(frame, cursor);
+        if(track->GetFrame(i)<=frame) {
+            return track->GetFrame(i);
         } else {
             return nil;
         }
@@ -172,11 +434,15 @@ Motion::QueryBoneKeyframeBackward(const std::wstring &bone_name, size_t frame) c
 
 inline size_t
 Motion::QueryMorphKeyframeForward(const std::wstring &morph_name, size_t frame) const {
-    std::map<std::wstring, std::map<size_t, MorphKeyframe>>::const_iterator i = morph_motions_.find(morph_name);
-    if(i!=morph_motions_.end()) {
-        std::map<size_t, MorphKeyframe>::const_iterator j = i->second.lower_bound(frame);
-        if(j!=i->second.end()) {
-            return j->first;
+    const MorphTrack *track = FindMorphTrack(morph_name);
+    if(track!=NULL) {
+        size_t cursor = 0;
+        size_t i = track->Locate(frame, cursor);
+        if(i<track->GetKeyframeNum()&&track->GetFrame(i)<frame) {
+            ++i;
+        }
+        if(i<track->GetKeyframeNum()) {
+            return track->GetFrame(i);
         } else {
             return nil;
         }
@@ -187,11 +453,12 @@ Motion::QueryMorphKeyframeForward(const std::wstring &morph_name, size_t frame)
 
 inline size_t
 Motion::QueryMorphKeyframeBackward(const std::wstring &morph_name, size_t frame) const {
-    std::map<std::wstring, std::map<size_t, MorphKeyframe>>::const_iterator i = morph_motions_.find(morph_name);
-    if(i!=morph_motions_.end()) {
-        std::map<size_t, MorphKeyframe>::const_iterator j = i->second.upper_bound(frame);
-        if(j!=i->second.begin()) {
-            return (--j)->first;
+    const MorphTrack *track = FindMorphTrack(morph_name);
+    if(track!=NULL&&track->GetKeyframeNum()>0) {
+        size_t cursor = 0;
+        size_t i = track->Locate(frame, cursor);
+        if(track->GetFrame(i)<=frame) {
+            return track->GetFrame(i);
         } else {
             return nil;
         }
@@ -201,7 +468,102 @@ Motion::QueryMorphKeyframeBackward(const std::wstring &morph_name, size_t frame)
 }
 
 inline 
-Motion::Motion() : length_(0) {}
+Motion::Motion() : length_(0), frame_rate_(MMD_FRAME_RATE) {}
+
+inline
+Motion::Motion(const Motion &motion)
+  : name_(motion.name_), length_(motion.length_), frame_rate_(motion.frame_rate_),
+    bone_motions_(motion.bone_motions_), morph_motions_(motion.morph_motions_),
+    curves_(motion.curves_), curve_samples_(motion.curve_samples_), curve_map_(motion.curve_map_) {
+    BindTracks();
+}
+
+inline Motion&
+Motion::operator=(const Motion &motion) {
+    name_ = motion.name_;
+    length_ = motion.length_;
+    frame_rate_ = motion.frame_rate_;
+    bone_motions_ = motion.bone_motions_;
+    morph_motions_ = motion.morph_motions_;
+    curves_ = motion.curves_;
+    curve_samples_ = motion.curve_samples_;
+    curve_map_ = motion.curve_map_;
+    BindTracks();
+    return *this;
+}
+
+inline void
+Motion::BindTracks() {
+    for(std::map<std::wstring, BoneTrack>::iterator i=bone_motions_.begin();i!=bone_motions_.end();++i) {
+        i->second.motion_ = this;
+    }
+    for(std::map<std::wstring, MorphTrack>::iterator i=morph_motions_.begin();i!=morph_motions_.end();++i) {
+        i->second.motion_ = this;
+    }
+}
+
+inline
+Motion::CurveKey::CurveKey(const Vector2f &c_0, const Vector2f &c_1) {
+    c_[0] = c_0.p.x;
+    c_[1] = c_0.p.y;
+    c_[2] = c_1.p.x;
+    c_[3] = c_1.p.y;
+}
+
+inline bool
+Motion::CurveKey::operator<(const CurveKey &key) const {
+    return std::lexicographical_compare(c_, c_+4, key.c_, key.c_+4);
+}
+
+inline std::uint16_t
+Motion::InternCurve(const Vector2f &c_0, const Vector2f &c_1) {
+    if(c_0.p.x==c_0.p.y&&c_1.p.x==c_1.p.y) {
+        return LINEAR_CURVE;
+    }
+    CurveKey key(c_0, c_1);
+    std::map<CurveKey, std::uint16_t>::const_iterator i = curve_map_.find(key);
+    if(i!=curve_map_.end()) {
+        return i->second;
+    }
+    if(curves_.size()>=LINEAR_CURVE) {
+        throw exception(std::string("Motion: Too many distinct curves."));
+    }
+    std::uint16_t curve = (std::uint16_t)curves_.size();
+    curves_.push_back(interpolator(c_0, c_1));
+    curve_samples_.insert(curve_samples_.end(), curves_.back().GetPresamples(), curves_.back().GetPresamples()+interpolator::GetPresampleNum());
+    curve_map_.insert(std::make_pair(key, curve));
+    return curve;
+}
+
+inline std::uint16_t
+Motion::InternCurve(const interpolator &curve) {
+    if(curve.IsLinear()) {
+        return LINEAR_CURVE;
+    }
+    CurveKey key(curve.GetC(0), curve.GetC(1));
+    std::map<CurveKey, std::uint16_t>::const_iterator i = curve_map_.find(key);
+    if(i!=curve_map_.end()) {
+        return i->second;
+    }
+    if(curves_.size()>=LINEAR_CURVE) {
+        throw exception(std::string("Motion: Too many distinct curves."));
+    }
+    std::uint16_t id = (std::uint16_t)curves_.size();
+    curves_.push_back(curve);
+    curve_samples_.insert(curve_samples_.end(), curve.GetPresamples(), curve.GetPresamples()+interpolator::GetPresampleNum());
+    curve_map_.insert(std::make_pair(key, id));
+    return id;
+}
+
+inline size_t
+Motion::GetCurveNum() const {
+    return curves_.size();
+}
+
+inline const interpolator&
+Motion::GetCurve(size_t curve) const {
+    return curves_[curve];
+}
 
 inline const std::wstring&
 Motion::GetName() const {
@@ -213,30 +575,73 @@ Motion::SetName(const std::wstring &name) {
     name_ = name;
 }
 
-inline const Motion::BoneKeyframe&
+inline Motion::BoneKeyframe
 Motion::GetBoneKeyframe(const std::wstring &bone_name, size_t frame) const {
-    return bone_motions_.find(bone_name)->second.find(frame)->second;
+    const BoneTrack &track = bone_motions_.find(bone_name)->second;
+    return track.GetKeyframe(track.Find(frame));
 }
 
-inline Motion::BoneKeyframe&
-Motion::GetBoneKeyframe(const std::wstring &bone_name, size_t frame) {
+inline void
+Motion::SetBoneKeyframe(const std::wstring &bone_name, size_t frame, const BoneKeyframe &keyframe) {
+    std::uint16_t curves[4];
+    curves[0] = InternCurve(keyframe.GetXInterpolator());
+    curves[1] = InternCurve(keyframe.GetYInterpolator());
+    curves[2] = InternCurve(keyframe.GetZInterpolator());
+    curves[3] = InternCurve(keyframe.GetRInterpolator());
+    SetBoneKeyframe(bone_name, frame, keyframe.GetTranslation(), keyframe.GetRotation(), curves);
+}
+
+inline void
+Motion::SetBoneKeyframe(const std::wstring &bone_name, size_t frame, const Vector3f &translation, const Vector4f &rotation, const std::uint16_t *curves) {
     if(frame>length_) {
         length_ = frame;
     }
-    return bone_motions_[bone_name][frame];
+    BoneTrack &track = bone_motions_[bone_name];
+    track.motion_ = this;
+    track.SetKeyframe(frame, translation, rotation, curves);
+}
+
+inline void
+Motion::SetBoneKeyframes(const std::wstring &bone_name, size_t num, const std::uint32_t *frames, const Vector3f *translations, const Vector4f *rotations, const std::uint16_t *curves) {
+    if(num==0) {
+        return;
+    }
+    length_ = std::max(length_, (size_t)*std::max_element(frames, frames+num));
+    BoneTrack &track = bone_motions_[bone_name];
+    track.motion_ = this;
+    track.SetKeyframes(num, frames, translations, rotations, curves);
 }
 
-inline const Motion::MorphKeyframe&
+inline Motion::MorphKeyframe
 Motion::GetMorphKeyframe(const std::wstring &morph_name, size_t frame) const {
-    return morph_motions_.find(morph_name)->second.find(frame)->second;
+    const MorphTrack &track = morph_motions_.find(morph_name)->second;
+    return track.GetKeyframe(track.Find(frame));
 }
 
-inline Motion::MorphKeyframe&
-Motion::GetMorphKeyframe(const std::wstring &morph_name, size_t frame) {
+inline void
+Motion::SetMorphKeyframe(const std::wstring &morph_name, size_t frame, const MorphKeyframe &keyframe) {
+    SetMorphKeyframe(morph_name, frame, keyframe.GetWeight(), InternCurve(keyframe.GetWeightInterpolator()));
+}
+
+inline void
+Motion::SetMorphKeyframe(const std::wstring &morph_name, size_t frame, float weight, std::uint16_t curve) {
     if(frame>length_) {
         length_ = frame;
     }
-    return morph_motions_[morph_name][frame];
+    MorphTrack &track = morph_motions_[morph_name];
+    track.motion_ = this;
+    track.SetKeyframe(frame, weight, curve);
+}
+
+inline void
+Motion::SetMorphKeyframes(const std::wstring &morph_name, size_t num, const std::uint32_t *frames, const float *weights, const std::uint16_t *curves) {
+    if(num==0) {
+        return;
+    }
+    length_ = std::max(length_, (size_t)*std::max_element(frames, frames+num));
+    MorphTrack &track = morph_motions_[morph_name];
+    track.motion_ = this;
+    track.SetKeyframes(num, frames, weights, curves);
 }
 
 inline size_t
@@ -244,222 +649,354 @@ Motion::GetLength() const {
     return length_;
 }
 
+inline double
+Motion::GetFrameRate() const {
+    return frame_rate_;
+}
+
+inline void
+Motion::SetFrameRate(double frame_rate) {
+    frame_rate_ = frame_rate;
+}
+
 inline void
 Motion::Clear() {
     name_.clear();
     length_ = 0;
+    frame_rate_ = MMD_FRAME_RATE;
     bone_motions_.clear();
     morph_motions_.clear();
+    curves_.clear();
+    curve_samples_.clear();
+    curve_map_.clear();
+}
+
+inline size_t
+Motion::Reduce(float rotation_error, float translation_error, float weight_error) {
+    float rotation_bound = math::cos(rotation_error*0.5f);
+    float translation_bound = translation_error*translation_error;
+    size_t dropped = 0;
+    for(std::map<std::wstring, BoneTrack>::iterator i=bone_motions_.begin();i!=bone_motions_.end();++i) {
+        dropped += ReduceTrack<BoneTrack, BonePose>(i->second, rotation_bound, translation_bound);
+    }
+    for(std::map<std::wstring, MorphTrack>::iterator i=morph_motions_.begin();i!=morph_motions_.end();++i) {
+        dropped += ReduceTrack<MorphTrack, MorphPose>(i->second, weight_error, 0.0f);
+    }
+    return dropped;
+}
+
+template <typename Track, typename Pose>
+inline size_t
+Motion::ReduceTrack(Track &track, float bound_0, float bound_1) {
+    size_t n = track.GetKeyframeNum();
+    if(n<3) {
+        return 0;
+    }
+
+    size_t first_frame = track.GetFrame(0);
+    size_t last_frame = track.GetFrame(n-1);
+    std::vector<Pose> reference;
+    reference.reserve(last_frame-first_frame+1);
+    size_t cursor = 0;
+    for(size_t frame=first_frame;frame<=last_frame;++frame) {
+        reference.push_back(SampleTrack(track, frame, cursor));
+    }
+
+    /* from each kept keyframe, bridge to the farthest one that still fits: gallop, then bisect */
+    std::vector<size_t> kept(1, 0);
+    size_t left = 0;
+    while(left+1<n) {
+        size_t good = left+1;
+        size_t bad = n;
+        size_t step = 1;
+        while(good+1<bad) {
+            size_t right = std::min(good+step, bad-1);
+            if(!IsSpanRedundant(track, left, right, reference, bound_0, bound_1)) {
+                bad = right;
+                break;
+            }
+            good = right;
+            step *= 2;
+        }
+        while(good+1<bad) {
+            size_t right = good+(bad-good)/2;
+            if(IsSpanRedundant(track, left, right, reference, bound_0, bound_1)) {
+                good = right;
+            } else {
+                bad = right;
+            }
+        }
+        kept.push_back(good);
+        left = good;
+    }
+
+    size_t dropped = n-kept.size();
+    if(dropped>0) {
+        track.Retain(kept);
+    }
+    return dropped;
+}
+
+template <typename Track, typename Pose>
+inline bool
+Motion::IsSpanRedundant(const Track &track, size_t left, size_t right, const std::vector<Pose> &reference, float bound_0, float bound_1) {
+    size_t first_frame = track.GetFrame(0);
+    size_t left_frame = track.GetFrame(left);
+    size_t right_frame = track.GetFrame(right);
+    for(size_t frame=left_frame+1;frame<right_frame;++frame) {
+        float bary_pos = (float)(frame-left_frame)/(float)(right_frame-left_frame);
+        if(!IsPoseClose(InterpolateTrack(track, left, right, bary_pos), reference[frame-first_frame], bound_0, bound_1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline Motion::BonePose
+Motion::SampleTrack(const BoneTrack &track, size_t frame, size_t &cursor) {
+    return GetBonePose(track, frame, cursor);
+}
+
+inline Motion::MorphPose
+Motion::SampleTrack(const MorphTrack &track, size_t frame, size_t &cursor) {
+    return GetMorphPose(track, frame, cursor);
+}
+
+inline Motion::BonePose
+Motion::InterpolateTrack(const BoneTrack &track, size_t left, size_t right, float bary_pos) {
+    return InterpolateBonePose(track, left, right, bary_pos);
+}
+
+inline Motion::MorphPose
+Motion::InterpolateTrack(const MorphTrack &track, size_t left, size_t right, float bary_pos) {
+    return InterpolateMorphPose(track, left, right, bary_pos);
+}
+
+inline bool
+Motion::IsPoseClose(const BonePose &pose, const BonePose &reference, float bound_0, float bound_1) {
+    Vector3f d = pose.GetTranslation()-reference.GetTranslation();
+    if(d*d>bound_1) {
+        return false;
+    }
+    const Vector4f &a = pose.GetRotation();
+    const Vector4f &b = reference.GetRotation();
+    return math::abs(a*b)>=bound_0*math::sqrt((a*a)*(b*b));
+}
+
+inline bool
+Motion::IsPoseClose(const MorphPose &pose, const MorphPose &reference, float bound_0, float bound_1) {
+    _unused(bound_1);
+    return math::abs(pose.GetWeight()-reference.GetWeight())<=bound_0;
 }
 
 inline Motion::BonePose
 Motion::GetBonePose(const std::wstring &bone_name, size_t frame) const {
-    const std::map<size_t, BoneKeyframe>& keyframes
-        = bone_motions_.find(bone_name)->second;
+    return GetBonePose(bone_motions_.find(bone_name)->second, frame);
+}
 
-    if(keyframes.size()==0) {
+inline Motion::BonePose
+Motion::GetBonePose(const BoneTrack &track, size_t frame) {
+    size_t cursor = nil;
+    return GetBonePose(track, frame, cursor);
+}
+
+inline Motion::BonePose
+Motion::GetBonePose(const BoneTrack &track, size_t frame, size_t &cursor) {
+
+    size_t n = track.GetKeyframeNum();
+    if(n==0) {
         Vector4f rot;
         rot.q.MakeIdentity();
         return BonePose(Vector3f(), rot);
     }
 
-    if(keyframes.begin()->first>=frame) {
-        const BoneKeyframe& key = keyframes.begin()->second;
-        return BonePose(key.GetTranslation(), key.GetRotation());
+    if(track.GetFrame(0)>=frame) {
+        return BonePose(track.GetTranslation(0), track.GetRotation(0));
+    } else if(track.GetFrame(n-1)<=frame) {
+        return BonePose(track.GetTranslation(n-1), track.GetRotation(n-1));
     } else {
-        std::map<size_t, BoneKeyframe>::const_iterator i = keyframes.end();
-        i--;
-        if(i->first<=frame) {
-            const BoneKeyframe& key = i->second;
-            return BonePose(key.GetTranslation(), key.GetRotation());
+        size_t left = track.Locate(frame, cursor);
+        size_t left_frame = track.GetFrame(left);
+        size_t right_frame = track.GetFrame(left+1);
+
+        if(left_frame==frame) {
+            return BonePose(track.GetTranslation(left), track.GetRotation(left));
         } else {
-            std::map<size_t, BoneKeyframe>::const_iterator right_bound
-                = keyframes.upper_bound(frame);
-            size_t right_frame = right_bound->first;
-            const BoneKeyframe& right_key = right_bound->second;
-            right_bound--;
-            size_t left_frame = right_bound->first;
-            const BoneKeyframe& left_key = right_bound->second;
-
-            if(left_frame==frame) {
-                return BonePose(
-                    left_key.GetTranslation(), left_key.GetRotation()
-                );
-            } else {
-                float bary_pos = (
-                    (float)(frame-left_frame)/(float)(right_frame-left_frame)
-                );
-                float lambda;
-
-                const Vector3f& l_translation = left_key.GetTranslation();
-                const Vector4f& l_rotation = left_key.GetRotation();
-                const Vector3f& r_translation = right_key.GetTranslation();
-                const Vector4f& r_rotation = right_key.GetRotation();
-
-                Vector3f translation;
-                Vector4f rotation;
-
-                lambda = left_key.GetXInterpolator()[bary_pos];
-                translation.p.x
-                    = l_translation.p.x*(1-lambda)+r_translation.p.x*lambda;
-                lambda = left_key.GetYInterpolator()[bary_pos];
-                translation.p.y
-                    = l_translation.p.y*(1-lambda)+r_translation.p.y*lambda;
-                lambda = left_key.GetZInterpolator()[bary_pos];
-                translation.p.z
-                    = l_translation.p.z*(1-lambda)+r_translation.p.z*lambda;
-
-                lambda = left_key.GetRInterpolator()[bary_pos];
-                rotation = NLerp(l_rotation, r_rotation)[lambda];
-
-                return BonePose(translation, rotation);
-            }
+            float bary_pos = (
+                (float)(frame-left_frame)/(float)(right_frame-left_frame)
+            );
+            return InterpolateBonePose(track, left, left+1, bary_pos);
         }
     }
 }
 
 inline Motion::BonePose
 Motion::GetBonePose(const std::wstring &bone_name, double time) const {
-    const std::map<size_t, BoneKeyframe>& keyframes
-        = bone_motions_.find(bone_name)->second;
+    return GetBonePose(bone_motions_.find(bone_name)->second, time);
+}
+
+inline Motion::BonePose
+Motion::GetBonePose(const BoneTrack &track, double time) {
+    size_t cursor = nil;
+    return GetBonePose(track, time, cursor);
+}
 
-    if(keyframes.size()==0) {
+inline Motion::BonePose
+Motion::GetBonePose(const BoneTrack &track, double time, size_t &cursor) {
+
+    size_t n = track.GetKeyframeNum();
+    if(n==0) {
         Vector4f rot;
         rot.q.MakeIdentity();
         return BonePose(Vector3f(), rot);
     }
 
-    double dframe = time * 30.0;
+    double dframe = time * track.GetFrameRate();
 
-    if(keyframes.begin()->first>=dframe) {
-        const BoneKeyframe& key = keyframes.begin()->second;
-        return BonePose(key.GetTranslation(), key.GetRotation());
+    if(track.GetFrame(0)>=dframe) {
+        return BonePose(track.GetTranslation(0), track.GetRotation(0));
+    } else if(track.GetFrame(n-1)<=dframe) {
+        return BonePose(track.GetTranslation(n-1), track.GetRotation(n-1));
     } else {
-        std::map<size_t, BoneKeyframe>::const_iterator i = keyframes.end();
-        i--;
-        if(i->first<=dframe) {
-            const BoneKeyframe& key = i->second;
-            return BonePose(key.GetTranslation(), key.GetRotation());
-        } else {
-            std::map<size_t, BoneKeyframe>::const_iterator right_bound
-                = keyframes.upper_bound(size_t(dframe));
-            size_t right_frame = right_bound->first;
-            const BoneKeyframe& right_key = right_bound->second;
-            right_bound--;
-            size_t left_frame = right_bound->first;
-            const BoneKeyframe& left_key = right_bound->second;
-
-            float bary_pos
-                = (float)((dframe-left_frame)/(right_frame-left_frame));
-            float lambda;
-
-            const Vector3f& l_translation = left_key.GetTranslation();
-            const Vector4f& l_rotation = left_key.GetRotation();
-            const Vector3f& r_translation = right_key.GetTranslation();
-            const Vector4f& r_rotation = right_key.GetRotation();
-
-            Vector3f translation;
-            Vector4f rotation;
-
-            lambda = left_key.GetXInterpolator()[bary_pos];
-            translation.p.x
-                = l_translation.p.x*(1-lambda)+r_translation.p.x*lambda;
-            lambda = left_key.GetYInterpolator()[bary_pos];
-            translation.p.y
-                = l_translation.p.y*(1-lambda)+r_translation.p.y*lambda;
-            lambda = left_key.GetZInterpolator()[bary_pos];
-            translation.p.z
-                = l_translation.p.z*(1-lambda)+r_translation.p.z*lambda;
-
-            lambda = left_key.GetRInterpolator()[bary_pos];
-            rotation = NLerp(l_rotation, r_rotation)[lambda];
-
-            return BonePose(translation, rotation);
-        }
+        size_t left = track.Locate(size_t(dframe), cursor);
+        size_t left_frame = track.GetFrame(left);
+        size_t right_frame = track.GetFrame(left+1);
+
+        float bary_pos
+            = (float)((dframe-left_frame)/(right_frame-left_frame));
+        return InterpolateBonePose(track, left, left+1, bary_pos);
     }
 }
 
+inline Motion::BonePose
+Motion::InterpolateBonePose(const BoneTrack &track, size_t left, size_t right, float bary_pos) {
+    float lambda;
+
+    const Vector3f& l_translation = track.GetTranslation(left);
+    const Vector4f& l_rotation = track.GetRotation(left);
+    const Vector3f& r_translation = track.GetTranslation(right);
+    const Vector4f& r_rotation = track.GetRotation(right);
+
+    Vector3f translation;
+    Vector4f rotation;
+
+    lambda = track.EvaluateCurve(track.GetXCurve(left), bary_pos);
+    translation.p.x
+        = l_translation.p.x*(1-lambda)+r_translation.p.x*lambda;
+    lambda = track.EvaluateCurve(track.GetYCurve(left), bary_pos);
+    translation.p.y
+        = l_translation.p.y*(1-lambda)+r_translation.p.y*lambda;
+    lambda = track.EvaluateCurve(track.GetZCurve(left), bary_pos);
+    translation.p.z
+        = l_translation.p.z*(1-lambda)+r_translation.p.z*lambda;
+
+    lambda = track.EvaluateCurve(track.GetRCurve(left), bary_pos);
+    rotation = NLerp(l_rotation, r_rotation)[lambda];
+
+    return BonePose(translation, rotation);
+}
+
 inline Motion::MorphPose
 Motion::GetMorphPose(const std::wstring &morph_name, size_t frame) const {
-    const std::map<size_t, MorphKeyframe>& keyframes
-        = morph_motions_.find(morph_name)->second;
+    return GetMorphPose(morph_motions_.find(morph_name)->second, frame);
+}
+
+inline Motion::MorphPose
+Motion::GetMorphPose(const MorphTrack &track, size_t frame) {
+    size_t cursor = nil;
+    return GetMorphPose(track, frame, cursor);
+}
+
+inline Motion::MorphPose
+Motion::GetMorphPose(const MorphTrack &track, size_t frame, size_t &cursor) {
 
-    if(keyframes.size()==0) {
+    size_t n = track.GetKeyframeNum();
+    if(n==0) {
         return MorphPose(0.0f);
     }
 
-    if(keyframes.begin()->first>=frame) {
-        const MorphKeyframe& key = keyframes.begin()->second;
-        return MorphPose(key.GetWeight());
+    if(track.GetFrame(0)>=frame) {
+        return MorphPose(track.GetWeight(0));
+    } else if(track.GetFrame(n-1)<=frame) {
+        return MorphPose(track.GetWeight(n-1));
     } else {
-        std::map<size_t, MorphKeyframe>::const_iterator i = keyframes.end();
-        i--;
-        if(i->first<=frame) {
-            const MorphKeyframe& key = i->second;
-            return MorphPose(key.GetWeight());
-        } else {
-            std::map<size_t, MorphKeyframe>::const_iterator right_bound
-                = keyframes.upper_bound(frame);
-            size_t right_frame = right_bound->first;
-            const MorphKeyframe& right_key = right_bound->second;
-            right_bound--;
-            size_t left_frame = right_bound->first;
-            const MorphKeyframe& left_key = right_bound->second;
-
-            if(left_frame==frame) {
-                return MorphPose(left_key.GetWeight());
-            } else {
-                float bary_pos = (
-                    (float)(frame-left_frame)/(float)(right_frame-left_frame)
-                );
-
-                float l_weight = left_key.GetWeight();
-                float r_weight = right_key.GetWeight();
-                float lambda = left_key.GetWeightInterpolator()[bary_pos];
+        size_t left = track.Locate(frame, cursor);
+        size_t left_frame = track.GetFrame(left);
+        size_t right_frame = track.GetFrame(left+1);
 
-                return MorphPose(l_weight*(1-lambda)+r_weight*lambda);
-            }
+        if(left_frame==frame) {
+            return MorphPose(track.GetWeight(left));
+        } else {
+            float bary_pos = (
+                (float)(frame-left_frame)/(float)(right_frame-left_frame)
+            );
+            return InterpolateMorphPose(track, left, left+1, bary_pos);
         }
     }
 }
 
 inline Motion::MorphPose
 Motion::GetMorphPose(const std::wstring &morph_name, double time) const {
-    const std::map<size_t, MorphKeyframe>& keyframes
-        = morph_motions_.find(morph_name)->second;
+    return GetMorphPose(morph_motions_.find(morph_name)->second, time);
+}
+
+inline Motion::MorphPose
+Motion::GetMorphPose(const MorphTrack &track, double time) {
+    size_t cursor = nil;
+    return GetMorphPose(track, time, cursor);
+}
 
-    if(keyframes.size()==0) {
+inline Motion::MorphPose
+Motion::GetMorphPose(const MorphTrack &track, double time, size_t &cursor) {
+
+    size_t n = track.GetKeyframeNum();
+    if(n==0) {
         return MorphPose(0.0f);
     }
 
-    double dframe = time * 30.0;
+    double dframe = time * track.GetFrameRate();
 
-    if(keyframes.begin()->first>=dframe) {
-        const MorphKeyframe& key = keyframes.begin()->second;
-        return MorphPose(key.GetWeight());
+    if(track.GetFrame(0)>=dframe) {
+        return MorphPose(track.GetWeight(0));
+    } else if(track.GetFrame(n-1)<=dframe) {
+        return MorphPose(track.GetWeight(n-1));
     } else {
-        std::map<size_t, MorphKeyframe>::const_iterator i = keyframes.end();
-        i--;
-        if(i->first<=dframe) {
-            const MorphKeyframe& key = i->second;
-            return MorphPose(key.GetWeight());
-        } else {
-            std::map<size_t, MorphKeyframe>::const_iterator right_bound
-                = keyframes.upper_bound(size_t(dframe));
-            size_t right_frame = right_bound->first;
-            const MorphKeyframe& right_key = right_bound->second;
-            right_bound--;
-            size_t left_frame = right_bound->first;
-            const MorphKeyframe& left_key = right_bound->second;
-
-            float bary_pos
-                = (float)((dframe-left_frame)/(right_frame-left_frame));
-
-            float l_weight = left_key.GetWeight();
-            float r_weight = right_key.GetWeight();
-            float lambda = left_key.GetWeightInterpolator()[bary_pos];
-
-            return MorphPose(l_weight*(1-lambda)+r_weight*lambda);
-        }
+        size_t left = track.Locate(size_t(dframe), cursor);
+        size_t left_frame = track.GetFrame(left);
+        size_t right_frame = track.GetFrame(left+1);
+
+        float bary_pos
+            = (float)((dframe-left_frame)/(right_frame-left_frame));
+        return InterpolateMorphPose(track, left, left+1, bary_pos);
+    }
+}
+
+inline Motion::MorphPose
+Motion::InterpolateMorphPose(const MorphTrack &track, size_t left, size_t right, float bary_pos) {
+    float l_weight = track.GetWeight(left);
+    float r_weight = track.GetWeight(right);
+    float lambda = track.EvaluateCurve(track.GetWeightCurve(left), bary_pos);
+
+    return MorphPose(l_weight*(1-lambda)+r_weight*lambda);
+}
+
+inline float
+Motion::EvaluateCurve(std::uint16_t curve, float x) const {
+    if(curve==LINEAR_CURVE) {
+        return x;
+    }
+    /* Bezier::operator[] over the flat presample table */
+    const size_t sample_num = interpolator::GetPresampleNum();
+    if(sample_num==0) {
+        return curves_[curve](x);
+    }
+    const float *presamples = &curve_samples_[curve*sample_num];
+    x *= sample_num-1;
+    size_t ix = (size_t)x;
+    float r = x-ix;
+    if(ix<sample_num-1) {
+        return (1.0f-r)*presamples[ix]+r*presamples[ix+1];
+    } else {
+        return presamples[sample_num-1];
     }
 }
@@ -29,14 +29,21 @@ namespace mmd {
         virtual void SetFloor(bool has_floor) = 0;
         virtual bool IsHasFloor() const = 0;
     protected:
-        typedef Poser::BoneImage& BoneImageReference;
+        typedef PoseState::BoneImage& BoneImageReference;
         static BoneImageReference GetPoserBoneImage(Poser &poser, size_t index);
+        static BoneImageReference GetPoseStateBoneImage(PoseState &state, size_t index);
     };
 
     inline PhysicsReactor::BoneImageReference PhysicsReactor::GetPoserBoneImage(
         Poser &poser, size_t index
     ) {
-        return poser.bone_images_[index];
+        return poser.state_.bone_images_[index];
+    }
+
+    inline PhysicsReactor::BoneImageReference PhysicsReactor::GetPoseStateBoneImage(
+        PoseState &state, size_t index
+    ) {
+        return state.bone_images_[index];
     }
 
 
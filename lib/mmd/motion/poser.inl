@@ -11,17 +11,27 @@
 
 namespace mmd {
 
+    /**
+      Poses a single instance of a model: a Rig together with one
+      PoseState. To pose many instances (or time samples) of a model at
+      once, share one Rig and give each of them its own PoseState.
+    **/
     class Poser {
         friend class PhysicsReactor;
     public:
-        struct PoseImage {
-            std::vector<Vector3f> coordinates;
-            std::vector<Vector3f> normals;
-        } pose_image;
-
+        typedef PoseState::PoseImage PoseImage;
+        typedef PoseState::MaterialImage MaterialImage;
+        typedef Rig::IKSolverType IKSolverType;
 
         Poser(Model &model);
 
+    private:
+        Rig rig_;
+        PoseState state_;
+
+    public:
+        PoseImage &pose_image;
+
         void ResetPosing();
 
         void SetBonePose(size_t index, const Motion::BonePose &bone_pose);
@@ -39,162 +49,361 @@ namespace mmd {
 
         void Deform();
 
+        const MaterialImage &GetMaterialMulImage(size_t index) const;
+        const MaterialImage &GetMaterialAddImage(size_t index) const;
+        void ClearPoseImageDirty();
+
+        /** See PoseState. **/
+        void SetIKWarmStart(bool warm_start);
+        bool IsIKWarmStart() const;
+        void SetIKWarmStartThreshold(float distance);
+        float GetIKWarmStartThreshold() const;
+        void SetIKWarmStartTolerance(float distance);
+        float GetIKWarmStartTolerance() const;
+        void ResetIKWarmStart();
+
+        /** See Rig. **/
+        void SetIKSolver(IKSolverType solver);
+        void SetIKSolver(size_t index, IKSolverType solver);
+        IKSolverType GetIKSolver(size_t index) const;
+
+        size_t GetIKIterationNum(size_t index) const;
+        float GetIKError(size_t index) const;
+
+        const Rig &GetRig() const;
+        Rig &GetRig();
+        const PoseState &GetPoseState() const;
+        PoseState &GetPoseState();
+
         const Model &GetModel() const;
         Model &GetModel();
 
     private:
+        Model &model_;
 
-        struct BoneImage {
-            BoneImage();
-
-            Vector4f rotation_;
-            Vector3f translation_;
+        Poser(const Poser&);
+        Poser &operator=(Poser&);
+    };
 
-            Vector4f morph_rotation_;
-            Vector3f morph_translation_;
+    /**
+      Resets the IK warm start of a poser when its player jumps: on the
+      first seek, on a seek backwards, and on a seek forwards by more
+      than one frame of the motion and more than 1.75 times the last
+      continuous step. After a jump, a step within half of the jump's
+      length is taken as a steady cadence and is continuous, so a player
+      slower than the motion's rate keeps its warm start from its third
+      seek on.
+    **/
+    class SeekContinuity {
+    public:
+        SeekContinuity();
 
-            bool has_parent_;
-            size_t parent_;
+        /** frame is at the motion's rate. **/
+        void Check(Poser &poser, double frame);
 
-            bool has_append_;
-            bool append_rotate_;
-            bool append_translate_;
+    private:
+        bool has_last_frame_;
+        double last_frame_;
+        /* the last step judged continuous, 0 after a jump */
+        double last_step_;
+        /* the length of the last forward jump, 0 when the last step was continuous */
+        double jump_step_;
+    };
 
-            size_t append_parent_;
-            float append_ratio_;
+    /**
+      The bones and morphs of a model bound to the tracks of a motion, as
+      (track, bone or morph index) pairs, each with a sampling cursor.
+      Tracks are either bound by exact names or taken from a RetargetMap.
+    **/
+    template<typename BoneTrackRef, typename MorphTrackRef>
+    struct TrackBinding {
+        template<typename MotionType>
+        void Bind(const MotionType &motion, const Model &model);
+        void Bind(const RetargetMap &retarget);
+
+        std::vector<std::pair<BoneTrackRef, size_t>> bones_;
+        std::vector<std::pair<MorphTrackRef, size_t>> morphs_;
+        std::vector<size_t> bone_cursors_;
+        std::vector<size_t> morph_cursors_;
 
-            bool has_ik_;
-            bool ik_link_;
+    private:
+        static bool IsBound(const void *track);
+        static bool IsBound(size_t track);
+    };
 
-            float ccd_angle_limit_;
-            size_t ccd_iterate_limit_;
+    class MotionPlayer {
+    public:
+        MotionPlayer(const Motion &motion, Poser &poser);
+        /** Plays the motion of the map with its bindings and corrections. **/
+        MotionPlayer(const RetargetMap &retarget, Poser &poser);
+        void SeekFrame(size_t frame);
+        void SeekTime(double time);
 
-            std::vector<size_t> ik_links_;
+    private:
+        MotionPlayer &operator=(const MotionPlayer&);
 
-            enum AxisFixType { FIX_NONE, FIX_X, FIX_Y, FIX_Z, FIX_ALL };
-            enum AxisTransformOrder { ORDER_ZXY, ORDER_XYZ, ORDER_YZX };
-            std::vector<AxisFixType> ik_fix_types_;
-            std::vector<AxisTransformOrder> ik_transform_orders_;
+        TrackBinding<const Motion::BoneTrack*, const Motion::MorphTrack*> binding_;
+        SeekContinuity continuity_;
 
-            std::deque<bool> ik_link_limited_;
-            std::vector<Vector3f> ik_link_limits_min_;
-            std::vector<Vector3f> ik_link_limits_max_;
+        const Motion &motion_;
+        /* NULL when bound by exact names */
+        const RetargetMap *retarget_;
+        Poser &poser_;
+    };
 
-            size_t ik_target_;
+    /**
+      Plays a Motion at any output rate. Tracks are sampled only at the
+      motion's own frames, into a ring of the last few of them, and a seek
+      between two frames lerps their snapshots (nlerp for rotations). At
+      144 Hz over a 30 fps motion the tracks are sampled once per five
+      seeks or so. Between two frames the curves are approximated
+      linearly, as in BakedMotion.
+    **/
+    class ResampledMotionPlayer {
+    public:
+        ResampledMotionPlayer(const Motion &motion, Poser &poser);
+        /** See MotionPlayer. **/
+        ResampledMotionPlayer(const RetargetMap &retarget, Poser &poser);
+        void SeekFrame(size_t frame);
+        void SeekTime(double time);
 
-            Vector4f pre_ik_rotation_;
-            Vector4f ik_rotation_;
+        /** Moves the playback clock by delta seconds and seeks there. **/
+        void Advance(double delta);
+        double GetTime() const;
 
-            Vector4f total_rotation_;
-            Vector3f total_translation_;
+        /** Snapshots sampled from the motion so far. **/
+        size_t GetSnapshotSampleNum() const;
 
-            Vector3f local_offset_;
-            Matrix4f global_offset_matrix_;
-            Matrix4f global_offset_matrix_inv_;
-            Matrix4f local_matrix_;
+    private:
+        ResampledMotionPlayer &operator=(const ResampledMotionPlayer&);
 
-            Matrix4f skinning_matrix_;
+        enum { SNAPSHOT_NUM = 4 };
 
-            class TransformOrder {
-            public:
-                TransformOrder(const Model &model);
-                bool operator() (size_t a, size_t b) const;
-            private:
-                const Model *model_;
-            };
+        /* the poses of every bound bone and morph at one frame */
+        struct Snapshot {
+            size_t frame_;
+            std::vector<Vector3f> translations_;
+            std::vector<Vector4f> rotations_;
+            std::vector<float> weights_;
         };
 
-        class MaterialImage {
-        public:
-            MaterialImage(float value);
+        void InitSnapshots();
+        const Snapshot &GetSnapshot(size_t frame);
+
+        TrackBinding<const Motion::BoneTrack*, const Motion::MorphTrack*> binding_;
+
+        /* frame f is kept in snapshots_[f%SNAPSHOT_NUM] */
+        Snapshot snapshots_[SNAPSHOT_NUM];
+        size_t sample_num_;
+        double time_;
+
+        SeekContinuity continuity_;
+
+        const Motion &motion_;
+        /* NULL when bound by exact names */
+        const RetargetMap *retarget_;
+        Poser &poser_;
+    };
+
+    /** Plays a BakedMotion; see MotionPlayer. **/
+    class BakedMotionPlayer {
+    public:
+        BakedMotionPlayer(const BakedMotion &motion, Poser &poser);
+        void SeekFrame(size_t frame);
+        void SeekTime(double time);
+
+    private:
+        BakedMotionPlayer &operator=(const BakedMotionPlayer&);
 
-            void Init(float value);
+        TrackBinding<size_t, size_t> binding_;
+        SeekContinuity continuity_;
 
-            const Vector4f &GetDiffuse() const;
-            void SetDiffuse(const Vector3f &diffuse);
-            void SetDiffuse(const Vector4f &diffuse);
+        const BakedMotion &motion_;
+        Poser &poser_;
+    };
 
-            const Vector4f &GetSpecular() const;
-            void SetSpecular(const Vector3f &specular);
-            void SetSpecular(const Vector4f &specular);
+    /** Plays a CompressedMotion; see MotionPlayer. **/
+    class CompressedMotionPlayer {
+    public:
+        CompressedMotionPlayer(const CompressedMotion &motion, Poser &poser);
+        void SeekFrame(size_t frame);
+        void SeekTime(double time);
 
-            const Vector4f &GetAmbient() const;
-            void SetAmbient(const Vector3f &ambient);
-            void SetAmbient(const Vector4f &ambient);
+    private:
+        CompressedMotionPlayer &operator=(const CompressedMotionPlayer&);
 
-            float GetShininess() const;
-            void SetShininess(float shininess);
+        TrackBinding<size_t, size_t> binding_;
+        SeekContinuity continuity_;
 
-            const Vector4f &GetEdgeColor() const;
-            void SetEdgeColor(const Vector3f &edge_color);
-            void SetEdgeColor(const Vector4f &edge_color);
+        const CompressedMotion &motion_;
+        Poser &poser_;
+    };
 
-            float GetEdgeSize() const;
-            void SetEdgeSize(float edge_size);
+    /**
+      Plays several motions on one Poser as layers. Each layer blends its
+      pose over the result of the layers below it (starting from the rest
+      pose) by its weight times its mask for the bone; a layer without a
+      track for a bone leaves that bone alone. All layers are sampled in
+      one pass over the bones, and layers under a fully weighted one are
+      not sampled at all.
+    **/
+    class MotionBlender {
+    public:
+        MotionBlender(Poser &poser);
 
-            const Vector4f &GetTexture() const;
-            void SetTexture(const Vector3f &texture);
-            void SetTexture(const Vector4f &texture);
+        /** Returns the index of the new layer, which starts at weight 1. **/
+        size_t AddLayer(const Motion &motion);
+        size_t GetLayerNum() const;
 
-            const Vector4f &GetSubTexture() const;
-            void SetSubTexture(const Vector3f &sub_texture);
-            void SetSubTexture(const Vector4f &sub_texture);
+        void SetLayerWeight(size_t layer, float weight);
+        float GetLayerWeight(size_t layer) const;
 
-            const Vector4f &GetToonTexture() const;
-            void SetToonTexture(const Vector3f &toon_texture);
-            void SetToonTexture(const Vector4f &toon_texture);
+        /** The layer samples its motion at time+offset. **/
+        void SetLayerTimeOffset(size_t layer, double offset);
+        double GetLayerTimeOffset(size_t layer) const;
 
-        private:
-            Vector4f diffuse_;
-            Vector4f specular_;
-            Vector4f ambient_;
-            float shininess_;
-            Vector4f edge_color_;
-            float edge_size_;
-            Vector4f texture_;
-            Vector4f sub_texture_;
-            Vector4f toon_texture_;
-        };
+        /** Scales the layer's weight on one bone, 1 by default. **/
+        void SetBoneMask(size_t layer, const std::wstring &bone_name, float mask);
+        float GetBoneMask(size_t layer, size_t bone_index) const;
 
-        std::vector<Vector3f> vertex_images_;
-        std::vector<BoneImage> bone_images_;
-        std::vector<MaterialImage> material_mul_images_;
-        std::vector<MaterialImage> material_add_images_;
+        /**
+          Ramps the weight of the layer linearly to the target over
+          duration seconds from the next seek. CrossFade() fades one layer
+          out and another in over the same time.
+        **/
+        void FadeLayer(size_t layer, float weight, double duration);
+        void CrossFade(size_t from_layer, size_t to_layer, double duration);
+        bool IsFading(size_t layer) const;
 
-        std::vector<float> morph_rates_;
+        /** frame is at MMD_FRAME_RATE, each layer samples at its motion's rate. **/
+        void SeekFrame(size_t frame);
+        void SeekTime(double time);
 
-        void UpdateBoneTransform(size_t index);
-        void UpdateBoneTransform(const std::vector<size_t> &list);
+    private:
+        MotionBlender &operator=(const MotionBlender&);
+
+        struct Layer {
+            const Motion *motion_;
+            float weight_;
+            double time_offset_;
+            std::vector<float> bone_masks_;
+
+            bool fading_;
+            bool fade_started_;
+            float fade_from_;
+            float fade_to_;
+            double fade_begin_;
+            double fade_duration_;
+        };
 
-        void UpdateBoneSkinningMatrix(const std::vector<size_t> &list);
+        /* one per bone (morph) and layer with a track for it, grouped by bone (morph) in layer order */
+        struct BoneEntry {
+            size_t bone_;
+            size_t layer_;
+            const Motion::BoneTrack *track_;
+            size_t cursor_;
+        };
 
-        void UpdateMorphTransform(size_t index, float rate);
+        struct MorphEntry {
+            size_t morph_;
+            size_t layer_;
+            const Motion::MorphTrack *track_;
+            size_t cursor_;
+        };
 
-        Model &model_;
+        void Index();
+        void UpdateFades(double time);
 
-        std::map<std::wstring, size_t> bone_name_map_;
-        std::map<std::wstring, size_t> morph_name_map_;
+        std::vector<Layer> layers_;
+        std::vector<BoneEntry> bone_entries_;
+        std::vector<MorphEntry> morph_entries_;
 
-        std::vector<size_t> pre_physics_bones_;
-        std::vector<size_t> post_physics_bones_;
+        SeekContinuity continuity_;
 
-        Poser &operator=(Poser&);
+        Poser &poser_;
     };
 
-    class MotionPlayer {
+    /**
+      Samples the motions of many posers in one pass, for crowds. The
+      instances playing the same Motion form a group whose samples are
+      laid out track by track, so one track's keyframes and curves are
+      walked for every instance of the group (each at its own time)
+      before the next track is touched. The tracks of all groups are
+      sampled in parallel with OpenMP when it is enabled, then each
+      instance's poses are set on its Poser, also in parallel.
+
+      Every instance needs a Poser of its own. Posing and deforming the
+      posers is left to the caller.
+    **/
+    class CrowdSampler {
     public:
-        MotionPlayer(const Motion &motion, Poser &poser);
-        void SeekFrame(size_t frame);
-        void SeekTime(double time);
+        CrowdSampler();
+
+        /**
+          Returns the index of the new instance, which starts at time 0.
+          Instances are bound to their tracks on the next Sample().
+        **/
+        size_t AddInstance(const Motion &motion, Poser &poser);
+        size_t GetInstanceNum() const;
+        /** Number of distinct motions. **/
+        size_t GetGroupNum() const;
+
+        void SetTime(size_t instance, double time);
+        double GetTime(size_t instance) const;
+
+        /** Samples every instance at its time. **/
+        void Sample();
+        /** Moves every instance's time by delta seconds and samples. **/
+        void Advance(double delta);
 
     private:
-        MotionPlayer &operator=(const MotionPlayer&);
+        CrowdSampler(const CrowdSampler&);
+        CrowdSampler &operator=(const CrowdSampler&);
+
+        /* per track and instance tables are [track*instance_num+slot] */
+        struct Group {
+            const Motion *motion_;
+            std::vector<size_t> instances_;
+            /* instances covered by the tables, the rest are indexed on the next Sample() */
+            size_t indexed_num_;
+
+            std::vector<const Motion::BoneTrack*> bone_tracks_;
+            /* nil when the instance's model has no bone for the track */
+            std::vector<size_t> bones_;
+            std::vector<size_t> bone_cursors_;
+            std::vector<Vector3f> translations_;
+            std::vector<Vector4f> rotations_;
+
+            std::vector<const Motion::MorphTrack*> morph_tracks_;
+            std::vector<size_t> morphs_;
+            std::vector<size_t> morph_cursors_;
+            std::vector<float> weights_;
+        };
+
+        struct Instance {
+            Poser *poser_;
+            size_t group_;
+            size_t slot_;
+            double time_;
+            SeekContinuity continuity_;
+        };
 
-        std::vector<std::pair<std::wstring, size_t>> bone_map_;
-        std::vector<std::pair<std::wstring, size_t>> morph_map_;
+        /* one track of one group */
+        struct Job {
+            size_t group_;
+            size_t track_;
+            bool morph_;
+        };
 
-        const Motion &motion_;
-        Poser &poser_;
+        void Index(size_t group);
+        void RebuildJobs();
+        void SampleTrack(const Job &job);
+        void SetPoses(size_t instance);
+
+        std::vector<Group> groups_;
+        std::vector<Instance> instances_;
+        std::vector<Job> jobs_;
+        std::map<const Motion*, size_t> group_map_;
     };
 
 #include "poser_impl.inl"
@@ -6,550 +6,784 @@
             http://www.boost.org/LICENSE_1_0.txt)
 **/
 
-/**
-  Reference:
-    ik.txt & ikx.txt
-      - Possibly original implementation in MMD, released by Higuchi Yu.
-        Listed at VPVP wiki, MMD Related Libraries:
-          http://www6.atwiki.jp/vpvpwiki/pages/288.html
-**/
-inline Poser::Poser(Model &model) : model_(model) {
+inline Poser::Poser(Model &model)
+  : rig_(model), state_(rig_), pose_image(state_.pose_image), model_(model) {}
 
-    /***** Create Pose Image *****/
-    size_t vertex_num = model_.GetVertexNum();
-    pose_image.coordinates.insert(pose_image.coordinates.end(), vertex_num, Vector3f());
-    pose_image.normals.insert(pose_image.normals.end(), vertex_num, Vector3f());
+inline void Poser::ResetPosing() {
+    rig_.ResetPosing(state_);
+}
 
-    /***** Create Vertex Images *****/
-    vertex_images_.insert(vertex_images_.end(), vertex_num, Vector3f());
+inline void Poser::PrePhysicsPosing() {
+    rig_.PrePhysicsPosing(state_);
+}
 
-    /***** Create Bone Images *****/
-    size_t bone_num = model_.GetBoneNum();
-    bone_images_.insert(bone_images_.end(), bone_num, BoneImage());
+inline void Poser::PostPhysicsPosing() {
+    rig_.PostPhysicsPosing(state_);
+}
 
-    for(size_t i=0;i<bone_num;++i) {
-        const Model::Bone& bone = model_.GetBone(i);
-        bone_name_map_[bone.GetName()] = i;
+inline void Poser::Deform() {
+    rig_.Deform(state_);
+}
 
-        BoneImage& image = bone_images_[i];
+inline void Poser::SetIKWarmStart(bool warm_start) {
+    state_.SetIKWarmStart(warm_start);
+}
 
-        image.global_offset_matrix_.r.v[3].downgrade.vector3d = -bone.GetPosition();
-        image.global_offset_matrix_inv_.r.v[3].downgrade.vector3d = bone.GetPosition();
+inline bool Poser::IsIKWarmStart() const {
+    return state_.IsIKWarmStart();
+}
 
-        image.parent_ = bone.GetParentIndex();
-        if(image.parent_<bone_num) {
-            image.has_parent_ = true;
-            image.local_offset_ = bone.GetPosition()-model_.GetBone(image.parent_).GetPosition();
-        } else {
-            image.has_parent_ = false;
-            image.local_offset_ = bone.GetPosition();
-        }
+inline void Poser::SetIKWarmStartThreshold(float distance) {
+    state_.SetIKWarmStartThreshold(distance);
+}
 
-        image.append_rotate_ = bone.IsAppendRotate();
-        image.append_translate_ = bone.IsAppendTranslate();
-        image.has_append_ = false;
-        if(image.append_rotate_||image.append_translate_) {
-            image.append_parent_ = bone.GetAppendIndex();
-            if(image.append_parent_<bone_num) {
-                image.has_append_ = true;
-                image.append_ratio_ = bone.GetAppendRatio();
-            }
-        }
+inline float Poser::GetIKWarmStartThreshold() const {
+    return state_.GetIKWarmStartThreshold();
+}
 
-        image.has_ik_ = bone.IsHasIK();
-        if(image.has_ik_) {
-            size_t ik_link_num = bone.GetIKLinkNum();
-            image.ik_links_.insert(image.ik_links_.end(), ik_link_num, 0);
-            image.ik_fix_types_.insert(image.ik_fix_types_.end(), ik_link_num, BoneImage::FIX_NONE);
-            image.ik_transform_orders_.insert(image.ik_transform_orders_.end(), ik_link_num, BoneImage::ORDER_YZX);
-            image.ik_link_limited_.insert(image.ik_link_limited_.end(), ik_link_num, false);
-            image.ik_link_limits_min_.insert(image.ik_link_limits_min_.end(), ik_link_num, Vector3f());
-            image.ik_link_limits_max_.insert(image.ik_link_limits_max_.end(), ik_link_num, Vector3f());
-
-            for(size_t j=0;j<ik_link_num;++j) {
-                const Model::Bone::IKLink& ik_link = bone.GetIKLink(j);
-                image.ik_links_[j] = ik_link.GetLinkIndex();
-                image.ik_link_limited_[j] = ik_link.IsHasLimit();
-                if(image.ik_link_limited_[j]) {
-                    for(size_t k=0;k<3;++k) {
-                        image.ik_link_limits_min_[j].v[k] = std::min(ik_link.GetLoLimit().v[k], ik_link.GetHiLimit().v[k]);
-                        image.ik_link_limits_max_[j].v[k] = std::max(ik_link.GetLoLimit().v[k], ik_link.GetHiLimit().v[k]);
-                    }
-                    if(image.ik_link_limits_min_[j].p.x>-mmd_math_const_pi*0.5f&&image.ik_link_limits_max_[j].p.x<mmd_math_const_pi*0.5f) {
-                        image.ik_transform_orders_[j] = BoneImage::ORDER_ZXY;
-                    } else if(image.ik_link_limits_min_[j].p.y>-mmd_math_const_pi*0.5f&&image.ik_link_limits_max_[j].p.y<mmd_math_const_pi*0.5f) {
-                        image.ik_transform_orders_[j] = BoneImage::ORDER_XYZ;
-                    }
-                    if((abs(image.ik_link_limits_min_[j].p.x)<mmd_math_const_eps)&&(abs(image.ik_link_limits_max_[j].p.x)<mmd_math_const_eps)&&(abs(image.ik_link_limits_min_[j].p.y)<mmd_math_const_eps)&&(abs(image.ik_link_limits_max_[j].p.y)<mmd_math_const_eps)&&(abs(image.ik_link_limits_min_[j].p.z)<mmd_math_const_eps)&&(abs(image.ik_link_limits_max_[j].p.z)<mmd_math_const_eps)) {
-                        image.ik_fix_types_[j] = BoneImage::FIX_ALL;
-                    } else if((abs(image.ik_link_limits_min_[j].p.y)<mmd_math_const_eps)&&(abs(image.ik_link_limits_max_[j].p.y)<mmd_math_const_eps)&&(abs(image.ik_link_limits_min_[j].p.z)<mmd_math_const_eps)&&(abs(image.ik_link_limits_max_[j].p.z)<mmd_math_const_eps)) {
-                        image.ik_fix_types_[j] = BoneImage::FIX_X;
-                    } else if((abs(image.ik_link_limits_min_[j].p.x)<mmd_math_const_eps)&&(abs(image.ik_link_limits_max_[j].p.x)<mmd_math_const_eps)&&(abs(image.ik_link_limits_min_[j].p.z)<mmd_math_const_eps)&&(abs(image.ik_link_limits_max_[j].p.z)<mmd_math_const_eps)) {
-                        image.ik_fix_types_[j] = BoneImage::FIX_Y;
-                    } else if((abs(image.ik_link_limits_min_[j].p.x)<mmd_math_const_eps)&&(abs(image.ik_link_limits_max_[j].p.x)<mmd_math_const_eps)&&(abs(image.ik_link_limits_min_[j].p.y)<mmd_math_const_eps)&&(abs(image.ik_link_limits_max_[j].p.y)<mmd_math_const_eps)) {
-                        image.ik_fix_types_[j] = BoneImage::FIX_Z;
-                    }
-                }
-                bone_images_[image.ik_links_[j]].ik_link_ = true;
-            }
-            image.ccd_angle_limit_ = bone.GetCCDAngleLimit();
-            image.ccd_iterate_limit_ = std::min(bone.GetCCDIterateLimit(), size_t(256));
-            image.ik_target_ = bone.GetIKTargetIndex();
-        }
+inline void Poser::SetIKWarmStartTolerance(float distance) {
+    state_.SetIKWarmStartTolerance(distance);
+}
 
-        if(bone.IsPostPhysics()) {
-            post_physics_bones_.push_back(i);
-        } else {
-            pre_physics_bones_.push_back(i);
-        }
-    }
+inline float Poser::GetIKWarmStartTolerance() const {
+    return state_.GetIKWarmStartTolerance();
+}
 
-    BoneImage::TransformOrder order(model_);
-    std::sort(pre_physics_bones_.begin(), pre_physics_bones_.end(), order);
-    std::sort(post_physics_bones_.begin(), post_physics_bones_.end(), order);
+inline void Poser::ResetIKWarmStart() {
+    state_.ResetIKWarmStart();
+}
 
-    /***** Create Material Images *****/
-    size_t material_num = model_.GetPartNum();
-    material_mul_images_.insert(material_mul_images_.end(), material_num, MaterialImage(1.0f));
-    material_add_images_.insert(material_add_images_.end(), material_num, MaterialImage(0.0f));
+inline void Poser::SetIKSolver(IKSolverType solver) {
+    rig_.SetIKSolver(solver);
+}
 
-    /***** Create Morph Rates *****/
-    size_t morph_num = model_.GetMorphNum();
-    morph_rates_.insert(morph_rates_.end(), morph_num, 0.0f);
+inline void Poser::SetIKSolver(size_t index, IKSolverType solver) {
+    rig_.SetIKSolver(index, solver);
+}
 
-    for(size_t i=0;i<morph_num;++i) {
-        const Model::Morph& morph = model_.GetMorph(i);
-        morph_name_map_[morph.GetName()] = i;
-    }
+inline Poser::IKSolverType Poser::GetIKSolver(size_t index) const {
+    return rig_.GetIKSolver(index);
+}
 
-    /***** 1st Posing *****/
-    ResetPosing();
-    Deform();
+inline size_t Poser::GetIKIterationNum(size_t index) const {
+    size_t chain_index = rig_.GetIKChainIndex(index);
+    return chain_index!=nil?state_.GetIKIterationNum(chain_index):0;
 }
 
-inline void Poser::ResetPosing() {
-    for(std::vector<float>::iterator i=morph_rates_.begin();i!=morph_rates_.end();++i) {
-        *i = 0;
+inline float Poser::GetIKError(size_t index) const {
+    size_t chain_index = rig_.GetIKChainIndex(index);
+    return chain_index!=nil?state_.GetIKError(chain_index):0.0f;
+}
+
+inline const Poser::MaterialImage& Poser::GetMaterialMulImage(size_t index) const {
+    return state_.GetMaterialMulImage(index);
+}
+
+inline const Poser::MaterialImage& Poser::GetMaterialAddImage(size_t index) const {
+    return state_.GetMaterialAddImage(index);
+}
+
+inline void Poser::ClearPoseImageDirty() {
+    state_.ClearPoseImageDirty();
+}
+
+inline const Rig& Poser::GetRig() const { return rig_; }
+inline Rig& Poser::GetRig() { return rig_; }
+
+inline const PoseState& Poser::GetPoseState() const { return state_; }
+inline PoseState& Poser::GetPoseState() { return state_; }
+
+inline const Model& Poser::GetModel() const { return model_; }
+inline Model& Poser::GetModel() { return model_; }
+
+inline void Poser::SetBonePose(size_t index, const Motion::BonePose& bone_pose) {
+    state_.SetBonePose(index, bone_pose);
+}
+
+inline void Poser::SetBonePose(const std::wstring &name, const Motion::BonePose& bone_pose) {
+    size_t index = rig_.GetBoneIndex(name);
+    if(index!=nil) {
+        SetBonePose(index, bone_pose);
     }
-    for(std::vector<BoneImage>::iterator i=bone_images_.begin();i!=bone_images_.end();++i) {
-        i->rotation_.q.MakeIdentity();
-        i->translation_.MakeZero();
+}
+
+inline void Poser::SetMorphPose(size_t index, const Motion::MorphPose &morph_pose) {
+    state_.SetMorphPose(index, morph_pose);
+}
+
+inline void Poser::SetMorphPose(const std::wstring &name, const Motion::MorphPose &morph_pose) {
+    size_t index = rig_.GetMorphIndex(name);
+    if(index!=nil) {
+        SetMorphPose(index, morph_pose);
     }
-    PrePhysicsPosing();
-    PostPhysicsPosing();
 }
 
-inline void Poser::UpdateBoneTransform(size_t index) {
-    BoneImage& image = bone_images_[index];
-    image.total_rotation_.q = image.morph_rotation_.q*image.rotation_.q;
-    image.total_translation_ = image.morph_translation_+image.translation_;
+inline SeekContinuity::SeekContinuity()
+  : has_last_frame_(false), last_frame_(0.0), last_step_(0.0), jump_step_(0.0) {}
+
+inline void SeekContinuity::Check(Poser &poser, double frame) {
+    double step = frame-last_frame_;
+    bool continuous = has_last_frame_&&step>=0.0&&(
+        step<=std::max(1.0, 1.75*last_step_)||
+        (jump_step_>0.0&&math::abs(step-jump_step_)<=0.5*jump_step_)
+    );
+    if(continuous) {
+        last_step_ = step;
+        jump_step_ = 0.0;
+    } else {
+        poser.ResetIKWarmStart();
+        last_step_ = 0.0;
+        jump_step_ = has_last_frame_&&step>0.0?step:0.0;
+    }
+    has_last_frame_ = true;
+    last_frame_ = frame;
+}
 
-    if(image.has_append_) {
-        if(image.append_rotate_) {
-            image.total_rotation_.q = image.total_rotation_.q*SLerp(Quaternionf::Identity(), bone_images_[image.append_parent_].total_rotation_.q)[image.append_ratio_];
-        }
-        if(image.append_translate_) {
-            image.total_translation_ = image.total_translation_+image.append_ratio_*bone_images_[image.append_parent_].total_translation_;
+template<typename BoneTrackRef, typename MorphTrackRef>
+template<typename MotionType>
+inline void TrackBinding<BoneTrackRef, MorphTrackRef>::Bind(const MotionType &motion, const Model &model) {
+    bones_.clear();
+    for(size_t i=0;i<model.GetBoneNum();++i) {
+        BoneTrackRef track = motion.FindBoneTrack(model.GetBone(i).GetName());
+        if(IsBound(track)) {
+            bones_.push_back(std::make_pair(track, i));
         }
     }
 
-    if(image.ik_link_) {
-        image.pre_ik_rotation_ = image.total_rotation_;
-        image.total_rotation_.q = image.ik_rotation_.q*image.total_rotation_.q;
+    morphs_.clear();
+    for(size_t i=0;i<model.GetMorphNum();++i) {
+        MorphTrackRef track = motion.FindMorphTrack(model.GetMorph(i).GetName());
+        if(IsBound(track)) {
+            morphs_.push_back(std::make_pair(track, i));
+        }
     }
 
-    image.local_matrix_ = image.total_rotation_.q.ToRotateMatrix();
-    image.local_matrix_.r.v[3].downgrade.vector3d = image.total_translation_+image.local_offset_;
+    bone_cursors_.assign(bones_.size(), 0);
+    morph_cursors_.assign(morphs_.size(), 0);
+}
 
-    if(image.has_parent_) {
-        image.local_matrix_ = image.local_matrix_*bone_images_[image.parent_].local_matrix_;
+template<typename BoneTrackRef, typename MorphTrackRef>
+inline void TrackBinding<BoneTrackRef, MorphTrackRef>::Bind(const RetargetMap &retarget) {
+    bones_.clear();
+    for(size_t i=0;i<retarget.GetBoneBindingNum();++i) {
+        bones_.push_back(std::make_pair(retarget.GetBoneTrack(i), retarget.GetBoneIndex(i)));
+    }
+    morphs_.clear();
+    for(size_t i=0;i<retarget.GetMorphBindingNum();++i) {
+        morphs_.push_back(std::make_pair(retarget.GetMorphTrack(i), retarget.GetMorphIndex(i)));
     }
 
-    if(image.has_ik_) {
-        struct __ {
-            static float Nabs(float x) {
-                if(x>=0.0f) {
-                    return 1.0f;
-                } else {
-                    return -1.0f;
-                }
-            }
+    bone_cursors_.assign(bones_.size(), 0);
+    morph_cursors_.assign(morphs_.size(), 0);
+}
 
-            static Vector3f LimitEulerAngle(const Vector3f& euler, const Vector3f& euler_min, const Vector3f& euler_max, bool ikt) {
-                Vector3f result = euler;
-                for(size_t i=0;i<3;++i) {
-                    if(result.v[i] < euler_min.v[i]) {
-                        float tf= 2 * euler_min.v[i] - result.v[i];
-                        if(tf <= euler_max.v[i] && ikt) result.v[i] = tf;
-                        else result.v[i] = euler_min.v[i];
-                    }
-                    if(result.v[i] > euler_max.v[i]) {
-                        float tf= 2 * euler_max.v[i] - result.v[i];
-                        if(tf >= euler_min.v[i] && ikt) result.v[i] = tf;
-                        else result.v[i] = euler_max.v[i];
-                    }
-                }
-                return result;
-            }
-        };
+template<typename BoneTrackRef, typename MorphTrackRef>
+inline bool TrackBinding<BoneTrackRef, MorphTrackRef>::IsBound(const void *track) {
+    return track!=NULL;
+}
 
-        Vector3f ik_error;
+template<typename BoneTrackRef, typename MorphTrackRef>
+inline bool TrackBinding<BoneTrackRef, MorphTrackRef>::IsBound(size_t track) {
+    return track!=nil;
+}
 
-        size_t ik_link_num = image.ik_links_.size();
-        for(size_t i=0;i<ik_link_num;++i) {
-            bone_images_[image.ik_links_[i]].ik_rotation_.q.MakeIdentity();
-        }
-        Vector3f ik_position = image.local_matrix_.r.v[3].downgrade.vector3d;
-        for(size_t i=0;i<ik_link_num;++i) {
-            UpdateBoneTransform(image.ik_links_[ik_link_num-i-1]);
-        }
-        UpdateBoneTransform(image.ik_target_);
-        Vector3f target_position = bone_images_[image.ik_target_].local_matrix_.r.v[3].downgrade.vector3d;
-        ik_error = ik_position-target_position;
-        if(ik_error*ik_error<mmd_math_const_eps) {
-            return;
-        }
-        size_t ikt = image.ccd_iterate_limit_/2;
-        for(size_t i=0;i<image.ccd_iterate_limit_;++i) {
-            for(size_t j=0;j<ik_link_num;++j) {
-                if(image.ik_fix_types_[j]!=BoneImage::FIX_ALL) {
-                    BoneImage& ik_image = bone_images_[image.ik_links_[j]];
-                    Vector3f ik_link_position = ik_image.local_matrix_.r.v[3].downgrade.vector3d;
-                    Vector3f target_direction = ik_link_position-target_position;
-                    Vector3f ik_direction = ik_link_position-ik_position;
-
-                    target_direction = target_direction.Normalize();
-                    ik_direction = ik_direction.Normalize();
-
-                    Vector3f ik_rotate_axis;
-                    ik_rotate_axis.t = target_direction.t*ik_direction.t;
-                    for(size_t k=0;k<3;++k) {
-                        if(std::abs(ik_rotate_axis.v[k])<mmd_math_const_eps) {
-                            ik_rotate_axis.v[k] = (float)mmd_math_const_eps;
-                        }
-                    }
-                    Matrix4f localization_matrix;
-                    if(ik_image.has_parent_) {
-                        localization_matrix = bone_images_[ik_image.parent_].local_matrix_;
-                    } else {
-                        localization_matrix.MakeIdentity();
-                    }
-                    if(image.ik_link_limited_[j]&&image.ik_fix_types_[j]!=BoneImage::FIX_NONE&&i<ikt) {
-                        switch(image.ik_fix_types_[j]) {
-                        case BoneImage::FIX_X:
-                            {
-                                ik_rotate_axis.p.x = __::Nabs(ik_rotate_axis*localization_matrix.r.v[0].downgrade.vector3d);
-                                ik_rotate_axis.p.y = ik_rotate_axis.p.z = 0.0f;
-                                break;
-                            }
-                        case BoneImage::FIX_Y:
-                            {
-                                ik_rotate_axis.p.y = __::Nabs(ik_rotate_axis*localization_matrix.r.v[1].downgrade.vector3d);
-                                ik_rotate_axis.p.x = ik_rotate_axis.p.z = 0.0f;
-                                break;
-                            }
-                        case BoneImage::FIX_Z:
-                            {
-                                ik_rotate_axis.p.z = __::Nabs(ik_rotate_axis*localization_matrix.r.v[2].downgrade.vector3d);
-                                ik_rotate_axis.p.x = ik_rotate_axis.p.y = 0.0f;
-                                break;
-                            }
-                        case BoneImage::FIX_ALL: case BoneImage::FIX_NONE: default: { break; }
-                        }
-                    } else {
-                        ik_rotate_axis = rotate(ik_rotate_axis, localization_matrix.Transpose());
-                        ik_rotate_axis = ik_rotate_axis.Normalize();
-                    }
-                    float ik_rotate_angle = std::min(math::acos(math::clamp(target_direction*ik_direction,-1.0f,1.0f)), image.ccd_angle_limit_*(j+1));
-                    ik_image.ik_rotation_.q = AxisToQuaternion(ik_rotate_axis, ik_rotate_angle)*ik_image.ik_rotation_.q;
-                    if(image.ik_link_limited_[j]) {
-                        Quaternionf local_rotation = ik_image.ik_rotation_.q*ik_image.pre_ik_rotation_.q;
-                        switch(image.ik_transform_orders_[j]) {
-                        case BoneImage::ORDER_ZXY:
-                            {
-                                Vector3f euler_angle = QuaternionToZXY(local_rotation);
-                                euler_angle = __::LimitEulerAngle(euler_angle, image.ik_link_limits_min_[j], image.ik_link_limits_max_[j], i<ikt);
-                                local_rotation = ZXYToQuaternion(euler_angle);
-                                break;
-                            }
-                        case BoneImage::ORDER_XYZ:
-                            {
-                                Vector3f euler_angle = QuaternionToXYZ(local_rotation);
-                                euler_angle = __::LimitEulerAngle(euler_angle, image.ik_link_limits_min_[j], image.ik_link_limits_max_[j], i<ikt);
-                                local_rotation = XYZToQuaternion(euler_angle);
-                                break;
-                            }
-                        case BoneImage::ORDER_YZX:
-                            {
-                                Vector3f euler_angle = QuaternionToYZX(local_rotation);
-                                euler_angle = __::LimitEulerAngle(euler_angle, image.ik_link_limits_min_[j], image.ik_link_limits_max_[j], i<ikt);
-                                local_rotation = YZXToQuaternion(euler_angle);
-                                break;
-                            }
-                        }
-                        ik_image.ik_rotation_.q = local_rotation*ik_image.pre_ik_rotation_.q.Inverse();
-                    }
-                    for(size_t k=0;k<=j;++k) {
-                        BoneImage& link_image = bone_images_[image.ik_links_[j-k]];
-                        link_image.total_rotation_.q = link_image.ik_rotation_.q*link_image.pre_ik_rotation_.q;
-                        link_image.local_matrix_ = link_image.total_rotation_.q.ToRotateMatrix();
-                        link_image.local_matrix_.r.v[3].downgrade.vector3d = link_image.total_translation_+link_image.local_offset_;
-                        if(link_image.has_parent_) {
-                            link_image.local_matrix_ = link_image.local_matrix_*bone_images_[link_image.parent_].local_matrix_;
-                        }
-                    }
-                    UpdateBoneTransform(image.ik_target_);
-                    target_position = bone_images_[image.ik_target_].local_matrix_.r.v[3].downgrade.vector3d;
-                }
-            }
-            ik_error = ik_position-target_position;
-            if(ik_error*ik_error<float(mmd_math_const_eps)) {
-                return;
-            }
-        }
+inline MotionPlayer::MotionPlayer(const Motion& motion, Poser& poser)
+  : motion_(motion), retarget_(NULL), poser_(poser) {
+    binding_.Bind(motion_, poser_.GetModel());
+}
+
+inline MotionPlayer::MotionPlayer(const RetargetMap& retarget, Poser& poser)
+  : motion_(retarget.GetMotion()), retarget_(&retarget), poser_(poser) {
+    binding_.Bind(retarget);
+}
+
+inline void MotionPlayer::SeekFrame(size_t frame) {
+    continuity_.Check(poser_, (double)frame);
+    for(size_t i=0;i<binding_.morphs_.size();++i) {
+        const std::pair<const Motion::MorphTrack*, size_t> &entry = binding_.morphs_[i];
+        poser_.SetMorphPose(entry.second, Motion::GetMorphPose(*entry.first, frame, binding_.morph_cursors_[i]));
+    }
+    for(size_t i=0;i<binding_.bones_.size();++i) {
+        const std::pair<const Motion::BoneTrack*, size_t> &entry = binding_.bones_[i];
+        Motion::BonePose pose = Motion::GetBonePose(*entry.first, frame, binding_.bone_cursors_[i]);
+        poser_.SetBonePose(entry.second, retarget_!=NULL?retarget_->Correct(i, pose):pose);
     }
 }
 
-inline void Poser::UpdateBoneTransform(const std::vector<size_t> &list) {
-    size_t n = list.size();
-    for(size_t i=0;i<n;++i) {
-        UpdateBoneTransform(list[i]);
+inline void MotionPlayer::SeekTime(double time) {
+    continuity_.Check(poser_, time*motion_.GetFrameRate());
+    for(size_t i=0;i<binding_.morphs_.size();++i) {
+        const std::pair<const Motion::MorphTrack*, size_t> &entry = binding_.morphs_[i];
+        poser_.SetMorphPose(entry.second, Motion::GetMorphPose(*entry.first, time, binding_.morph_cursors_[i]));
+    }
+    for(size_t i=0;i<binding_.bones_.size();++i) {
+        const std::pair<const Motion::BoneTrack*, size_t> &entry = binding_.bones_[i];
+        Motion::BonePose pose = Motion::GetBonePose(*entry.first, time, binding_.bone_cursors_[i]);
+        poser_.SetBonePose(entry.second, retarget_!=NULL?retarget_->Correct(i, pose):pose);
     }
 }
 
-inline void Poser::UpdateBoneSkinningMatrix(const std::vector<size_t> &list) {
-    size_t n = list.size();
-    for(size_t i=0;i<n;++i) {
-        Poser::BoneImage& image = bone_images_[list[i]];
-        image.skinning_matrix_ = image.global_offset_matrix_*image.local_matrix_;
+inline ResampledMotionPlayer::ResampledMotionPlayer(const Motion& motion, Poser& poser)
+  : sample_num_(0), time_(0.0), motion_(motion), retarget_(NULL), poser_(poser) {
+    binding_.Bind(motion_, poser_.GetModel());
+    InitSnapshots();
+}
+
+inline ResampledMotionPlayer::ResampledMotionPlayer(const RetargetMap& retarget, Poser& poser)
+  : sample_num_(0), time_(0.0), motion_(retarget.GetMotion()), retarget_(&retarget), poser_(poser) {
+    binding_.Bind(retarget);
+    InitSnapshots();
+}
+
+inline void ResampledMotionPlayer::InitSnapshots() {
+    for(size_t i=0;i<SNAPSHOT_NUM;++i) {
+        Snapshot &snapshot = snapshots_[i];
+        snapshot.frame_ = nil;
+        snapshot.translations_.resize(binding_.bones_.size());
+        snapshot.rotations_.resize(binding_.bones_.size());
+        snapshot.weights_.resize(binding_.morphs_.size());
     }
 }
 
-inline void Poser::UpdateMorphTransform(size_t index, float rate) {
-    if(rate<mmd_math_const_eps) {
-        return;
+inline const ResampledMotionPlayer::Snapshot& ResampledMotionPlayer::GetSnapshot(size_t frame) {
+    Snapshot &snapshot = snapshots_[frame%SNAPSHOT_NUM];
+    if(snapshot.frame_==frame) {
+        return snapshot;
     }
-    const Model::Morph &morph = model_.GetMorph(index);
-    switch(morph.GetType()) {
-    case Model::Morph::MORPH_TYPE_GROUP:
-        for(size_t i=0;i<morph.GetMorphDataNum();++i) {
-            const Model::Morph::MorphData::GroupMorph &data = morph.GetMorphData(i).GetGroupMorph();
-            UpdateMorphTransform(data.GetMorphIndex(), data.GetMorphRate()*rate);
+    for(size_t i=0;i<binding_.bones_.size();++i) {
+        Motion::BonePose pose = Motion::GetBonePose(*binding_.bones_[i].first, frame, binding_.bone_cursors_[i]);
+        if(retarget_!=NULL) {
+            pose = retarget_->Correct(i, pose);
         }
-        break;
-    case Model::Morph::MORPH_TYPE_VERTEX:
-        for(size_t i=0;i<morph.GetMorphDataNum();++i) {
-            const Model::Morph::MorphData::VertexMorph &data = morph.GetMorphData(i).GetVertexMorph();
-            Vector3f &vertex_image = vertex_images_[data.GetVertexIndex()];
-            vertex_image = vertex_image+data.GetOffset()*rate;
+        snapshot.translations_[i] = pose.GetTranslation();
+        snapshot.rotations_[i] = pose.GetRotation();
+    }
+    for(size_t i=0;i<binding_.morphs_.size();++i) {
+        snapshot.weights_[i] = Motion::GetMorphPose(*binding_.morphs_[i].first, frame, binding_.morph_cursors_[i]).GetWeight();
+    }
+    snapshot.frame_ = frame;
+    ++sample_num_;
+    return snapshot;
+}
+
+inline void ResampledMotionPlayer::SeekFrame(size_t frame) {
+    SeekTime((double)frame/motion_.GetFrameRate());
+}
+
+inline void ResampledMotionPlayer::SeekTime(double time) {
+    time_ = time;
+    double dframe = std::max(0.0, time*motion_.GetFrameRate());
+    continuity_.Check(poser_, dframe);
+
+    size_t frame = (size_t)dframe;
+    float lambda = (float)(dframe-frame);
+    const Snapshot &left = GetSnapshot(frame);
+    if(lambda==0.0f) {
+        for(size_t i=0;i<binding_.morphs_.size();++i) {
+            poser_.SetMorphPose(binding_.morphs_[i].second, Motion::MorphPose(left.weights_[i]));
         }
-        break;
-    case Model::Morph::MORPH_TYPE_BONE:
-        for(size_t i=0;i<morph.GetMorphDataNum();++i) {
-            const Model::Morph::MorphData::BoneMorph &data = morph.GetMorphData(i).GetBoneMorph();
-            BoneImage &bone_image = bone_images_[data.GetBoneIndex()];
-            bone_image.morph_translation_ = bone_image.morph_translation_+data.GetTranslation()*rate;
-            bone_image.morph_rotation_.q = bone_image.morph_rotation_.q*SLerp(Quaternionf::Identity(), data.GetRotation().q)[rate];
+        for(size_t i=0;i<binding_.bones_.size();++i) {
+            poser_.SetBonePose(binding_.bones_[i].second, Motion::BonePose(left.translations_[i], left.rotations_[i]));
         }
-        break;
-    case Model::Morph::MORPH_TYPE_MATERIAL:
-        break;
-    default:
-        break;
+        return;
     }
-}
 
-inline void Poser::PrePhysicsPosing() {
-    for(std::vector<Vector3f>::iterator i = vertex_images_.begin();i!=vertex_images_.end();++i) {
-        i->MakeZero();
+    const Snapshot &right = GetSnapshot(frame+1);
+    for(size_t i=0;i<binding_.morphs_.size();++i) {
+        float weight = left.weights_[i]*(1.0f-lambda)+right.weights_[i]*lambda;
+        poser_.SetMorphPose(binding_.morphs_[i].second, Motion::MorphPose(weight));
     }
-    for(std::vector<BoneImage>::iterator i = bone_images_.begin();i!=bone_images_.end();++i) {
-        i->morph_translation_.MakeZero();
-        i->morph_rotation_.q.MakeIdentity();
+    for(size_t i=0;i<binding_.bones_.size();++i) {
+        Vector3f translation = left.translations_[i]*(1.0f-lambda)+right.translations_[i]*lambda;
+        Vector4f rotation = NLerp(left.rotations_[i], right.rotations_[i])[lambda];
+        poser_.SetBonePose(binding_.bones_[i].second, Motion::BonePose(translation, rotation));
+    }
+}
+
+inline void ResampledMotionPlayer::Advance(double delta) {
+    SeekTime(time_+delta);
+}
 
-        i->local_matrix_.MakeIdentity();
+inline double ResampledMotionPlayer::GetTime() const {
+    return time_;
+}
 
-        i->pre_ik_rotation_.q.MakeIdentity();
-        i->ik_rotation_.q.MakeIdentity();
+inline size_t ResampledMotionPlayer::GetSnapshotSampleNum() const {
+    return sample_num_;
+}
 
-        i->total_rotation_.q.MakeIdentity();
-        i->total_translation_.MakeZero();
+inline BakedMotionPlayer::BakedMotionPlayer(const BakedMotion& motion, Poser& poser)
+  : motion_(motion), poser_(poser) {
+    binding_.Bind(motion_, poser_.GetModel());
+}
+
+inline void BakedMotionPlayer::SeekFrame(size_t frame) {
+    continuity_.Check(poser_, (double)frame);
+    for(std::vector<std::pair<size_t, size_t>>::iterator i=binding_.morphs_.begin();i!=binding_.morphs_.end();++i) {
+        poser_.SetMorphPose(i->second, motion_.GetMorphPose(i->first, frame));
     }
-    for(std::vector<MaterialImage>::iterator i = material_mul_images_.begin();i!=material_mul_images_.end();++i) {
-        i->Init(1.0f);
+    for(std::vector<std::pair<size_t, size_t>>::iterator i=binding_.bones_.begin();i!=binding_.bones_.end();++i) {
+        poser_.SetBonePose(i->second, motion_.GetBonePose(i->first, frame));
     }
-    for(std::vector<MaterialImage>::iterator i = material_add_images_.begin();i!=material_add_images_.end();++i) {
-        i->Init(0.0f);
+}
+
+inline void BakedMotionPlayer::SeekTime(double time) {
+    continuity_.Check(poser_, time*motion_.GetFrameRate());
+    for(std::vector<std::pair<size_t, size_t>>::iterator i=binding_.morphs_.begin();i!=binding_.morphs_.end();++i) {
+        poser_.SetMorphPose(i->second, motion_.GetMorphPose(i->first, time));
     }
-    for(size_t i=0;i<morph_rates_.size();++i) {
-        UpdateMorphTransform(i, morph_rates_[i]);
+    for(std::vector<std::pair<size_t, size_t>>::iterator i=binding_.bones_.begin();i!=binding_.bones_.end();++i) {
+        poser_.SetBonePose(i->second, motion_.GetBonePose(i->first, time));
     }
-    UpdateBoneTransform(pre_physics_bones_);
-    UpdateBoneSkinningMatrix(pre_physics_bones_);
 }
 
-inline void Poser::PostPhysicsPosing() {
-    UpdateBoneTransform(post_physics_bones_);
-    UpdateBoneSkinningMatrix(post_physics_bones_);
+inline CompressedMotionPlayer::CompressedMotionPlayer(const CompressedMotion& motion, Poser& poser)
+  : motion_(motion), poser_(poser) {
+    binding_.Bind(motion_, poser_.GetModel());
 }
 
-inline void Poser::Deform() {
-    size_t vertex_num = model_.GetVertexNum();
-    //for(size_t i=0;i<vertex_num;++i) {
-    //    Model::Vertex<ref> vertex = model_.GetVertex(i);
-    //    pose_image.coordinates[i] = ;
-    //    pose_image.normals[i] = ;
-    //}
-
-    for(size_t i=0;i<vertex_num;++i) {
-        Model::Vertex<ref> vertex = model_.GetVertex(i);
-        const Model::SkinningOperator& op = vertex.GetSkinningOperator();
-        const Vector3f &coordinate = vertex.GetCoordinate()+vertex_images_[i];
-        const Vector3f &normal = vertex.GetNormal();
-        switch(op.GetSkinningType()) {
-        case Model::SkinningOperator::SKINNING_BDEF1:
-            {
-                const Matrix4f &mat = bone_images_[op.GetBDEF1().GetBoneID()].skinning_matrix_;
-                pose_image.coordinates[i] = transform(coordinate, mat);
-                pose_image.normals[i] = rotate(normal, mat);
-            }
-            break;
-        case Model::SkinningOperator::SKINNING_SDEF:
-        case Model::SkinningOperator::SKINNING_BDEF2: default:
-            {
-                const Matrix4f &mat_0 = bone_images_[op.GetBDEF2().GetBoneID(0)].skinning_matrix_;
-                const Matrix4f &mat_1 = bone_images_[op.GetBDEF2().GetBoneID(1)].skinning_matrix_;
-                Matrix4f mat = Lerp(mat_1, mat_0)[op.GetBDEF2().GetBoneWeight()];
-                pose_image.coordinates[i] = transform(coordinate, mat);
-                pose_image.normals[i] = rotate(normal, mat);
-            }
-            break;
-        case Model::SkinningOperator::SKINNING_BDEF4:
-            {
-                const Matrix4f &mat_0 = bone_images_[op.GetBDEF4().GetBoneID(0)].skinning_matrix_;
-                const Matrix4f &mat_1 = bone_images_[op.GetBDEF4().GetBoneID(1)].skinning_matrix_;
-                const Matrix4f &mat_2 = bone_images_[op.GetBDEF4().GetBoneID(2)].skinning_matrix_;
-                const Matrix4f &mat_3 = bone_images_[op.GetBDEF4().GetBoneID(3)].skinning_matrix_;
-                Matrix4f mat = mat_0*op.GetBDEF4().GetBoneWeight(0)+mat_1*op.GetBDEF4().GetBoneWeight(1)+mat_2*op.GetBDEF4().GetBoneWeight(2)+mat_3*op.GetBDEF4().GetBoneWeight(3);
-                pose_image.coordinates[i] = transform(coordinate, mat);
-                pose_image.normals[i] = rotate(normal, mat);
-            }
-            break;
-        //case Model::SkinningOperator::SKINNING_SDEF:
-        //    {
-        //        const Matrix4f &mat_0 = bone_images_[op.GetSDEF().GetBoneID(0)].skinning_matrix_;
-        //        const Matrix4f &mat_1 = bone_images_[op.GetSDEF().GetBoneID(1)].skinning_matrix_;
-        //        const Vector3f &c = op.GetSDEF().GetC();
-        //        const Vector3f &r0 = op.GetSDEF().GetR0();
-        //        const Vector3f &r1 = op.GetSDEF().GetR1();
-        //        float weight = op.GetSDEF().GetBoneWeight();
-        //        Vector3f rr0 = transform(r0, mat_0);
-        //        Vector3f rr1 = transform(r1, mat_1);
-        //        Vector3f nc0 = transform(c, mat_0);
-        //        Vector3f nc1 = transform(c, mat_1);
-        //        Vector3f lr = Lerp(rr1, rr0)[weight];
-        //        Vector3f nc = Lerp(nc1, nc0)[weight];
-        //        Vector3f rc = lr;
-        //        Matrix4f mat = SLerp(Quaternionf::Identity(), bone_images_[op.GetSDEF().GetBoneID(1)].total_rotation_.q)[weight].ToRotateMatrix()*bone_images_[op.GetSDEF().GetBoneID(0)].local_matrix_;
-        //        pose_image.coordinates[i] = rotate(coordinate-c, mat)+rc;
-        //        pose_image.normals[i] = rotate(normal, mat);
-        //    }
-        //    break;
-        // UNDONE
-        }
+inline void CompressedMotionPlayer::SeekFrame(size_t frame) {
+    continuity_.Check(poser_, (double)frame);
+    for(size_t i=0;i<binding_.morphs_.size();++i) {
+        poser_.SetMorphPose(binding_.morphs_[i].second, motion_.GetMorphPose(binding_.morphs_[i].first, frame, binding_.morph_cursors_[i]));
+    }
+    for(size_t i=0;i<binding_.bones_.size();++i) {
+        poser_.SetBonePose(binding_.bones_[i].second, motion_.GetBonePose(binding_.bones_[i].first, frame, binding_.bone_cursors_[i]));
     }
 }
 
-inline const Model& Poser::GetModel() const { return model_; }
-inline Model& Poser::GetModel() { return model_; }
+inline void CompressedMotionPlayer::SeekTime(double time) {
+    continuity_.Check(poser_, time*motion_.GetFrameRate());
+    for(size_t i=0;i<binding_.morphs_.size();++i) {
+        poser_.SetMorphPose(binding_.morphs_[i].second, motion_.GetMorphPose(binding_.morphs_[i].first, time, binding_.morph_cursors_[i]));
+    }
+    for(size_t i=0;i<binding_.bones_.size();++i) {
+        poser_.SetBonePose(binding_.bones_[i].second, motion_.GetBonePose(binding_.bones_[i].first, time, binding_.bone_cursors_[i]));
+    }
+}
 
-inline void Poser::SetBonePose(size_t index, const Motion::BonePose& bone_pose) {
-    bone_images_[index].translation_ = bone_pose.GetTranslation();
-    bone_images_[index].rotation_ = bone_pose.GetRotation();
+inline MotionBlender::MotionBlender(Poser& poser)
+  : poser_(poser) {}
+
+inline size_t MotionBlender::AddLayer(const Motion& motion) {
+    Layer layer;
+    layer.motion_ = &motion;
+    layer.weight_ = 1.0f;
+    layer.time_offset_ = 0.0;
+    layer.bone_masks_.resize(poser_.GetModel().GetBoneNum(), 1.0f);
+    layer.fading_ = false;
+    layer.fade_started_ = false;
+    layer.fade_from_ = 0.0f;
+    layer.fade_to_ = 0.0f;
+    layer.fade_begin_ = 0.0;
+    layer.fade_duration_ = 0.0;
+    layers_.push_back(layer);
+    Index();
+    return layers_.size()-1;
 }
 
-inline void Poser::SetBonePose(const std::wstring &name, const Motion::BonePose& bone_pose) {
-    std::map<std::wstring, size_t>::iterator i = bone_name_map_.find(name);
-    if(i!=bone_name_map_.end()) {
-        SetBonePose(i->second, bone_pose);
+inline size_t MotionBlender::GetLayerNum() const {
+    return layers_.size();
+}
+
+inline void MotionBlender::SetLayerWeight(size_t layer, float weight) {
+    layers_[layer].weight_ = weight;
+    layers_[layer].fading_ = false;
+}
+
+inline float MotionBlender::GetLayerWeight(size_t layer) const {
+    return layers_[layer].weight_;
+}
+
+inline void MotionBlender::SetLayerTimeOffset(size_t layer, double offset) {
+    layers_[layer].time_offset_ = offset;
+}
+
+inline double MotionBlender::GetLayerTimeOffset(size_t layer) const {
+    return layers_[layer].time_offset_;
+}
+
+inline void MotionBlender::SetBoneMask(size_t layer, const std::wstring &bone_name, float mask) {
+    size_t index = poser_.GetRig().GetBoneIndex(bone_name);
+    if(index!=nil) {
+        layers_[layer].bone_masks_[index] = mask;
     }
 }
 
-inline void Poser::SetMorphPose(size_t index, const Motion::MorphPose &morph_pose) {
-    morph_rates_[index] = morph_pose.GetWeight();
+inline float MotionBlender::GetBoneMask(size_t layer, size_t bone_index) const {
+    return layers_[layer].bone_masks_[bone_index];
 }
 
-inline void Poser::SetMorphPose(const std::wstring &name, const Motion::MorphPose &morph_pose) {
-    std::map<std::wstring, size_t>::iterator i = morph_name_map_.find(name);
-    if(i!=morph_name_map_.end()) {
-        SetMorphPose(i->second, morph_pose);
+inline void MotionBlender::FadeLayer(size_t layer, float weight, double duration) {
+    Layer &l = layers_[layer];
+    l.fading_ = true;
+    l.fade_started_ = false;
+    l.fade_from_ = l.weight_;
+    l.fade_to_ = weight;
+    l.fade_duration_ = duration;
+}
+
+inline void MotionBlender::CrossFade(size_t from_layer, size_t to_layer, double duration) {
+    FadeLayer(from_layer, 0.0f, duration);
+    FadeLayer(to_layer, 1.0f, duration);
+}
+
+inline bool MotionBlender::IsFading(size_t layer) const {
+    return layers_[layer].fading_;
+}
+
+inline void MotionBlender::Index() {
+    const Model& model = poser_.GetModel();
+    bone_entries_.clear();
+    for(size_t i=0;i<model.GetBoneNum();++i) {
+        for(size_t j=0;j<layers_.size();++j) {
+            BoneEntry entry;
+            entry.bone_ = i;
+            entry.layer_ = j;
+            entry.track_ = layers_[j].motion_->FindBoneTrack(model.GetBone(i).GetName());
+            entry.cursor_ = 0;
+            if(entry.track_!=NULL) {
+                bone_entries_.push_back(entry);
+            }
+        }
+    }
+
+    morph_entries_.clear();
+    for(size_t i=0;i<model.GetMorphNum();++i) {
+        for(size_t j=0;j<layers_.size();++j) {
+            MorphEntry entry;
+            entry.morph_ = i;
+            entry.layer_ = j;
+            entry.track_ = layers_[j].motion_->FindMorphTrack(model.GetMorph(i).GetName());
+            entry.cursor_ = 0;
+            if(entry.track_!=NULL) {
+                morph_entries_.push_back(entry);
+            }
+        }
+    }
+}
+
+inline void MotionBlender::UpdateFades(double time) {
+    for(std::vector<Layer>::iterator i=layers_.begin();i!=layers_.end();++i) {
+        if(!i->fading_) {
+            continue;
+        }
+        if(!i->fade_started_) {
+            i->fade_started_ = true;
+            i->fade_begin_ = time;
+        }
+        double progress = i->fade_duration_>0.0?(time-i->fade_begin_)/i->fade_duration_:1.0;
+        if(progress>=1.0||progress<0.0) {
+            i->weight_ = i->fade_to_;
+            i->fading_ = false;
+        } else {
+            i->weight_ = i->fade_from_+(i->fade_to_-i->fade_from_)*(float)progress;
+        }
     }
 }
 
-inline Poser::BoneImage::BoneImage() : ik_link_(false) {
-    rotation_.q.MakeIdentity();
-    translation_.MakeZero();
+inline void MotionBlender::SeekFrame(size_t frame) {
+    SeekTime((double)frame/MMD_FRAME_RATE);
+}
 
-    morph_rotation_.q.MakeIdentity();
-    morph_translation_.MakeZero();
+inline void MotionBlender::SeekTime(double time) {
+    continuity_.Check(poser_, time*MMD_FRAME_RATE);
+    UpdateFades(time);
+
+    /*
+      Layers are walked top-down: a layer with weight w keeps (1-w) of
+      everything below, so once nothing is left the rest are skipped.
+    */
+    for(size_t begin=0, end=0;begin<morph_entries_.size();begin=end) {
+        size_t morph = morph_entries_[begin].morph_;
+        for(end=begin+1;end<morph_entries_.size()&&morph_entries_[end].morph_==morph;++end);
+
+        float weight = 0.0f;
+        float remained = 1.0f;
+        for(size_t j=end;j>begin&&remained>0.0f;--j) {
+            MorphEntry &entry = morph_entries_[j-1];
+            const Layer &layer = layers_[entry.layer_];
+            float w = math::clamp(layer.weight_, 0.0f, 1.0f);
+            if(w<=0.0f) {
+                continue;
+            }
+            weight += remained*w*Motion::GetMorphPose(*entry.track_, time+layer.time_offset_, entry.cursor_).GetWeight();
+            remained *= 1.0f-w;
+        }
+        poser_.SetMorphPose(morph, Motion::MorphPose(weight));
+    }
 
-    global_offset_matrix_.MakeIdentity();
-    global_offset_matrix_inv_.MakeIdentity();
+    for(size_t begin=0, end=0;begin<bone_entries_.size();begin=end) {
+        size_t bone = bone_entries_[begin].bone_;
+        for(end=begin+1;end<bone_entries_.size()&&bone_entries_[end].bone_==bone;++end);
+
+        /* rotations are summed in the hemisphere of the first one and normalized once */
+        Vector3f translation;
+        translation.MakeZero();
+        Vector4f rotation;
+        rotation.MakeZero();
+        float remained = 1.0f;
+        size_t contributions = 0;
+        for(size_t j=end;j>begin&&remained>0.0f;--j) {
+            BoneEntry &entry = bone_entries_[j-1];
+            const Layer &layer = layers_[entry.layer_];
+            float w = math::clamp(layer.weight_*layer.bone_masks_[bone], 0.0f, 1.0f);
+            if(w<=0.0f) {
+                continue;
+            }
+            Motion::BonePose pose = Motion::GetBonePose(*entry.track_, time+layer.time_offset_, entry.cursor_);
+            if(w==1.0f&&contributions==0) {
+                /* the top layer hides everything */
+                translation = pose.GetTranslation();
+                rotation = pose.GetRotation();
+                remained = 0.0f;
+                ++contributions;
+                break;
+            }
+            float c = remained*w;
+            translation = translation+pose.GetTranslation()*c;
+            if(rotation*pose.GetRotation()<0.0f) {
+                c = -c;
+            }
+            rotation = rotation+pose.GetRotation()*c;
+            remained *= 1.0f-w;
+            ++contributions;
+        }
+        if(remained>0.0f) {
+            Vector4f rest;
+            rest.q.MakeIdentity();
+            rotation = rotation+(rotation*rest<0.0f?-remained:remained)*rest;
+            ++contributions;
+        }
+        if(contributions>1) {
+            rotation = rotation.Normalize();
+        }
+        poser_.SetBonePose(bone, Motion::BonePose(translation, rotation));
+    }
 }
 
-inline Poser::BoneImage::TransformOrder::TransformOrder(const Model &model) : model_(&model) {}
+inline CrowdSampler::CrowdSampler() {}
 
-inline bool Poser::BoneImage::TransformOrder::operator()(size_t a, size_t b) const {
-    if(model_->GetBone(a).GetTransformLevel()<model_->GetBone(b).GetTransformLevel()) {
-        return true;
-    } else if(model_->GetBone(a).GetTransformLevel()>model_->GetBone(b).GetTransformLevel()) {
-        return false;
+inline size_t CrowdSampler::AddInstance(const Motion& motion, Poser& poser) {
+    for(size_t i=0;i<instances_.size();++i) {
+        if(instances_[i].poser_==&poser) {
+            throw exception(std::string("CrowdSampler: the poser already has an instance"));
+        }
+    }
+
+    std::map<const Motion*, size_t>::const_iterator it = group_map_.find(&motion);
+    size_t group;
+    if(it!=group_map_.end()) {
+        group = it->second;
     } else {
-        return a<b;
+        group = groups_.size();
+        groups_.push_back(Group());
+        groups_.back().motion_ = &motion;
+        groups_.back().indexed_num_ = 0;
+        group_map_[&motion] = group;
     }
+
+    Instance instance;
+    instance.poser_ = &poser;
+    instance.group_ = group;
+    instance.slot_ = groups_[group].instances_.size();
+    instance.time_ = 0.0;
+    instances_.push_back(instance);
+    groups_[group].instances_.push_back(instances_.size()-1);
+    return instances_.size()-1;
 }
 
-inline Poser::MaterialImage::MaterialImage(float value) {
-    Init(value);
+inline size_t CrowdSampler::GetInstanceNum() const {
+    return instances_.size();
 }
 
-inline void Poser::MaterialImage::Init(float value) {
-    Vector4f seed;
-    seed.v[0] = seed.v[1] = seed.v[2] = seed.v[3] = shininess_ = edge_size_ = value;
-    diffuse_ = specular_ = ambient_ = edge_color_ = texture_ = sub_texture_ = toon_texture_ = seed;
+inline size_t CrowdSampler::GetGroupNum() const {
+    return groups_.size();
 }
 
-inline MotionPlayer::MotionPlayer(const Motion& motion, Poser& poser) : motion_(motion), poser_(poser) {
-    const Model& model = poser_.GetModel();
-    for(size_t i=0;i<model.GetBoneNum();++i) {
-        const std::wstring &name = model.GetBone(i).GetName();
-        if(motion_.IsBoneRegistered(name)) {
-            bone_map_.push_back(std::make_pair(name, i));
+inline void CrowdSampler::SetTime(size_t instance, double time) {
+    instances_[instance].time_ = time;
+}
+
+inline double CrowdSampler::GetTime(size_t instance) const {
+    return instances_[instance].time_;
+}
+
+inline void CrowdSampler::Index(size_t group_index) {
+    typedef TrackBinding<const Motion::BoneTrack*, const Motion::MorphTrack*> Binding;
+    Group &group = groups_[group_index];
+    size_t instance_num = group.instances_.size();
+    size_t old_instance_num = group.indexed_num_;
+    size_t old_bone_track_num = group.bone_tracks_.size();
+    size_t old_morph_track_num = group.morph_tracks_.size();
+
+    /* names are looked up once per model, instances of one model share the result */
+    std::map<const Model*, Binding> bindings;
+    std::vector<const Binding*> instance_bindings(instance_num);
+    for(size_t k=0;k<instance_num;++k) {
+        const Model &model = instances_[group.instances_[k]].poser_->GetModel();
+        std::map<const Model*, Binding>::iterator it = bindings.find(&model);
+        if(it==bindings.end()) {
+            it = bindings.insert(std::make_pair(&model, Binding())).first;
+            it->second.Bind(*group.motion_, model);
         }
+        instance_bindings[k] = &it->second;
     }
 
-    for(size_t i=0;i<model.GetMorphNum();++i) {
-        const std::wstring &name = model.GetMorph(i).GetName();
-        if(motion_.IsMorphRegistered(name)) {
-            morph_map_.push_back(std::make_pair(name, i));
+    /* tracks already indexed keep their place, so their cursors can be carried over */
+    std::map<const Motion::BoneTrack*, size_t> bone_track_map;
+    std::map<const Motion::MorphTrack*, size_t> morph_track_map;
+    for(size_t j=0;j<old_bone_track_num;++j) {
+        bone_track_map[group.bone_tracks_[j]] = j;
+    }
+    for(size_t j=0;j<old_morph_track_num;++j) {
+        morph_track_map[group.morph_tracks_[j]] = j;
+    }
+    for(std::map<const Model*, Binding>::const_iterator it=bindings.begin();it!=bindings.end();++it) {
+        const Binding &binding = it->second;
+        for(size_t i=0;i<binding.bones_.size();++i) {
+            if(bone_track_map.insert(std::make_pair(binding.bones_[i].first, group.bone_tracks_.size())).second) {
+                group.bone_tracks_.push_back(binding.bones_[i].first);
+            }
+        }
+        for(size_t i=0;i<binding.morphs_.size();++i) {
+            if(morph_track_map.insert(std::make_pair(binding.morphs_[i].first, group.morph_tracks_.size())).second) {
+                group.morph_tracks_.push_back(binding.morphs_[i].first);
+            }
+        }
+    }
+
+    std::vector<size_t> old_bone_cursors;
+    std::vector<size_t> old_morph_cursors;
+    old_bone_cursors.swap(group.bone_cursors_);
+    old_morph_cursors.swap(group.morph_cursors_);
+
+    size_t bone_entry_num = group.bone_tracks_.size()*instance_num;
+    group.bones_.assign(bone_entry_num, nil);
+    group.bone_cursors_.assign(bone_entry_num, 0);
+    group.translations_.resize(bone_entry_num);
+    group.rotations_.resize(bone_entry_num);
+
+    size_t morph_entry_num = group.morph_tracks_.size()*instance_num;
+    group.morphs_.assign(morph_entry_num, nil);
+    group.morph_cursors_.assign(morph_entry_num, 0);
+    group.weights_.resize(morph_entry_num);
+
+    for(size_t k=0;k<instance_num;++k) {
+        const Binding &binding = *instance_bindings[k];
+        for(size_t i=0;i<binding.bones_.size();++i) {
+            group.bones_[bone_track_map[binding.bones_[i].first]*instance_num+k] = binding.bones_[i].second;
+        }
+        for(size_t i=0;i<binding.morphs_.size();++i) {
+            group.morphs_[morph_track_map[binding.morphs_[i].first]*instance_num+k] = binding.morphs_[i].second;
+        }
+    }
+
+    for(size_t j=0;j<old_bone_track_num;++j) {
+        for(size_t k=0;k<old_instance_num;++k) {
+            group.bone_cursors_[j*instance_num+k] = old_bone_cursors[j*old_instance_num+k];
+        }
+    }
+    for(size_t j=0;j<old_morph_track_num;++j) {
+        for(size_t k=0;k<old_instance_num;++k) {
+            group.morph_cursors_[j*instance_num+k] = old_morph_cursors[j*old_instance_num+k];
         }
     }
+    group.indexed_num_ = instance_num;
 }
 
-inline void MotionPlayer::SeekFrame(size_t frame) {
-    for(std::vector<std::pair<std::wstring, size_t>>::iterator i=morph_map_.begin();i!=morph_map_.end();++i) {
-        poser_.SetMorphPose(i->second, motion_.GetMorphPose(i->first, frame));
+inline void CrowdSampler::RebuildJobs() {
+    jobs_.clear();
+    for(size_t i=0;i<groups_.size();++i) {
+        Job job;
+        job.group_ = i;
+        job.morph_ = false;
+        for(job.track_=0;job.track_<groups_[i].bone_tracks_.size();++job.track_) {
+            jobs_.push_back(job);
+        }
+        job.morph_ = true;
+        for(job.track_=0;job.track_<groups_[i].morph_tracks_.size();++job.track_) {
+            jobs_.push_back(job);
+        }
     }
-    for(std::vector<std::pair<std::wstring, size_t>>::iterator i=bone_map_.begin();i!=bone_map_.end();++i) {
-        poser_.SetBonePose(i->second, motion_.GetBonePose(i->first, frame));
+}
+
+inline void CrowdSampler::SampleTrack(const Job& job) {
+    Group &group = groups_[job.group_];
+    size_t instance_num = group.instances_.size();
+    size_t begin = job.track_*instance_num;
+    if(job.morph_) {
+        const Motion::MorphTrack &track = *group.morph_tracks_[job.track_];
+        for(size_t k=0;k<instance_num;++k) {
+            if(group.morphs_[begin+k]!=nil) {
+                double time = instances_[group.instances_[k]].time_;
+                group.weights_[begin+k] = Motion::GetMorphPose(track, time, group.morph_cursors_[begin+k]).GetWeight();
+            }
+        }
+    } else {
+        const Motion::BoneTrack &track = *group.bone_tracks_[job.track_];
+        for(size_t k=0;k<instance_num;++k) {
+            if(group.bones_[begin+k]!=nil) {
+                double time = instances_[group.instances_[k]].time_;
+                Motion::BonePose pose = Motion::GetBonePose(track, time, group.bone_cursors_[begin+k]);
+                group.translations_[begin+k] = pose.GetTranslation();
+                group.rotations_[begin+k] = pose.GetRotation();
+            }
+        }
     }
 }
 
-inline void MotionPlayer::SeekTime(double time) {
-    for(std::vector<std::pair<std::wstring, size_t>>::iterator i=morph_map_.begin();i!=morph_map_.end();++i) {
-        poser_.SetMorphPose(i->second, motion_.GetMorphPose(i->first, time));
+inline void CrowdSampler::SetPoses(size_t instance_index) {
+    Instance &instance = instances_[instance_index];
+    const Group &group = groups_[instance.group_];
+    size_t instance_num = group.instances_.size();
+
+    instance.continuity_.Check(*instance.poser_, instance.time_*group.motion_->GetFrameRate());
+
+    for(size_t j=0, e=instance.slot_;j<group.morph_tracks_.size();++j, e+=instance_num) {
+        if(group.morphs_[e]!=nil) {
+            instance.poser_->SetMorphPose(group.morphs_[e], Motion::MorphPose(group.weights_[e]));
+        }
     }
-    for(std::vector<std::pair<std::wstring, size_t>>::iterator i=bone_map_.begin();i!=bone_map_.end();++i) {
-        poser_.SetBonePose(i->second, motion_.GetBonePose(i->first, time));
+    for(size_t j=0, e=instance.slot_;j<group.bone_tracks_.size();++j, e+=instance_num) {
+        if(group.bones_[e]!=nil) {
+            instance.poser_->SetBonePose(group.bones_[e], Motion::BonePose(group.translations_[e], group.rotations_[e]));
+        }
+    }
+}
+
+inline void CrowdSampler::Sample() {
+    bool indexed = false;
+    for(size_t i=0;i<groups_.size();++i) {
+        if(groups_[i].indexed_num_!=groups_[i].instances_.size()) {
+            Index(i);
+            indexed = true;
+        }
+    }
+    if(indexed) {
+        RebuildJobs();
+    }
+
+    int job_num = (int)jobs_.size();
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 4)
+#endif
+    for(int i=0;i<job_num;++i) {
+        SampleTrack(jobs_[i]);
+    }
+
+    int instance_num = (int)instances_.size();
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i=0;i<instance_num;++i) {
+        SetPoses((size_t)i);
+    }
+}
+
+inline void CrowdSampler::Advance(double delta) {
+    for(size_t i=0;i<instances_.size();++i) {
+        instances_[i].time_ += delta;
     }
+    Sample();
 }
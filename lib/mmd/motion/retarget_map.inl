@@ -0,0 +1,121 @@
+
+/**
+             Copyright itsuhane@gmail.com, 2012.
+  Distributed under the Boost Software License, Version 1.0.
+      (See accompanying file LICENSE_1_0.txt or copy at
+            http://www.boost.org/LICENSE_1_0.txt)
+**/
+
+#ifndef __RETARGET_MAP_HXX_9C2E47A1B05D38F6E4A7C3D1920B6F85_INCLUDED__
+#define __RETARGET_MAP_HXX_9C2E47A1B05D38F6E4A7C3D1920B6F85_INCLUDED__
+
+namespace mmd {
+
+    /**
+      Binds the tracks of a Motion to the bones and morphs of a Model it
+      was not made for. A track binds to the bone of the same name, or
+      failing that to one whose name is the same after NormalizeName()
+      and alias resolution against the bone's Japanese and English names.
+      Width and kana variants of a name, kanji spellings of the standard
+      bones, and English names such as "elbow_L" or "left elbow" all
+      meet. Tracks that bind to nothing are listed by
+      GetUnboundBoneTracks() instead of being dropped silently.
+
+      Given the model the motion was made for, the rotations are corrected
+      for the difference of the rest poses. With C the rotation from a
+      bone's rest direction in the model to the one in the source model,
+      a rotation q becomes C(parent)^-1*q*C(bone), which keeps an arm
+      motion made on an A-pose model pointing the same way on a T-pose
+      one.
+
+      The map is built once; MotionPlayer then plays through it with one
+      index lookup and, when there is a correction, two quaternion
+      products per bone.
+    **/
+    class RetargetMap {
+    public:
+        RetargetMap(const Motion &motion, const Model &model);
+        RetargetMap(const Motion &motion, const Model &model, const Model &source_model);
+
+        const Motion &GetMotion() const;
+
+        size_t GetBoneBindingNum() const;
+        const Motion::BoneTrack *GetBoneTrack(size_t binding) const;
+        size_t GetBoneIndex(size_t binding) const;
+
+        size_t GetMorphBindingNum() const;
+        const Motion::MorphTrack *GetMorphTrack(size_t binding) const;
+        size_t GetMorphIndex(size_t binding) const;
+
+        const std::vector<std::wstring> &GetUnboundBoneTracks() const;
+        const std::vector<std::wstring> &GetUnboundMorphTracks() const;
+
+        /** Scales bone translations, for models of a different size. **/
+        void SetTranslationScale(float scale);
+        float GetTranslationScale() const;
+
+        bool IsCorrected(size_t binding) const;
+        Motion::BonePose Correct(size_t binding, const Motion::BonePose &pose) const;
+
+        /**
+          Folds full-width ASCII and half-width katakana to their common
+          forms, katakana to hiragana and ASCII to lower case, and drops
+          spaces, '_' and '.'.
+        **/
+        static std::wstring NormalizeName(const std::wstring &name);
+
+    private:
+        struct BoneBinding {
+            const Motion::BoneTrack *track_;
+            size_t bone_;
+            bool corrected_;
+            /* rest correction of the parent, inverted, and of the bone */
+            Quaternionf pre_;
+            Quaternionf post_;
+        };
+
+        struct MorphBinding {
+            const Motion::MorphTrack *track_;
+            size_t morph_;
+        };
+
+        struct Alias {
+            const wchar_t *name_;
+            const wchar_t *alias_;
+        };
+
+        typedef std::map<std::wstring, size_t> NameMap;
+
+        void Bind(const Model &model, const Model *source_model);
+        /* tracks[i] is the track bound to target i, or nil */
+        static void BindNames(
+            const std::vector<std::wstring> &track_names, const NameMap &exact_names,
+            const NameMap &keyed_names, bool use_aliases, size_t target_num,
+            std::vector<size_t> &tracks, std::vector<std::wstring> &unbound_tracks
+        );
+
+        static const std::map<std::wstring, std::wstring> &GetAliases();
+        static std::map<std::wstring, std::wstring> BuildAliases();
+        static std::wstring GetKey(const std::wstring &name);
+        static void AddName(NameMap &names, const std::wstring &name, size_t index);
+        static size_t FindName(
+            const NameMap &exact_names, const NameMap &keyed_names,
+            const std::wstring &name
+        );
+        static Vector3f GetRestDirection(const Model &model, size_t bone);
+
+        const Motion &motion_;
+        float translation_scale_;
+
+        std::vector<BoneBinding> bone_bindings_;
+        std::vector<MorphBinding> morph_bindings_;
+
+        std::vector<std::wstring> unbound_bone_tracks_;
+        std::vector<std::wstring> unbound_morph_tracks_;
+    };
+
+#include "retarget_map_impl.inl"
+
+} /* End of namespace mmd */
+
+#endif /* __RETARGET_MAP_HXX_9C2E47A1B05D38F6E4A7C3D1920B6F85_INCLUDED__ */
@@ -0,0 +1,400 @@
+
+/**
+             Copyright itsuhane@gmail.com, 2012.
+  Distributed under the Boost Software License, Version 1.0.
+      (See accompanying file LICENSE_1_0.txt or copy at
+            http://www.boost.org/LICENSE_1_0.txt)
+**/
+
+inline RetargetMap::RetargetMap(const Motion &motion, const Model &model)
+  : motion_(motion), translation_scale_(1.0f) {
+    Bind(model, NULL);
+}
+
+inline RetargetMap::RetargetMap(const Motion &motion, const Model &model, const Model &source_model)
+  : motion_(motion), translation_scale_(1.0f) {
+    Bind(model, &source_model);
+}
+
+inline const Motion &RetargetMap::GetMotion() const {
+    return motion_;
+}
+
+inline size_t RetargetMap::GetBoneBindingNum() const {
+    return bone_bindings_.size();
+}
+
+inline const Motion::BoneTrack *RetargetMap::GetBoneTrack(size_t binding) const {
+    return bone_bindings_[binding].track_;
+}
+
+inline size_t RetargetMap::GetBoneIndex(size_t binding) const {
+    return bone_bindings_[binding].bone_;
+}
+
+inline size_t RetargetMap::GetMorphBindingNum() const {
+    return morph_bindings_.size();
+}
+
+inline const Motion::MorphTrack *RetargetMap::GetMorphTrack(size_t binding) const {
+    return morph_bindings_[binding].track_;
+}
+
+inline size_t RetargetMap::GetMorphIndex(size_t binding) const {
+    return morph_bindings_[binding].morph_;
+}
+
+inline const std::vector<std::wstring> &RetargetMap::GetUnboundBoneTracks() const {
+    return unbound_bone_tracks_;
+}
+
+inline const std::vector<std::wstring> &RetargetMap::GetUnboundMorphTracks() const {
+    return unbound_morph_tracks_;
+}
+
+inline void RetargetMap::SetTranslationScale(float scale) {
+    translation_scale_ = scale;
+}
+
+inline float RetargetMap::GetTranslationScale() const {
+    return translation_scale_;
+}
+
+inline bool RetargetMap::IsCorrected(size_t binding) const {
+    return bone_bindings_[binding].corrected_||translation_scale_!=1.0f;
+}
+
+inline Motion::BonePose RetargetMap::Correct(size_t binding, const Motion::BonePose &pose) const {
+    const BoneBinding &b = bone_bindings_[binding];
+    if(!b.corrected_) {
+        return Motion::BonePose(pose.GetTranslation()*translation_scale_, pose.GetRotation());
+    }
+    Vector4f rotation;
+    rotation.q = b.pre_*pose.GetRotation().q*b.post_;
+    return Motion::BonePose(
+        rotate(pose.GetTranslation(), b.pre_.ToRotateMatrix())*translation_scale_, rotation
+    );
+}
+
+inline std::wstring RetargetMap::NormalizeName(const std::wstring &name) {
+    /* U+FF61 to U+FF9F */
+    static const wchar_t half_width_kana[] = {
+        0x3002, 0x300C, 0x300D, 0x3001, 0x30FB, 0x30F2, 0x30A1, 0x30A3,
+        0x30A5, 0x30A7, 0x30A9, 0x30E3, 0x30E5, 0x30E7, 0x30C3, 0x30FC,
+        0x30A2, 0x30A4, 0x30A6, 0x30A8, 0x30AA, 0x30AB, 0x30AD, 0x30AF,
+        0x30B1, 0x30B3, 0x30B5, 0x30B7, 0x30B9, 0x30BB, 0x30BD, 0x30BF,
+        0x30C1, 0x30C4, 0x30C6, 0x30C8, 0x30CA, 0x30CB, 0x30CC, 0x30CD,
+        0x30CE, 0x30CF, 0x30D2, 0x30D5, 0x30D8, 0x30DB, 0x30DE, 0x30DF,
+        0x30E0, 0x30E1, 0x30E2, 0x30E4, 0x30E6, 0x30E8, 0x30E9, 0x30EA,
+        0x30EB, 0x30EC, 0x30ED, 0x30EF, 0x30F3, 0x309B, 0x309C
+    };
+
+    std::wstring result;
+    result.reserve(name.size());
+    for(size_t i=0;i<name.size();++i) {
+        wchar_t c = name[i];
+        if(c>=0xFF61&&c<=0xFF9F) {
+            c = half_width_kana[c-0xFF61];
+        } else if(c>=0xFF01&&c<=0xFF5E) {
+            c = wchar_t(c-0xFEE0);
+        } else if(c==0x3000) {
+            c = L' ';
+        }
+
+        if(c==L' '||c==L'\t'||c==L'_'||c==L'.'||c==0xFEFF) {
+            continue;
+        } else if(c>=L'A'&&c<=L'Z') {
+            c = wchar_t(c-L'A'+L'a');
+        } else if(c==0x309B||c==0x3099||c==0x309C||c==0x309A) {
+            /* a separate (semi-)voiced sound mark joins the kana before it */
+            if(!result.empty()) {
+                wchar_t &k = result[result.size()-1];
+                bool semi = (c==0x309C||c==0x309A);
+                bool ha_row = (k>=0x306F&&k<=0x307B&&(k-0x306F)%3==0);
+                if(!semi&&k==0x3046) {
+                    k = 0x3094;
+                    continue;
+                } else if(!semi&&((k>=0x304B&&k<=0x3062&&k%2==1)||(k>=0x3064&&k<=0x3069&&k%2==0)||ha_row)) {
+                    k = wchar_t(k+1);
+                    continue;
+                } else if(semi&&ha_row) {
+                    k = wchar_t(k+2);
+                    continue;
+                }
+            }
+        }
+
+        if(c>=0x30A1&&c<=0x30F6) {
+            c = wchar_t(c-0x60);
+        }
+        result.push_back(c);
+    }
+    return result;
+}
+
+inline const std::map<std::wstring, std::wstring> &RetargetMap::GetAliases() {
+    /* initialized once, thread-safely */
+    static const std::map<std::wstring, std::wstring> aliases = BuildAliases();
+    return aliases;
+}
+
+inline std::map<std::wstring, std::wstring> RetargetMap::BuildAliases() {
+    static const Alias unsided[] = {
+        { L"\x5168\x3066\x306E\x89AA", L"master" },
+        { L"\x5168\x3066\x306E\x89AA", L"mother" },
+        { L"\x30BB\x30F3\x30BF\x30FC", L"center" },
+        { L"\x30BB\x30F3\x30BF\x30FC", L"centre" },
+        { L"\x30B0\x30EB\x30FC\x30D6", L"groove" },
+        { L"\x8170", L"waist" },
+        { L"\x4E0A\x534A\x8EAB", L"upper body" },
+        { L"\x4E0A\x534A\x8EAB" L"2", L"upper body2" },
+        { L"\x4E0B\x534A\x8EAB", L"lower body" },
+        { L"\x9996", L"neck" },
+        { L"\x982D", L"head" },
+        { L"\x4E21\x76EE", L"eyes" }
+    };
+
+    /* prefixed by the side in Japanese, suffixed by _L or prefixed by "left" in English */
+    static const Alias sided[] = {
+        { L"\x80A9", L"shoulder" },
+        { L"\x8155", L"arm" },
+        { L"\x3072\x3058", L"elbow" },
+        { L"\x3072\x3058", L"\x8098" },
+        { L"\x624B\x9996", L"wrist" },
+        { L"\x8DB3", L"leg" },
+        { L"\x3072\x3056", L"knee" },
+        { L"\x3072\x3056", L"\x819D" },
+        { L"\x8DB3\x9996", L"ankle" },
+        { L"\x3064\x307E\x5148", L"toe" },
+        { L"\x8DB3" L"IK", L"leg IK" },
+        { L"\x3064\x307E\x5148" L"IK", L"toe IK" },
+        { L"\x76EE", L"eye" }
+    };
+
+    /* sided too, numbered 0 to 3 */
+    static const Alias fingers[] = {
+        { L"\x89AA\x6307", L"thumb" },
+        { L"\x4EBA\x6307", L"fore" },
+        { L"\x4EBA\x6307", L"index" },
+        { L"\x4E2D\x6307", L"middle" },
+        { L"\x85AC\x6307", L"third" },
+        { L"\x85AC\x6307", L"ring" },
+        { L"\x5C0F\x6307", L"little" },
+        { L"\x5C0F\x6307", L"pinky" }
+    };
+
+    static const wchar_t *side_names[2][3] = {
+        { L"\x5DE6", L"_L", L"left " },
+        { L"\x53F3", L"_R", L"right " }
+    };
+
+    std::map<std::wstring, std::wstring> aliases;
+    for(size_t i=0;i<sizeof(unsided)/sizeof(unsided[0]);++i) {
+        aliases[NormalizeName(unsided[i].alias_)] = NormalizeName(unsided[i].name_);
+    }
+
+    std::vector<Alias> sided_aliases(sided, sided+sizeof(sided)/sizeof(sided[0]));
+    std::vector<std::wstring> numbered;
+    for(size_t i=0;i<sizeof(fingers)/sizeof(fingers[0]);++i) {
+        for(wchar_t n=L'0';n<=L'3';++n) {
+            numbered.push_back(std::wstring(fingers[i].name_)+n);
+            numbered.push_back(std::wstring(fingers[i].alias_)+n);
+        }
+    }
+    for(size_t i=0;i<numbered.size();i+=2) {
+        Alias alias = { numbered[i].c_str(), numbered[i+1].c_str() };
+        sided_aliases.push_back(alias);
+    }
+
+    for(size_t side=0;side<2;++side) {
+        for(size_t i=0;i<sided_aliases.size();++i) {
+            std::wstring name = NormalizeName(side_names[side][0]+std::wstring(sided_aliases[i].name_));
+            std::wstring alias = sided_aliases[i].alias_;
+            if(alias[0]<0x80) {
+                aliases[NormalizeName(alias+side_names[side][1])] = name;
+                aliases[NormalizeName(side_names[side][2]+alias)] = name;
+            } else {
+                aliases[NormalizeName(side_names[side][0]+alias)] = name;
+            }
+        }
+    }
+    return aliases;
+}
+
+inline std::wstring RetargetMap::GetKey(const std::wstring &name) {
+    std::wstring key = NormalizeName(name);
+    const std::map<std::wstring, std::wstring> &aliases = GetAliases();
+    std::map<std::wstring, std::wstring>::const_iterator i = aliases.find(key);
+    return i!=aliases.end()?i->second:key;
+}
+
+inline void RetargetMap::AddName(NameMap &names, const std::wstring &name, size_t index) {
+    /* the first of several equal names wins */
+    if(!name.empty()) {
+        names.insert(std::make_pair(name, index));
+    }
+}
+
+inline size_t RetargetMap::FindName(const NameMap &exact_names, const NameMap &keyed_names, const std::wstring &name) {
+    NameMap::const_iterator i = exact_names.find(name);
+    if(i!=exact_names.end()) {
+        return i->second;
+    }
+    i = keyed_names.find(GetKey(name));
+    return i!=keyed_names.end()?i->second:nil;
+}
+
+inline void RetargetMap::BindNames(
+    const std::vector<std::wstring> &track_names, const NameMap &exact_names,
+    const NameMap &keyed_names, bool use_aliases, size_t target_num,
+    std::vector<size_t> &tracks, std::vector<std::wstring> &unbound_tracks
+) {
+    tracks.assign(target_num, nil);
+
+    /* exact names first, so a normalized name never takes a target from an exact one */
+    std::vector<bool> bound(track_names.size(), false);
+    for(size_t i=0;i<track_names.size();++i) {
+        NameMap::const_iterator j = exact_names.find(track_names[i]);
+        if(j!=exact_names.end()&&tracks[j->second]==nil) {
+            tracks[j->second] = i;
+            bound[i] = true;
+        }
+    }
+    for(size_t i=0;i<track_names.size();++i) {
+        if(bound[i]) {
+            continue;
+        }
+        NameMap::const_iterator j = keyed_names.find(use_aliases?GetKey(track_names[i]):NormalizeName(track_names[i]));
+        if(j!=keyed_names.end()&&tracks[j->second]==nil) {
+            tracks[j->second] = i;
+        } else {
+            unbound_tracks.push_back(track_names[i]);
+        }
+    }
+}
+
+inline Vector3f RetargetMap::GetRestDirection(const Model &model, size_t bone) {
+    const Model::Bone &b = model.GetBone(bone);
+    Vector3f direction;
+    if(b.IsChildUseID()) {
+        size_t child = b.GetChildIndex();
+        /* PMD bones without a tail point at bone 0 */
+        if(child==nil||child==0||child==bone||child>=model.GetBoneNum()) {
+            return Vector3f::Zero();
+        }
+        direction = model.GetBone(child).GetPosition()-b.GetPosition();
+    } else {
+        direction = b.GetChildOffset();
+    }
+    if(direction.Norm()<1e-4f) {
+        return Vector3f::Zero();
+    }
+    return direction.Normalize();
+}
+
+inline void RetargetMap::Bind(const Model &model, const Model *source_model) {
+    size_t bone_num = model.GetBoneNum();
+    NameMap exact_bones, keyed_bones;
+    for(size_t i=0;i<bone_num;++i) {
+        AddName(exact_bones, model.GetBone(i).GetName(), i);
+    }
+    for(size_t i=0;i<bone_num;++i) {
+        AddName(keyed_bones, GetKey(model.GetBone(i).GetName()), i);
+    }
+    for(size_t i=0;i<bone_num;++i) {
+        AddName(keyed_bones, GetKey(model.GetBone(i).GetNameEn()), i);
+    }
+
+    std::vector<std::wstring> track_names = motion_.GetBoneNames();
+    std::vector<size_t> bone_tracks;
+    BindNames(track_names, exact_bones, keyed_bones, true, bone_num, bone_tracks, unbound_bone_tracks_);
+
+    /* rotation from each bone's rest direction to its counterpart's in the source model */
+    std::vector<Quaternionf> rest_corrections(bone_num, Quaternionf::Identity());
+    if(source_model!=NULL) {
+        NameMap exact_sources, keyed_sources;
+        for(size_t i=0;i<source_model->GetBoneNum();++i) {
+            AddName(exact_sources, source_model->GetBone(i).GetName(), i);
+        }
+        for(size_t i=0;i<source_model->GetBoneNum();++i) {
+            AddName(keyed_sources, GetKey(source_model->GetBone(i).GetName()), i);
+        }
+        for(size_t i=0;i<source_model->GetBoneNum();++i) {
+            AddName(keyed_sources, GetKey(source_model->GetBone(i).GetNameEn()), i);
+        }
+        for(size_t i=0;i<bone_num;++i) {
+            const Model::Bone &bone = model.GetBone(i);
+            size_t source = FindName(exact_sources, keyed_sources, bone.GetName());
+            if(source==nil) {
+                source = FindName(exact_sources, keyed_sources, bone.GetNameEn());
+            }
+            if(source==nil) {
+                continue;
+            }
+            Vector3f from = GetRestDirection(model, i);
+            Vector3f to = GetRestDirection(*source_model, source);
+            if(from==Vector3f::Zero()||to==Vector3f::Zero()) {
+                continue;
+            }
+            float cosine = from*to;
+            if(cosine>0.99999f) {
+                continue;
+            }
+            Vector3f axis;
+            axis.p.x = from.p.y*to.p.z-from.p.z*to.p.y;
+            axis.p.y = from.p.z*to.p.x-from.p.x*to.p.z;
+            axis.p.z = from.p.x*to.p.y-from.p.y*to.p.x;
+            if(axis.Norm()<1e-6f) {
+                /* opposite directions, turn about any perpendicular axis */
+                axis.p.x = from.p.y;
+                axis.p.y = -from.p.x;
+                axis.p.z = 0.0f;
+                if(axis.Norm()<1e-6f) {
+                    axis.p.x = 0.0f;
+                    axis.p.y = from.p.z;
+                    axis.p.z = -from.p.y;
+                }
+            }
+            rest_corrections[i] = AxisToQuaternion(axis.Normalize(), std::acos(std::max(-1.0f, cosine)));
+        }
+    }
+
+    for(size_t i=0;i<bone_num;++i) {
+        if(bone_tracks[i]==nil) {
+            continue;
+        }
+        BoneBinding binding;
+        binding.track_ = motion_.FindBoneTrack(track_names[bone_tracks[i]]);
+        binding.bone_ = i;
+        size_t parent = model.GetBone(i).GetParentIndex();
+        binding.pre_ = (parent!=nil&&parent<bone_num)?rest_corrections[parent].Inverse():Quaternionf::Identity();
+        binding.post_ = rest_corrections[i];
+        binding.corrected_ = (binding.pre_!=Quaternionf::Identity()||binding.post_!=Quaternionf::Identity());
+        bone_bindings_.push_back(binding);
+    }
+
+    size_t morph_num = model.GetMorphNum();
+    NameMap exact_morphs, keyed_morphs;
+    for(size_t i=0;i<morph_num;++i) {
+        AddName(exact_morphs, model.GetMorph(i).GetName(), i);
+    }
+    for(size_t i=0;i<morph_num;++i) {
+        AddName(keyed_morphs, NormalizeName(model.GetMorph(i).GetName()), i);
+    }
+    for(size_t i=0;i<morph_num;++i) {
+        AddName(keyed_morphs, NormalizeName(model.GetMorph(i).GetNameEn()), i);
+    }
+
+    std::vector<std::wstring> morph_names = motion_.GetMorphNames();
+    std::vector<size_t> morph_tracks;
+    BindNames(morph_names, exact_morphs, keyed_morphs, false, morph_num, morph_tracks, unbound_morph_tracks_);
+    for(size_t i=0;i<morph_num;++i) {
+        if(morph_tracks[i]==nil) {
+            continue;
+        }
+        MorphBinding binding;
+        binding.track_ = motion_.FindMorphTrack(morph_names[morph_tracks[i]]);
+        binding.morph_ = i;
+        morph_bindings_.push_back(binding);
+    }
+}
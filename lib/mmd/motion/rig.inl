@@ -0,0 +1,351 @@
+
+/**
+             Copyright itsuhane@gmail.com, 2012.
+  Distributed under the Boost Software License, Version 1.0.
+      (See accompanying file LICENSE_1_0.txt or copy at
+            http://www.boost.org/LICENSE_1_0.txt)
+**/
+
+#ifndef __RIG_HXX_F2C08EFD8EEF64C22D33529D940833D6_INCLUDED__
+#define __RIG_HXX_F2C08EFD8EEF64C22D33529D940833D6_INCLUDED__
+
+namespace mmd {
+
+    class Rig;
+
+    /**
+      Everything that changes while posing one instance of a model: the
+      bone and morph poses, the intermediate bone transforms and the
+      resulting images. A PoseState only makes sense with the Rig it was
+      created from. It is copyable, and any number of states may be
+      evaluated against one Rig concurrently, one thread per state.
+    **/
+    class PoseState {
+        friend class Rig;
+        friend class PhysicsReactor;
+    public:
+        struct PoseImage {
+            std::vector<Vector3f> coordinates;
+            std::vector<Vector3f> normals;
+            std::vector<Vector2f> uv_coords;
+            std::vector<std::vector<Vector4f>> extra_uv_coords;
+
+            /**
+              Changes since the last ClearPoseImageDirty(): UVs of vertices in
+              [uv_dirty_begin, uv_dirty_end) and the material images of the
+              parts in dirty_parts. Everything starts out dirty.
+            **/
+            size_t uv_dirty_begin;
+            size_t uv_dirty_end;
+            std::vector<size_t> dirty_parts;
+        } pose_image;
+
+        class MaterialImage {
+        public:
+            MaterialImage(float value);
+
+            void Init(float value);
+
+            const Vector4f &GetDiffuse() const;
+            void SetDiffuse(const Vector3f &diffuse);
+            void SetDiffuse(const Vector4f &diffuse);
+
+            const Vector4f &GetSpecular() const;
+            void SetSpecular(const Vector3f &specular);
+            void SetSpecular(const Vector4f &specular);
+
+            const Vector4f &GetAmbient() const;
+            void SetAmbient(const Vector3f &ambient);
+            void SetAmbient(const Vector4f &ambient);
+
+            float GetShininess() const;
+            void SetShininess(float shininess);
+
+            const Vector4f &GetEdgeColor() const;
+            void SetEdgeColor(const Vector3f &edge_color);
+            void SetEdgeColor(const Vector4f &edge_color);
+
+            float GetEdgeSize() const;
+            void SetEdgeSize(float edge_size);
+
+            const Vector4f &GetTexture() const;
+            void SetTexture(const Vector3f &texture);
+            void SetTexture(const Vector4f &texture);
+
+            const Vector4f &GetSubTexture() const;
+            void SetSubTexture(const Vector3f &sub_texture);
+            void SetSubTexture(const Vector4f &sub_texture);
+
+            const Vector4f &GetToonTexture() const;
+            void SetToonTexture(const Vector3f &toon_texture);
+            void SetToonTexture(const Vector4f &toon_texture);
+
+        private:
+            Vector4f diffuse_;
+            Vector4f specular_;
+            Vector4f ambient_;
+            float shininess_;
+            Vector4f edge_color_;
+            float edge_size_;
+            Vector4f texture_;
+            Vector4f sub_texture_;
+            Vector4f toon_texture_;
+        };
+
+        /**
+          Sizes the state for the rig and poses it at rest (ResetPosing()
+          followed by Deform()).
+        **/
+        PoseState(const Rig &rig);
+
+        void SetBonePose(size_t index, const Motion::BonePose &bone_pose);
+        void SetMorphPose(size_t index, const Motion::MorphPose &morph_pose);
+
+        const MaterialImage &GetMaterialMulImage(size_t index) const;
+        const MaterialImage &GetMaterialAddImage(size_t index) const;
+        void ClearPoseImageDirty();
+
+        /**
+          IK warm start seeds every IK chain with the rotations it converged
+          to on the previous frame instead of identity. The seed is dropped
+          when the IK bone moved farther than the threshold since the last
+          solve, or after ResetIKWarmStart() (e.g. on a seek). While enabled,
+          CCD also stops early once the residual is within the tolerance or
+          no longer improves by more than it.
+        **/
+        void SetIKWarmStart(bool warm_start);
+        bool IsIKWarmStart() const;
+        void SetIKWarmStartThreshold(float distance);
+        float GetIKWarmStartThreshold() const;
+        void SetIKWarmStartTolerance(float distance);
+        float GetIKWarmStartTolerance() const;
+        void ResetIKWarmStart();
+
+        /** Statistics of the last solve of an IK chain (see Rig::GetIKChainIndex). **/
+        size_t GetIKIterationNum(size_t chain_index) const;
+        float GetIKError(size_t chain_index) const;
+
+    private:
+
+        struct BoneImage {
+            BoneImage();
+
+            Vector4f rotation_;
+            Vector3f translation_;
+
+            Vector4f morph_rotation_;
+            Vector3f morph_translation_;
+
+            Vector4f pre_ik_rotation_;
+            Vector4f ik_rotation_;
+
+            Vector4f total_rotation_;
+            Vector3f total_translation_;
+
+            Matrix4f local_matrix_;
+
+            Matrix4f skinning_matrix_;
+        };
+
+        struct IKImage {
+            IKImage();
+
+            bool warm_valid_;
+            Vector3f warm_position_;
+            size_t iteration_num_;
+            float error_;
+        };
+
+        std::vector<Vector3f> vertex_images_;
+        std::vector<bool> vertex_displaced_;
+        std::vector<size_t> displaced_vertices_;
+        std::vector<BoneImage> bone_images_;
+        std::vector<IKImage> ik_images_;
+        std::vector<Vector4f> ik_warm_rotations_;
+        /* FABRIK scratch, sized for the longest chain */
+        std::vector<Vector3f> ik_joints_;
+        std::vector<float> ik_lengths_;
+        std::vector<MaterialImage> material_mul_images_;
+        std::vector<MaterialImage> material_add_images_;
+
+        std::vector<float> morph_rates_;
+        std::vector<float> leaf_morph_rates_;
+        std::vector<float> applied_morph_rates_;
+        std::vector<bool> morph_displaced_;
+
+        struct UVImage {
+            std::vector<Vector4f> offsets_;
+            std::vector<bool> displaced_;
+            std::vector<size_t> displaced_vertices_;
+        };
+        std::vector<UVImage> uv_images_;
+
+        std::vector<bool> part_dirty_;
+        /* material morph scratch, reused every frame */
+        std::vector<size_t> changed_parts_;
+
+        bool ik_warm_start_;
+        float ik_warm_start_threshold_;
+        float ik_warm_start_tolerance_;
+    };
+
+    /**
+      The immutable part of posing a model: bone hierarchy, append and IK
+      definitions, offsets, the transform schedule and the flattened morph
+      tables. All evaluation is const and only writes to the PoseState it
+      is given, so one Rig can pose many states in parallel. Choosing the
+      IK solvers is configuration and must not race with evaluation.
+    **/
+    class Rig {
+        friend class PoseState;
+    public:
+        enum IKSolverType {
+            IK_SOLVER_CCD, IK_SOLVER_TWO_BONE, IK_SOLVER_FABRIK, IK_SOLVER_AUTO
+        };
+
+        Rig(const Model &model);
+
+        /** Returns nil when the model has no bone (morph) of that name. **/
+        size_t GetBoneIndex(const std::wstring &name) const;
+        size_t GetMorphIndex(const std::wstring &name) const;
+
+        /** Returns nil when the bone drives no IK chain. **/
+        size_t GetIKChainIndex(size_t bone_index) const;
+        size_t GetIKChainNum() const;
+
+        /**
+          CCD is the reference solver and the default. The analytic two-bone
+          solver needs a 2-link chain whose links and target are parented to
+          each other in order; FABRIK needs such a chain with no fixed links.
+          IK_SOLVER_AUTO picks two-bone or FABRIK (3+ links) when the chain
+          allows it, and chains that fit neither fall back to CCD.
+        **/
+        void SetIKSolver(IKSolverType solver);
+        void SetIKSolver(size_t index, IKSolverType solver);
+        IKSolverType GetIKSolver(size_t index) const;
+
+        void ResetPosing(PoseState &state) const;
+
+        void PrePhysicsPosing(PoseState &state) const;
+        void PostPhysicsPosing(PoseState &state) const;
+
+        void Deform(PoseState &state) const;
+
+        const Model &GetModel() const;
+
+    private:
+        typedef PoseState::BoneImage BoneImage;
+        typedef PoseState::IKImage IKImage;
+        typedef PoseState::UVImage UVImage;
+        typedef PoseState::MaterialImage MaterialImage;
+
+        struct BoneNode {
+            BoneNode();
+
+            bool has_parent_;
+            size_t parent_;
+
+            bool has_append_;
+            bool append_rotate_;
+            bool append_translate_;
+
+            size_t append_parent_;
+            float append_ratio_;
+
+            size_t ik_chain_;
+            bool ik_link_;
+
+            Vector3f local_offset_;
+            Matrix4f global_offset_matrix_;
+            Matrix4f global_offset_matrix_inv_;
+
+            class TransformOrder {
+            public:
+                TransformOrder(const Model &model);
+                bool operator() (size_t a, size_t b) const;
+            private:
+                const Model *model_;
+            };
+        };
+
+        /**
+          IK chains live in two flat tables: one IKChain per IK bone and
+          the links of all chains back to back in ik_links_, so a solve
+          walks one contiguous range.
+        **/
+        struct IKLink {
+            enum AxisFixType { FIX_NONE, FIX_X, FIX_Y, FIX_Z, FIX_ALL };
+            enum AxisTransformOrder { ORDER_ZXY, ORDER_XYZ, ORDER_YZX };
+
+            Vector3f limits_min_;
+            Vector3f limits_max_;
+            size_t bone_;
+            AxisFixType fix_type_;
+            AxisTransformOrder transform_order_;
+            bool limited_;
+        };
+
+        struct IKChain {
+            size_t bone_;
+            size_t target_;
+            size_t link_begin_;
+            size_t link_num_;
+            float ccd_angle_limit_;
+            size_t ccd_iterate_limit_;
+            IKSolverType solver_;
+        };
+
+        std::vector<BoneNode> bone_nodes_;
+        std::vector<IKChain> ik_chains_;
+        std::vector<IKLink> ik_links_;
+
+        std::vector<size_t> vertex_morphs_;
+        std::vector<size_t> uv_morphs_;
+        std::vector<size_t> material_morphs_;
+
+        std::vector<std::vector<size_t>> part_material_morphs_;
+
+        std::vector<size_t> morph_leaf_begin_;
+        std::vector<std::pair<size_t, float>> morph_leaves_;
+
+        void InitPoseState(PoseState &state) const;
+
+        void UpdateBoneTransform(PoseState &state, size_t index) const;
+        void UpdateBoneTransform(PoseState &state, const std::vector<size_t> &list) const;
+
+        const IKLink *GetIKLinks(const IKChain &chain) const;
+        void SolveIK(PoseState &state, size_t chain_index) const;
+        void SolveIKCCD(PoseState &state, const IKChain &chain, IKImage &image, const Vector3f &ik_position) const;
+        void SolveIKTwoBone(PoseState &state, const IKChain &chain, IKImage &image, const Vector3f &ik_position) const;
+        void SolveIKFABRIK(PoseState &state, const IKChain &chain, IKImage &image, const Vector3f &ik_position) const;
+        void SwingIKLink(PoseState &state, const IKChain &chain, size_t j, const Vector3f &from, const Vector3f &to) const;
+        void RotateIKLink(PoseState &state, const IKChain &chain, size_t j, const Vector3f &axis, float angle) const;
+        void LimitIKLink(PoseState &state, const IKChain &chain, size_t j, bool ikt) const;
+        void UpdateIKLink(PoseState &state, const IKChain &chain, size_t j) const;
+
+        void UpdateBoneSkinningMatrix(PoseState &state, const std::vector<size_t> &list) const;
+
+        void FlattenMorph(size_t index, float rate, std::vector<bool> &visiting, std::map<size_t, float> &leaves) const;
+        void UpdateMorphTransform(PoseState &state, size_t index, float rate) const;
+        void UpdateVertexMorph(PoseState &state) const;
+        void UpdateUVMorph(PoseState &state) const;
+        void UpdateUVImage(PoseState &state, size_t channel, size_t vertex_index) const;
+        void UpdateMaterialMorph(PoseState &state) const;
+        void UpdateMaterialImage(PoseState &state, size_t part_index) const;
+
+        const Model &model_;
+
+        std::map<std::wstring, size_t> bone_name_map_;
+        std::map<std::wstring, size_t> morph_name_map_;
+
+        std::vector<size_t> pre_physics_bones_;
+        std::vector<size_t> post_physics_bones_;
+
+        Rig &operator=(const Rig&);
+    };
+
+#include "rig_impl.inl"
+
+} /* End of namespace mmd */
+
+#endif /* __RIG_HXX_F2C08EFD8EEF64C22D33529D940833D6_INCLUDED__ */
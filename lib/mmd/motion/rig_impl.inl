@@ -0,0 +1,1309 @@
+
+/**
+             Copyright itsuhane@gmail.com, 2012.
+  Distributed under the Boost Software License, Version 1.0.
+      (See accompanying file LICENSE_1_0.txt or copy at
+            http://www.boost.org/LICENSE_1_0.txt)
+**/
+
+/**
+  Reference:
+    ik.txt & ikx.txt
+      - Possibly original implementation in MMD, released by Higuchi Yu.
+        Listed at VPVP wiki, MMD Related Libraries:
+          http://www6.atwiki.jp/vpvpwiki/pages/288.html
+**/
+inline Rig::Rig(const Model &model) : model_(model) {
+    size_t extra_uv_num = model_.GetExtraUVNumber();
+
+    /***** Create Bone Nodes *****/
+    size_t bone_num = model_.GetBoneNum();
+    bone_nodes_.insert(bone_nodes_.end(), bone_num, BoneNode());
+
+    for(size_t i=0;i<bone_num;++i) {
+        const Model::Bone& bone = model_.GetBone(i);
+        bone_name_map_[bone.GetName()] = i;
+
+        BoneNode& node = bone_nodes_[i];
+
+        node.global_offset_matrix_.r.v[3].downgrade.vector3d = -bone.GetPosition();
+        node.global_offset_matrix_inv_.r.v[3].downgrade.vector3d = bone.GetPosition();
+
+        node.parent_ = bone.GetParentIndex();
+        if(node.parent_<bone_num) {
+            node.has_parent_ = true;
+            node.local_offset_ = bone.GetPosition()-model_.GetBone(node.parent_).GetPosition();
+        } else {
+            node.has_parent_ = false;
+            node.local_offset_ = bone.GetPosition();
+        }
+
+        node.append_rotate_ = bone.IsAppendRotate();
+        node.append_translate_ = bone.IsAppendTranslate();
+        node.has_append_ = false;
+        if(node.append_rotate_||node.append_translate_) {
+            node.append_parent_ = bone.GetAppendIndex();
+            /* a zero ratio grants nothing, so such bones skip the append step */
+            if(node.append_parent_<bone_num&&bone.GetAppendRatio()!=0.0f) {
+                node.has_append_ = true;
+                node.append_ratio_ = bone.GetAppendRatio();
+            }
+        }
+
+        node.ik_chain_ = nil;
+        if(bone.IsHasIK()) {
+            node.ik_chain_ = ik_chains_.size();
+            ik_chains_.push_back(IKChain());
+            IKChain &chain = ik_chains_.back();
+            chain.bone_ = i;
+            chain.link_begin_ = ik_links_.size();
+            chain.link_num_ = bone.GetIKLinkNum();
+            chain.ccd_angle_limit_ = bone.GetCCDAngleLimit();
+            chain.ccd_iterate_limit_ = std::min(bone.GetCCDIterateLimit(), size_t(256));
+            chain.target_ = bone.GetIKTargetIndex();
+            chain.solver_ = IK_SOLVER_CCD;
+
+            for(size_t j=0;j<chain.link_num_;++j) {
+                const Model::Bone::IKLink& ik_link = bone.GetIKLink(j);
+                IKLink link;
+                link.bone_ = ik_link.GetLinkIndex();
+                link.fix_type_ = IKLink::FIX_NONE;
+                link.transform_order_ = IKLink::ORDER_YZX;
+                link.limited_ = ik_link.IsHasLimit();
+                link.limits_min_ = Vector3f();
+                link.limits_max_ = Vector3f();
+                if(link.limited_) {
+                    for(size_t k=0;k<3;++k) {
+                        link.limits_min_.v[k] = std::min(ik_link.GetLoLimit().v[k], ik_link.GetHiLimit().v[k]);
+                        link.limits_max_.v[k] = std::max(ik_link.GetLoLimit().v[k], ik_link.GetHiLimit().v[k]);
+                    }
+                    if(link.limits_min_.p.x>-mmd_math_const_pi*0.5f&&link.limits_max_.p.x<mmd_math_const_pi*0.5f) {
+                        link.transform_order_ = IKLink::ORDER_ZXY;
+                    } else if(link.limits_min_.p.y>-mmd_math_const_pi*0.5f&&link.limits_max_.p.y<mmd_math_const_pi*0.5f) {
+                        link.transform_order_ = IKLink::ORDER_XYZ;
+                    }
+                    if((math::abs(link.limits_min_.p.x)<mmd_math_const_eps)&&(math::abs(link.limits_max_.p.x)<mmd_math_const_eps)&&(math::abs(link.limits_min_.p.y)<mmd_math_const_eps)&&(math::abs(link.limits_max_.p.y)<mmd_math_const_eps)&&(math::abs(link.limits_min_.p.z)<mmd_math_const_eps)&&(math::abs(link.limits_max_.p.z)<mmd_math_const_eps)) {
+                        link.fix_type_ = IKLink::FIX_ALL;
+                    } else if((math::abs(link.limits_min_.p.y)<mmd_math_const_eps)&&(math::abs(link.limits_max_.p.y)<mmd_math_const_eps)&&(math::abs(link.limits_min_.p.z)<mmd_math_const_eps)&&(math::abs(link.limits_max_.p.z)<mmd_math_const_eps)) {
+                        link.fix_type_ = IKLink::FIX_X;
+                    } else if((math::abs(link.limits_min_.p.x)<mmd_math_const_eps)&&(math::abs(link.limits_max_.p.x)<mmd_math_const_eps)&&(math::abs(link.limits_min_.p.z)<mmd_math_const_eps)&&(math::abs(link.limits_max_.p.z)<mmd_math_const_eps)) {
+                        link.fix_type_ = IKLink::FIX_Y;
+                    } else if((math::abs(link.limits_min_.p.x)<mmd_math_const_eps)&&(math::abs(link.limits_max_.p.x)<mmd_math_const_eps)&&(math::abs(link.limits_min_.p.y)<mmd_math_const_eps)&&(math::abs(link.limits_max_.p.y)<mmd_math_const_eps)) {
+                        link.fix_type_ = IKLink::FIX_Z;
+                    }
+                }
+                ik_links_.push_back(link);
+                bone_nodes_[link.bone_].ik_link_ = true;
+            }
+        }
+
+        if(bone.IsPostPhysics()) {
+            post_physics_bones_.push_back(i);
+        } else {
+            pre_physics_bones_.push_back(i);
+        }
+    }
+
+    BoneNode::TransformOrder order(model_);
+    std::sort(pre_physics_bones_.begin(), pre_physics_bones_.end(), order);
+    std::sort(post_physics_bones_.begin(), post_physics_bones_.end(), order);
+
+    /***** Create Morph Tables *****/
+    size_t material_num = model_.GetPartNum();
+    part_material_morphs_.insert(part_material_morphs_.end(), material_num, std::vector<size_t>());
+
+    size_t morph_num = model_.GetMorphNum();
+    for(size_t i=0;i<morph_num;++i) {
+        const Model::Morph& morph = model_.GetMorph(i);
+        morph_name_map_[morph.GetName()] = i;
+        switch(morph.GetType()) {
+        case Model::Morph::MORPH_TYPE_VERTEX:
+            vertex_morphs_.push_back(i);
+            break;
+        case Model::Morph::MORPH_TYPE_UV:
+        case Model::Morph::MORPH_TYPE_EXT_UV_1:
+        case Model::Morph::MORPH_TYPE_EXT_UV_2:
+        case Model::Morph::MORPH_TYPE_EXT_UV_3:
+        case Model::Morph::MORPH_TYPE_EXT_UV_4:
+            {
+                size_t c = morph.GetType()-Model::Morph::MORPH_TYPE_UV;
+                if(c<=extra_uv_num) {
+                    uv_morphs_.push_back(i);
+                }
+                break;
+            }
+        case Model::Morph::MORPH_TYPE_MATERIAL:
+            {
+                material_morphs_.push_back(i);
+                for(size_t j=0;j<morph.GetMorphDataNum();++j) {
+                    const Model::Morph::MaterialMorph &data = morph.GetMaterialMorph(j);
+                    for(size_t p=0;p<material_num;++p) {
+                        if(data.IsGlobal()||data.GetMaterialIndex()==p) {
+                            std::vector<size_t> &morphs = part_material_morphs_[p];
+                            if(morphs.empty()||morphs.back()!=i) {
+                                morphs.push_back(i);
+                            }
+                        }
+                    }
+                }
+                break;
+            }
+        default:
+            break;
+        }
+    }
+
+    /***** Flatten Group Morphs *****/
+    morph_leaf_begin_.push_back(0);
+    for(size_t i=0;i<morph_num;++i) {
+        std::map<size_t, float> leaves;
+        std::vector<bool> visiting(morph_num, false);
+        FlattenMorph(i, 1.0f, visiting, leaves);
+        morph_leaves_.insert(morph_leaves_.end(), leaves.begin(), leaves.end());
+        morph_leaf_begin_.push_back(morph_leaves_.size());
+    }
+}
+
+inline void Rig::InitPoseState(PoseState &state) const {
+    /***** Create Pose Image *****/
+    PoseState::PoseImage &pose_image = state.pose_image;
+    size_t vertex_num = model_.GetVertexNum();
+    pose_image.coordinates.insert(pose_image.coordinates.end(), vertex_num, Vector3f());
+    pose_image.normals.insert(pose_image.normals.end(), vertex_num, Vector3f());
+
+    /***** Create Vertex Images *****/
+    state.vertex_images_.insert(state.vertex_images_.end(), vertex_num, Vector3f());
+    state.vertex_displaced_.insert(state.vertex_displaced_.end(), vertex_num, false);
+
+    /***** Create UV Images *****/
+    for(size_t i=0;i<vertex_num;++i) {
+        pose_image.uv_coords.push_back(model_.GetVertex(i).GetUVCoordinate());
+    }
+    size_t extra_uv_num = model_.GetExtraUVNumber();
+    pose_image.extra_uv_coords.insert(pose_image.extra_uv_coords.end(), extra_uv_num, std::vector<Vector4f>());
+    for(size_t c=0;c<extra_uv_num;++c) {
+        for(size_t i=0;i<vertex_num;++i) {
+            pose_image.extra_uv_coords[c].push_back(model_.GetVertex(i).GetExtraUVCoordinate(c));
+        }
+    }
+    pose_image.uv_dirty_begin = 0;
+    pose_image.uv_dirty_end = vertex_num;
+    state.uv_images_.insert(state.uv_images_.end(), extra_uv_num+1, UVImage());
+    for(std::vector<size_t>::const_iterator i=uv_morphs_.begin();i!=uv_morphs_.end();++i) {
+        UVImage &uv_image = state.uv_images_[model_.GetMorph(*i).GetType()-Model::Morph::MORPH_TYPE_UV];
+        if(uv_image.offsets_.empty()) {
+            uv_image.offsets_.insert(uv_image.offsets_.end(), vertex_num, Vector4f::Zero());
+            uv_image.displaced_.insert(uv_image.displaced_.end(), vertex_num, false);
+        }
+    }
+
+    /***** Create Bone Images *****/
+    state.bone_images_.insert(state.bone_images_.end(), bone_nodes_.size(), BoneImage());
+    state.ik_images_.insert(state.ik_images_.end(), ik_chains_.size(), IKImage());
+    state.ik_warm_rotations_.insert(state.ik_warm_rotations_.end(), ik_links_.size(), Vector4f());
+    size_t max_link_num = 0;
+    for(std::vector<IKChain>::const_iterator i=ik_chains_.begin();i!=ik_chains_.end();++i) {
+        max_link_num = std::max(max_link_num, i->link_num_);
+    }
+    state.ik_joints_.insert(state.ik_joints_.end(), max_link_num+1, Vector3f());
+    state.ik_lengths_.insert(state.ik_lengths_.end(), max_link_num, 0.0f);
+
+    /***** Create Material Images *****/
+    size_t material_num = model_.GetPartNum();
+    state.material_mul_images_.insert(state.material_mul_images_.end(), material_num, MaterialImage(1.0f));
+    state.material_add_images_.insert(state.material_add_images_.end(), material_num, MaterialImage(0.0f));
+    state.part_dirty_.insert(state.part_dirty_.end(), material_num, true);
+    state.changed_parts_.reserve(material_num);
+    for(size_t i=0;i<material_num;++i) {
+        pose_image.dirty_parts.push_back(i);
+    }
+
+    /***** Create Morph Rates *****/
+    size_t morph_num = model_.GetMorphNum();
+    state.morph_rates_.insert(state.morph_rates_.end(), morph_num, 0.0f);
+    state.leaf_morph_rates_.insert(state.leaf_morph_rates_.end(), morph_num, 0.0f);
+    state.applied_morph_rates_.insert(state.applied_morph_rates_.end(), morph_num, 0.0f);
+    state.morph_displaced_.insert(state.morph_displaced_.end(), morph_num, false);
+
+    /***** 1st Posing *****/
+    ResetPosing(state);
+    Deform(state);
+}
+
+inline void Rig::ResetPosing(PoseState &state) const {
+    for(std::vector<float>::iterator i=state.morph_rates_.begin();i!=state.morph_rates_.end();++i) {
+        *i = 0;
+    }
+    for(std::vector<BoneImage>::iterator i=state.bone_images_.begin();i!=state.bone_images_.end();++i) {
+        i->rotation_.q.MakeIdentity();
+        i->translation_.MakeZero();
+    }
+    state.ResetIKWarmStart();
+    PrePhysicsPosing(state);
+    PostPhysicsPosing(state);
+}
+
+inline void Rig::UpdateBoneTransform(PoseState &state, size_t index) const {
+    std::vector<BoneImage> &bone_images = state.bone_images_;
+    const BoneNode& node = bone_nodes_[index];
+    BoneImage& image = bone_images[index];
+    image.total_rotation_.q = image.morph_rotation_.q*image.rotation_.q;
+    image.total_translation_ = image.morph_translation_+image.translation_;
+
+    if(node.has_append_) {
+        if(node.append_rotate_) {
+            image.total_rotation_.q = image.total_rotation_.q*QuaternionPower(bone_images[node.append_parent_].total_rotation_.q, node.append_ratio_);
+        }
+        if(node.append_translate_) {
+            image.total_translation_ = image.total_translation_+node.append_ratio_*bone_images[node.append_parent_].total_translation_;
+        }
+    }
+
+    if(node.ik_link_) {
+        image.pre_ik_rotation_ = image.total_rotation_;
+        image.total_rotation_.q = image.ik_rotation_.q*image.total_rotation_.q;
+    }
+
+    image.local_matrix_ = image.total_rotation_.q.ToRotateMatrix();
+    image.local_matrix_.r.v[3].downgrade.vector3d = image.total_translation_+node.local_offset_;
+
+    if(node.has_parent_) {
+        image.local_matrix_ = image.local_matrix_*bone_images[node.parent_].local_matrix_;
+    }
+
+    if(node.ik_chain_!=nil) {
+        SolveIK(state, node.ik_chain_);
+    }
+}
+
+inline void Rig::SolveIK(PoseState &state, size_t chain_index) const {
+    std::vector<BoneImage> &bone_images = state.bone_images_;
+    const IKChain &chain = ik_chains_[chain_index];
+    const IKLink *links = GetIKLinks(chain);
+    IKImage &ik_image = state.ik_images_[chain_index];
+    Vector4f *warm_rotations = links!=NULL?&state.ik_warm_rotations_[0]+chain.link_begin_:NULL;
+    size_t ik_link_num = chain.link_num_;
+    Vector3f ik_position = bone_images[chain.bone_].local_matrix_.r.v[3].downgrade.vector3d;
+
+    bool warm_start = state.ik_warm_start_&&ik_image.warm_valid_;
+    if(warm_start) {
+        Vector3f ik_jump = ik_position-ik_image.warm_position_;
+        warm_start = ik_jump*ik_jump<state.ik_warm_start_threshold_*state.ik_warm_start_threshold_;
+    }
+    for(size_t i=0;i<ik_link_num;++i) {
+        if(warm_start) {
+            bone_images[links[i].bone_].ik_rotation_ = warm_rotations[i];
+        } else {
+            bone_images[links[i].bone_].ik_rotation_.q.MakeIdentity();
+        }
+    }
+    for(size_t i=0;i<ik_link_num;++i) {
+        UpdateBoneTransform(state, links[ik_link_num-i-1].bone_);
+    }
+    UpdateBoneTransform(state, chain.target_);
+
+    ik_image.iteration_num_ = 0;
+    switch(chain.solver_) {
+    case IK_SOLVER_TWO_BONE: { SolveIKTwoBone(state, chain, ik_image, ik_position); break; }
+    case IK_SOLVER_FABRIK: { SolveIKFABRIK(state, chain, ik_image, ik_position); break; }
+    case IK_SOLVER_CCD: case IK_SOLVER_AUTO: default: { SolveIKCCD(state, chain, ik_image, ik_position); break; }
+    }
+    Vector3f ik_error = ik_position-bone_images[chain.target_].local_matrix_.r.v[3].downgrade.vector3d;
+    ik_image.error_ = ik_error.Norm();
+
+    if(state.ik_warm_start_) {
+        for(size_t i=0;i<ik_link_num;++i) {
+            warm_rotations[i] = bone_images[links[i].bone_].ik_rotation_;
+        }
+        ik_image.warm_position_ = ik_position;
+        ik_image.warm_valid_ = true;
+    }
+}
+
+inline void Rig::SolveIKCCD(PoseState &state, const IKChain &chain, IKImage &image, const Vector3f &ik_position) const {
+    struct __ {
+        static float Nabs(float x) {
+            if(x>=0.0f) {
+                return 1.0f;
+            } else {
+                return -1.0f;
+            }
+        }
+    };
+
+    std::vector<BoneImage> &bone_images = state.bone_images_;
+    const IKLink *links = GetIKLinks(chain);
+    size_t ik_link_num = chain.link_num_;
+    Vector3f target_position = bone_images[chain.target_].local_matrix_.r.v[3].downgrade.vector3d;
+    Vector3f ik_error = ik_position-target_position;
+    float ik_tolerance = state.ik_warm_start_?state.ik_warm_start_tolerance_*state.ik_warm_start_tolerance_:float(mmd_math_const_eps);
+    float last_ik_error = 2.0f*(ik_error*ik_error)+ik_tolerance;
+    size_t ikt = chain.ccd_iterate_limit_/2;
+    for(size_t i=0;i<chain.ccd_iterate_limit_;++i) {
+        float ik_error_sq = ik_error*ik_error;
+        if(ik_error_sq<ik_tolerance) {
+            break;
+        }
+        /* a warm started chain that stopped improving has reached what it can */
+        if(state.ik_warm_start_&&last_ik_error-ik_error_sq<ik_tolerance) {
+            break;
+        }
+        last_ik_error = ik_error_sq;
+        ++image.iteration_num_;
+        for(size_t j=0;j<ik_link_num;++j) {
+            if(links[j].fix_type_!=IKLink::FIX_ALL) {
+                const BoneNode& ik_node = bone_nodes_[links[j].bone_];
+                BoneImage& ik_image = bone_images[links[j].bone_];
+                Vector3f ik_link_position = ik_image.local_matrix_.r.v[3].downgrade.vector3d;
+                Vector3f target_direction = ik_link_position-target_position;
+                Vector3f ik_direction = ik_link_position-ik_position;
+
+                target_direction = target_direction.Normalize();
+                ik_direction = ik_direction.Normalize();
+
+                Vector3f ik_rotate_axis;
+                ik_rotate_axis.t = target_direction.t*ik_direction.t;
+                for(size_t k=0;k<3;++k) {
+                    if(std::abs(ik_rotate_axis.v[k])<mmd_math_const_eps) {
+                        ik_rotate_axis.v[k] = (float)mmd_math_const_eps;
+                    }
+                }
+                Matrix4f localization_matrix;
+                if(ik_node.has_parent_) {
+                    localization_matrix = bone_images[ik_node.parent_].local_matrix_;
+                } else {
+                    localization_matrix.MakeIdentity();
+                }
+                if(links[j].limited_&&links[j].fix_type_!=IKLink::FIX_NONE&&i<ikt) {
+                    switch(links[j].fix_type_) {
+                    case IKLink::FIX_X:
+                        {
+                            ik_rotate_axis.p.x = __::Nabs(ik_rotate_axis*localization_matrix.r.v[0].downgrade.vector3d);
+                            ik_rotate_axis.p.y = ik_rotate_axis.p.z = 0.0f;
+                            break;
+                        }
+                    case IKLink::FIX_Y:
+                        {
+                            ik_rotate_axis.p.y = __::Nabs(ik_rotate_axis*localization_matrix.r.v[1].downgrade.vector3d);
+                            ik_rotate_axis.p.x = ik_rotate_axis.p.z = 0.0f;
+                            break;
+                        }
+                    case IKLink::FIX_Z:
+                        {
+                            ik_rotate_axis.p.z = __::Nabs(ik_rotate_axis*localization_matrix.r.v[2].downgrade.vector3d);
+                            ik_rotate_axis.p.x = ik_rotate_axis.p.y = 0.0f;
+                            break;
+                        }
+                    case IKLink::FIX_ALL: case IKLink::FIX_NONE: default: { break; }
+                    }
+                } else {
+                    ik_rotate_axis = rotate(ik_rotate_axis, localization_matrix.Transpose());
+                    ik_rotate_axis = ik_rotate_axis.Normalize();
+                }
+                float ik_rotate_angle = std::min(math::acos(math::clamp(target_direction*ik_direction,-1.0f,1.0f)), chain.ccd_angle_limit_*(j+1));
+                ik_image.ik_rotation_.q = AxisToQuaternion(ik_rotate_axis, ik_rotate_angle)*ik_image.ik_rotation_.q;
+                LimitIKLink(state, chain, j, i<ikt);
+                UpdateIKLink(state, chain, j);
+                target_position = bone_images[chain.target_].local_matrix_.r.v[3].downgrade.vector3d;
+            }
+        }
+        ik_error = ik_position-target_position;
+    }
+}
+
+inline void Rig::SolveIKTwoBone(PoseState &state, const IKChain &chain, IKImage &image, const Vector3f &ik_position) const {
+    ++image.iteration_num_;
+
+    /* bend the middle link until the chain spans the distance to the IK bone */
+    std::vector<BoneImage> &bone_images = state.bone_images_;
+    const IKLink *links = GetIKLinks(chain);
+    BoneImage& root_image = bone_images[links[1].bone_];
+    BoneImage& middle_image = bone_images[links[0].bone_];
+    Vector3f root_position = root_image.local_matrix_.r.v[3].downgrade.vector3d;
+    Vector3f middle_position = middle_image.local_matrix_.r.v[3].downgrade.vector3d;
+    Vector3f target_position = bone_images[chain.target_].local_matrix_.r.v[3].downgrade.vector3d;
+
+    Vector3f w = root_position-middle_position;
+    Vector3f u = target_position-middle_position;
+    float a = w.Norm();
+    float b = u.Norm();
+    float d = math::clamp((ik_position-root_position).Norm(), std::abs(a-b), a+b);
+
+    Vector3f axis;
+    if(links[0].limited_&&links[0].fix_type_>=IKLink::FIX_X&&links[0].fix_type_<=IKLink::FIX_Z) {
+        axis = root_image.local_matrix_.r.v[links[0].fix_type_-IKLink::FIX_X].downgrade.vector3d;
+    } else {
+        axis.t = w.t*u.t;
+        if(axis*axis<mmd_math_const_eps) {
+            axis = root_image.local_matrix_.r.v[0].downgrade.vector3d;
+        }
+    }
+    axis = axis.Normalize();
+
+    /* solve A*cos(phi)+B*sin(phi) = C for the hinge angle phi */
+    Vector3f u_perp = u-(u*axis)*axis;
+    Vector3f w_perp = w-(w*axis)*axis;
+    Vector3f axis_u;
+    axis_u.t = axis.t*u.t;
+    float A = w_perp*u_perp;
+    float B = w*axis_u;
+    float C = 0.5f*(a*a+b*b-d*d)-(w*axis)*(u*axis);
+    float R = math::sqrt(A*A+B*B);
+    if(R>mmd_math_const_eps) {
+        float phi_0 = math::atan2(B, A);
+        float delta = math::acos(math::clamp(C/R, -1.0f, 1.0f));
+        float phi_1 = phi_0+delta;
+        float phi_2 = phi_0-delta;
+        if(phi_1>mmd_math_const_pi) phi_1 -= 2.0f*mmd_math_const_pi;
+        if(phi_2<-mmd_math_const_pi) phi_2 += 2.0f*mmd_math_const_pi;
+        RotateIKLink(state, chain, 0, axis, std::abs(phi_1)<std::abs(phi_2)?phi_1:phi_2);
+    }
+
+    /* then swing the root link onto the IK bone */
+    target_position = bone_images[chain.target_].local_matrix_.r.v[3].downgrade.vector3d;
+    SwingIKLink(state, chain, 1, target_position-root_position, ik_position-root_position);
+}
+
+inline void Rig::SolveIKFABRIK(PoseState &state, const IKChain &chain, IKImage &image, const Vector3f &ik_position) const {
+    std::vector<BoneImage> &bone_images = state.bone_images_;
+    const IKLink *links = GetIKLinks(chain);
+    size_t ik_link_num = chain.link_num_;
+
+    /* joints run from the chain root to the IK target */
+    std::vector<Vector3f> &joints = state.ik_joints_;
+    std::vector<float> &lengths = state.ik_lengths_;
+    for(size_t i=0;i<ik_link_num;++i) {
+        joints[i] = bone_images[links[ik_link_num-i-1].bone_].local_matrix_.r.v[3].downgrade.vector3d;
+    }
+    joints[ik_link_num] = bone_images[chain.target_].local_matrix_.r.v[3].downgrade.vector3d;
+    for(size_t i=0;i<ik_link_num;++i) {
+        lengths[i] = (joints[i+1]-joints[i]).Norm();
+    }
+
+    Vector3f base = joints[0];
+    float ik_tolerance = state.ik_warm_start_?state.ik_warm_start_tolerance_*state.ik_warm_start_tolerance_:float(mmd_math_const_eps);
+    for(size_t i=0;i<chain.ccd_iterate_limit_;++i) {
+        Vector3f ik_error = ik_position-joints[ik_link_num];
+        if(ik_error*ik_error<ik_tolerance) {
+            break;
+        }
+        ++image.iteration_num_;
+        joints[ik_link_num] = ik_position;
+        for(size_t j=ik_link_num;j>0;--j) {
+            Vector3f direction = joints[j-1]-joints[j];
+            float length = direction.Norm();
+            if(length>mmd_math_const_eps) {
+                joints[j-1] = joints[j]+(lengths[j-1]/length)*direction;
+            }
+        }
+        joints[0] = base;
+        for(size_t j=0;j<ik_link_num;++j) {
+            Vector3f direction = joints[j+1]-joints[j];
+            float length = direction.Norm();
+            if(length>mmd_math_const_eps) {
+                joints[j+1] = joints[j]+(lengths[j]/length)*direction;
+            }
+        }
+    }
+
+    /* turn the solved joint positions back into link rotations, root first */
+    for(size_t i=0;i<ik_link_num;++i) {
+        size_t j = ik_link_num-i-1;
+        if(links[j].fix_type_!=IKLink::FIX_ALL) {
+            size_t child = j>0?links[j-1].bone_:chain.target_;
+            Vector3f link_position = bone_images[links[j].bone_].local_matrix_.r.v[3].downgrade.vector3d;
+            Vector3f child_position = bone_images[child].local_matrix_.r.v[3].downgrade.vector3d;
+            SwingIKLink(state, chain, j, child_position-link_position, joints[i+1]-link_position);
+        }
+    }
+}
+
+inline void Rig::SwingIKLink(PoseState &state, const IKChain &chain, size_t j, const Vector3f &from, const Vector3f &to) const {
+    float from_length = from.Norm();
+    float to_length = to.Norm();
+    if(from_length<mmd_math_const_eps||to_length<mmd_math_const_eps) {
+        return;
+    }
+    Vector3f axis;
+    axis.t = from.t*to.t;
+    if(axis*axis<mmd_math_const_eps*from_length*to_length) {
+        return;
+    }
+    float angle = math::acos(math::clamp((from*to)/(from_length*to_length), -1.0f, 1.0f));
+    RotateIKLink(state, chain, j, axis.Normalize(), angle);
+}
+
+inline void Rig::RotateIKLink(PoseState &state, const IKChain &chain, size_t j, const Vector3f &axis, float angle) const {
+    const IKLink *links = GetIKLinks(chain);
+    const BoneNode& ik_node = bone_nodes_[links[j].bone_];
+    BoneImage& ik_image = state.bone_images_[links[j].bone_];
+    Vector3f local_axis = axis;
+    if(ik_node.has_parent_) {
+        local_axis = rotate(axis, state.bone_images_[ik_node.parent_].local_matrix_.Transpose()).Normalize();
+    }
+    ik_image.ik_rotation_.q = AxisToQuaternion(local_axis, angle)*ik_image.ik_rotation_.q;
+    LimitIKLink(state, chain, j, true);
+    UpdateIKLink(state, chain, j);
+}
+
+inline void Rig::LimitIKLink(PoseState &state, const IKChain &chain, size_t j, bool ikt) const {
+    struct __ {
+        static Vector3f LimitEulerAngle(const Vector3f& euler, const Vector3f& euler_min, const Vector3f& euler_max, bool ikt) {
+            Vector3f result = euler;
+            for(size_t i=0;i<3;++i) {
+                if(result.v[i] < euler_min.v[i]) {
+                    float tf= 2 * euler_min.v[i] - result.v[i];
+                    if(tf <= euler_max.v[i] && ikt) result.v[i] = tf;
+                    else result.v[i] = euler_min.v[i];
+                }
+                if(result.v[i] > euler_max.v[i]) {
+                    float tf= 2 * euler_max.v[i] - result.v[i];
+                    if(tf >= euler_min.v[i] && ikt) result.v[i] = tf;
+                    else result.v[i] = euler_max.v[i];
+                }
+            }
+            return result;
+        }
+    };
+
+    const IKLink *links = GetIKLinks(chain);
+    if(!links[j].limited_) {
+        return;
+    }
+    BoneImage& ik_image = state.bone_images_[links[j].bone_];
+    Quaternionf local_rotation = ik_image.ik_rotation_.q*ik_image.pre_ik_rotation_.q;
+    switch(links[j].transform_order_) {
+    case IKLink::ORDER_ZXY:
+        {
+            Vector3f euler_angle = QuaternionToZXY(local_rotation);
+            euler_angle = __::LimitEulerAngle(euler_angle, links[j].limits_min_, links[j].limits_max_, ikt);
+            local_rotation = ZXYToQuaternion(euler_angle);
+            break;
+        }
+    case IKLink::ORDER_XYZ:
+        {
+            Vector3f euler_angle = QuaternionToXYZ(local_rotation);
+            euler_angle = __::LimitEulerAngle(euler_angle, links[j].limits_min_, links[j].limits_max_, ikt);
+            local_rotation = XYZToQuaternion(euler_angle);
+            break;
+        }
+    case IKLink::ORDER_YZX:
+        {
+            Vector3f euler_angle = QuaternionToYZX(local_rotation);
+            euler_angle = __::LimitEulerAngle(euler_angle, links[j].limits_min_, links[j].limits_max_, ikt);
+            local_rotation = YZXToQuaternion(euler_angle);
+            break;
+        }
+    }
+    ik_image.ik_rotation_.q = local_rotation*ik_image.pre_ik_rotation_.q.Inverse();
+}
+
+inline void Rig::UpdateIKLink(PoseState &state, const IKChain &chain, size_t j) const {
+    const IKLink *links = GetIKLinks(chain);
+    for(size_t k=0;k<=j;++k) {
+        const BoneNode& link_node = bone_nodes_[links[j-k].bone_];
+        BoneImage& link_image = state.bone_images_[links[j-k].bone_];
+        link_image.total_rotation_.q = link_image.ik_rotation_.q*link_image.pre_ik_rotation_.q;
+        link_image.local_matrix_ = link_image.total_rotation_.q.ToRotateMatrix();
+        link_image.local_matrix_.r.v[3].downgrade.vector3d = link_image.total_translation_+link_node.local_offset_;
+        if(link_node.has_parent_) {
+            link_image.local_matrix_ = link_image.local_matrix_*state.bone_images_[link_node.parent_].local_matrix_;
+        }
+    }
+    UpdateBoneTransform(state, chain.target_);
+}
+
+inline const Rig::IKLink* Rig::GetIKLinks(const IKChain &chain) const {
+    if(ik_links_.empty()) {
+        return NULL;
+    }
+    return &ik_links_[0]+chain.link_begin_;
+}
+
+inline void Rig::UpdateBoneTransform(PoseState &state, const std::vector<size_t> &list) const {
+    size_t n = list.size();
+    for(size_t i=0;i<n;++i) {
+        UpdateBoneTransform(state, list[i]);
+    }
+}
+
+inline void Rig::UpdateBoneSkinningMatrix(PoseState &state, const std::vector<size_t> &list) const {
+    size_t n = list.size();
+    for(size_t i=0;i<n;++i) {
+        BoneImage& image = state.bone_images_[list[i]];
+        image.skinning_matrix_ = bone_nodes_[list[i]].global_offset_matrix_*image.local_matrix_;
+    }
+}
+
+/**
+    Expands a morph into the leaf (non-group) morphs it drives, with the
+    product of the group rates along the way. Leaves reached through
+    several groups are merged. A group that (indirectly) contains itself
+    is expanded only once along each path.
+**/
+inline void Rig::FlattenMorph(size_t index, float rate, std::vector<bool> &visiting, std::map<size_t, float> &leaves) const {
+    if(index>=model_.GetMorphNum()||visiting[index]) {
+        return;
+    }
+    const Model::Morph &morph = model_.GetMorph(index);
+    if(morph.GetType()!=Model::Morph::MORPH_TYPE_GROUP) {
+        leaves[index] += rate;
+        return;
+    }
+    visiting[index] = true;
+    for(size_t i=0;i<morph.GetMorphDataNum();++i) {
+        const Model::Morph::GroupMorph &data = morph.GetGroupMorph(i);
+        FlattenMorph(data.GetMorphIndex(), data.GetMorphRate()*rate, visiting, leaves);
+    }
+    visiting[index] = false;
+}
+
+inline void Rig::UpdateMorphTransform(PoseState &state, size_t index, float rate) const {
+    if(rate<mmd_math_const_eps) {
+        return;
+    }
+    const Model::Morph &morph = model_.GetMorph(index);
+    switch(morph.GetType()) {
+    case Model::Morph::MORPH_TYPE_GROUP:
+    case Model::Morph::MORPH_TYPE_VERTEX:
+        break;
+    case Model::Morph::MORPH_TYPE_BONE:
+        for(size_t i=0;i<morph.GetMorphDataNum();++i) {
+            const Model::Morph::BoneMorph &data = morph.GetBoneMorph(i);
+            BoneImage &bone_image = state.bone_images_[data.GetBoneIndex()];
+            bone_image.morph_translation_ = bone_image.morph_translation_+data.GetTranslation()*rate;
+            bone_image.morph_rotation_.q = bone_image.morph_rotation_.q*QuaternionPower(data.GetRotation().q, rate);
+        }
+        break;
+    case Model::Morph::MORPH_TYPE_MATERIAL:
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+    UV morphs follow the vertex morph scheme, one offset image per UV
+    channel (channel 0 is the regular UV, 1-4 the extra UVs). Every UV
+    written to pose_image widens its dirty range.
+**/
+inline void Rig::UpdateUVMorph(PoseState &state) const {
+    bool morphed[5] = { false, false, false, false, false };
+    for(std::vector<size_t>::const_iterator i=uv_morphs_.begin();i!=uv_morphs_.end();++i) {
+        if(state.leaf_morph_rates_[*i]!=0.0f) {
+            morphed[model_.GetMorph(*i).GetType()-Model::Morph::MORPH_TYPE_UV] = true;
+        }
+    }
+    for(size_t c=0;c<state.uv_images_.size();++c) {
+        UVImage &uv_image = state.uv_images_[c];
+        if(morphed[c]||uv_image.displaced_vertices_.empty()) {
+            continue;
+        }
+        for(std::vector<size_t>::iterator i=uv_image.displaced_vertices_.begin();i!=uv_image.displaced_vertices_.end();++i) {
+            uv_image.offsets_[*i].MakeZero();
+            uv_image.displaced_[*i] = false;
+            UpdateUVImage(state, c, *i);
+        }
+        uv_image.displaced_vertices_.clear();
+        for(std::vector<size_t>::const_iterator i=uv_morphs_.begin();i!=uv_morphs_.end();++i) {
+            if(size_t(model_.GetMorph(*i).GetType()-Model::Morph::MORPH_TYPE_UV)==c) {
+                state.applied_morph_rates_[*i] = 0.0f;
+                state.morph_displaced_[*i] = false;
+            }
+        }
+    }
+    for(std::vector<size_t>::const_iterator k=uv_morphs_.begin();k!=uv_morphs_.end();++k) {
+        size_t i = *k;
+        float delta = state.leaf_morph_rates_[i]-state.applied_morph_rates_[i];
+        if(delta==0.0f) {
+            continue;
+        }
+        const Model::Morph &morph = model_.GetMorph(i);
+        size_t c = morph.GetType()-Model::Morph::MORPH_TYPE_UV;
+        UVImage &uv_image = state.uv_images_[c];
+        for(size_t j=0;j<morph.GetMorphDataNum();++j) {
+            const Model::Morph::UVMorph &data = morph.GetUVMorph(j);
+            size_t vertex_index = data.GetVertexIndex();
+            uv_image.offsets_[vertex_index] = uv_image.offsets_[vertex_index]+data.GetOffset()*delta;
+            if(!uv_image.displaced_[vertex_index]) {
+                uv_image.displaced_[vertex_index] = true;
+                uv_image.displaced_vertices_.push_back(vertex_index);
+            }
+            UpdateUVImage(state, c, vertex_index);
+        }
+        state.morph_displaced_[i] = true;
+        state.applied_morph_rates_[i] = state.leaf_morph_rates_[i];
+    }
+}
+
+inline void Rig::UpdateUVImage(PoseState &state, size_t channel, size_t vertex_index) const {
+    const Model::Vertex<cref> vertex = model_.GetVertex(vertex_index);
+    PoseState::PoseImage &pose_image = state.pose_image;
+    const Vector4f &offset = state.uv_images_[channel].offsets_[vertex_index];
+    if(channel==0) {
+        Vector2f uv_coord = vertex.GetUVCoordinate();
+        uv_coord.v[0] += offset.v[0];
+        uv_coord.v[1] += offset.v[1];
+        pose_image.uv_coords[vertex_index] = uv_coord;
+    } else {
+        pose_image.extra_uv_coords[channel-1][vertex_index] = vertex.GetExtraUVCoordinate(channel-1)+offset;
+    }
+    pose_image.uv_dirty_begin = std::min(pose_image.uv_dirty_begin, vertex_index);
+    pose_image.uv_dirty_end = std::max(pose_image.uv_dirty_end, vertex_index+1);
+}
+
+/**
+    Material morphs are not invertible (a multiplier may be zero), so a
+    rate change marks the parts the morph touches and only those parts
+    are rebuilt from all material morphs acting on them.
+**/
+inline void Rig::UpdateMaterialMorph(PoseState &state) const {
+    size_t part_num = part_material_morphs_.size();
+    std::vector<size_t> &changed_parts = state.changed_parts_;
+    changed_parts.clear();
+    for(std::vector<size_t>::const_iterator k=material_morphs_.begin();k!=material_morphs_.end();++k) {
+        size_t i = *k;
+        if(state.leaf_morph_rates_[i]==state.applied_morph_rates_[i]) {
+            continue;
+        }
+        state.applied_morph_rates_[i] = state.leaf_morph_rates_[i];
+        const Model::Morph &morph = model_.GetMorph(i);
+        for(size_t j=0;j<morph.GetMorphDataNum();++j) {
+            const Model::Morph::MaterialMorph &data = morph.GetMaterialMorph(j);
+            if(data.IsGlobal()) {
+                for(size_t p=0;p<part_num;++p) {
+                    changed_parts.push_back(p);
+                }
+            } else if(data.GetMaterialIndex()<part_num) {
+                changed_parts.push_back(data.GetMaterialIndex());
+            }
+        }
+    }
+    std::sort(changed_parts.begin(), changed_parts.end());
+    changed_parts.erase(std::unique(changed_parts.begin(), changed_parts.end()), changed_parts.end());
+    for(std::vector<size_t>::iterator i=changed_parts.begin();i!=changed_parts.end();++i) {
+        UpdateMaterialImage(state, *i);
+    }
+}
+
+inline void Rig::UpdateMaterialImage(PoseState &state, size_t part_index) const {
+    struct __ {
+        static Vector4f Mul(const Vector4f &a, const Vector4f &b, float rate) {
+            Vector4f result;
+            for(size_t i=0;i<4;++i) {
+                result.v[i] = a.v[i]*(1.0f+(b.v[i]-1.0f)*rate);
+            }
+            return result;
+        }
+    };
+
+    MaterialImage &mul_image = state.material_mul_images_[part_index];
+    MaterialImage &add_image = state.material_add_images_[part_index];
+    mul_image.Init(1.0f);
+    add_image.Init(0.0f);
+    const std::vector<size_t> &morphs = part_material_morphs_[part_index];
+    for(std::vector<size_t>::const_iterator k=morphs.begin();k!=morphs.end();++k) {
+        float rate = state.leaf_morph_rates_[*k];
+        if(rate==0.0f) {
+            continue;
+        }
+        const Model::Morph &morph = model_.GetMorph(*k);
+        for(size_t j=0;j<morph.GetMorphDataNum();++j) {
+            const Model::Morph::MaterialMorph &data = morph.GetMaterialMorph(j);
+            if(!data.IsGlobal()&&data.GetMaterialIndex()!=part_index) {
+                continue;
+            }
+            if(data.GetMethod()==Model::Morph::MaterialMorph::MORPH_MAT_MUL) {
+                mul_image.SetDiffuse(__::Mul(mul_image.GetDiffuse(), data.GetDiffuse(), rate));
+                mul_image.SetSpecular(__::Mul(mul_image.GetSpecular(), data.GetSpecular(), rate));
+                mul_image.SetAmbient(__::Mul(mul_image.GetAmbient(), data.GetAmbient(), rate));
+                mul_image.SetShininess(mul_image.GetShininess()*(1.0f+(data.GetShininess()-1.0f)*rate));
+                mul_image.SetEdgeColor(__::Mul(mul_image.GetEdgeColor(), data.GetEdgeColor(), rate));
+                mul_image.SetEdgeSize(mul_image.GetEdgeSize()*(1.0f+(data.GetEdgeSize()-1.0f)*rate));
+                mul_image.SetTexture(__::Mul(mul_image.GetTexture(), data.GetTexture(), rate));
+                mul_image.SetSubTexture(__::Mul(mul_image.GetSubTexture(), data.GetSubTexture(), rate));
+                mul_image.SetToonTexture(__::Mul(mul_image.GetToonTexture(), data.GetToonTexture(), rate));
+            } else {
+                add_image.SetDiffuse(add_image.GetDiffuse()+data.GetDiffuse()*rate);
+                add_image.SetSpecular(add_image.GetSpecular()+data.GetSpecular()*rate);
+                add_image.SetAmbient(add_image.GetAmbient()+data.GetAmbient()*rate);
+                add_image.SetShininess(add_image.GetShininess()+data.GetShininess()*rate);
+                add_image.SetEdgeColor(add_image.GetEdgeColor()+data.GetEdgeColor()*rate);
+                add_image.SetEdgeSize(add_image.GetEdgeSize()+data.GetEdgeSize()*rate);
+                add_image.SetTexture(add_image.GetTexture()+data.GetTexture()*rate);
+                add_image.SetSubTexture(add_image.GetSubTexture()+data.GetSubTexture()*rate);
+                add_image.SetToonTexture(add_image.GetToonTexture()+data.GetToonTexture()*rate);
+            }
+        }
+    }
+    if(!state.part_dirty_[part_index]) {
+        state.part_dirty_[part_index] = true;
+        state.pose_image.dirty_parts.push_back(part_index);
+    }
+}
+
+/**
+    Vertex morphs are applied incrementally: only morphs whose merged leaf
+    rate changed since the last call add their rate delta to the vertex
+    images. Every vertex ever offset is listed in
+    displaced_vertices_, and the list is cleared exactly (no accumulated
+    rounding) once all vertex morph rates drop back to zero.
+**/
+inline void Rig::UpdateVertexMorph(PoseState &state) const {
+    bool morphed = false;
+    for(std::vector<size_t>::const_iterator i=vertex_morphs_.begin();i!=vertex_morphs_.end();++i) {
+        if(state.leaf_morph_rates_[*i]!=0.0f) {
+            morphed = true;
+            break;
+        }
+    }
+    if(!morphed) {
+        for(std::vector<size_t>::iterator i=state.displaced_vertices_.begin();i!=state.displaced_vertices_.end();++i) {
+            state.vertex_images_[*i].MakeZero();
+            state.vertex_displaced_[*i] = false;
+        }
+        state.displaced_vertices_.clear();
+        for(std::vector<size_t>::const_iterator i=vertex_morphs_.begin();i!=vertex_morphs_.end();++i) {
+            state.applied_morph_rates_[*i] = 0.0f;
+            state.morph_displaced_[*i] = false;
+        }
+        return;
+    }
+    std::vector<Vector3f> &vertex_images = state.vertex_images_;
+    for(std::vector<size_t>::const_iterator k=vertex_morphs_.begin();k!=vertex_morphs_.end();++k) {
+        size_t i = *k;
+        float delta = state.leaf_morph_rates_[i]-state.applied_morph_rates_[i];
+        if(delta==0.0f) {
+            continue;
+        }
+        const Model::Morph &morph = model_.GetMorph(i);
+        size_t vertex_morph_num = morph.GetMorphDataNum();
+        const std::uint32_t *indices = morph.GetVertexIndexPointer();
+        const Vector3f *offsets = morph.GetVertexOffsetPointer();
+        if(!state.morph_displaced_[i]) {
+            for(size_t j=0;j<vertex_morph_num;++j) {
+                if(!state.vertex_displaced_[indices[j]]) {
+                    state.vertex_displaced_[indices[j]] = true;
+                    state.displaced_vertices_.push_back(indices[j]);
+                }
+            }
+            state.morph_displaced_[i] = true;
+        }
+        /* scatter-add over the contiguous index/offset arrays, unrolled by 4 */
+        size_t j = 0;
+        for(;j+4<=vertex_morph_num;j+=4) {
+            Vector3f &image_0 = vertex_images[indices[j]];
+            image_0 = image_0+offsets[j]*delta;
+            Vector3f &image_1 = vertex_images[indices[j+1]];
+            image_1 = image_1+offsets[j+1]*delta;
+            Vector3f &image_2 = vertex_images[indices[j+2]];
+            image_2 = image_2+offsets[j+2]*delta;
+            Vector3f &image_3 = vertex_images[indices[j+3]];
+            image_3 = image_3+offsets[j+3]*delta;
+        }
+        for(;j<vertex_morph_num;++j) {
+            Vector3f &image = vertex_images[indices[j]];
+            image = image+offsets[j]*delta;
+        }
+        state.applied_morph_rates_[i] = state.leaf_morph_rates_[i];
+    }
+}
+
+inline void Rig::PrePhysicsPosing(PoseState &state) const {
+    for(std::vector<BoneImage>::iterator i = state.bone_images_.begin();i!=state.bone_images_.end();++i) {
+        i->morph_translation_.MakeZero();
+        i->morph_rotation_.q.MakeIdentity();
+
+        i->local_matrix_.MakeIdentity();
+
+        i->pre_ik_rotation_.q.MakeIdentity();
+        i->ik_rotation_.q.MakeIdentity();
+
+        i->total_rotation_.q.MakeIdentity();
+        i->total_translation_.MakeZero();
+    }
+    /* merge every leaf contribution first, then apply each leaf once */
+    std::vector<float> &leaf_morph_rates = state.leaf_morph_rates_;
+    std::fill(leaf_morph_rates.begin(), leaf_morph_rates.end(), 0.0f);
+    for(size_t i=0;i<state.morph_rates_.size();++i) {
+        float rate = state.morph_rates_[i];
+        if(rate<mmd_math_const_eps) {
+            continue;
+        }
+        for(size_t j=morph_leaf_begin_[i];j<morph_leaf_begin_[i+1];++j) {
+            float leaf_rate = morph_leaves_[j].second*rate;
+            if(leaf_rate>=mmd_math_const_eps) {
+                leaf_morph_rates[morph_leaves_[j].first] += leaf_rate;
+            }
+        }
+    }
+    for(size_t i=0;i<leaf_morph_rates.size();++i) {
+        UpdateMorphTransform(state, i, leaf_morph_rates[i]);
+    }
+    UpdateVertexMorph(state);
+    UpdateUVMorph(state);
+    UpdateMaterialMorph(state);
+    UpdateBoneTransform(state, pre_physics_bones_);
+    UpdateBoneSkinningMatrix(state, pre_physics_bones_);
+}
+
+inline void Rig::PostPhysicsPosing(PoseState &state) const {
+    UpdateBoneTransform(state, post_physics_bones_);
+    UpdateBoneSkinningMatrix(state, post_physics_bones_);
+}
+
+inline void Rig::Deform(PoseState &state) const {
+    const std::vector<BoneImage> &bone_images = state.bone_images_;
+    PoseState::PoseImage &pose_image = state.pose_image;
+    size_t vertex_num = model_.GetVertexNum();
+    //for(size_t i=0;i<vertex_num;++i) {
+    //    Model::Vertex<cref> vertex = model_.GetVertex(i);
+    //    pose_image.coordinates[i] = ;
+    //    pose_image.normals[i] = ;
+    //}
+
+    for(size_t i=0;i<vertex_num;++i) {
+        const Model::Vertex<cref> vertex = model_.GetVertex(i);
+        const Model::SkinningOperator& op = vertex.GetSkinningOperator();
+        Vector3f coordinate = vertex.GetCoordinate();
+        if(state.vertex_displaced_[i]) {
+            coordinate = coordinate+state.vertex_images_[i];
+        }
+        const Vector3f &normal = vertex.GetNormal();
+        switch(op.GetSkinningType()) {
+        case Model::SkinningOperator::SKINNING_BDEF1:
+            {
+                const Matrix4f &mat = bone_images[op.GetBDEF1().GetBoneID()].skinning_matrix_;
+                pose_image.coordinates[i] = transform(coordinate, mat);
+                pose_image.normals[i] = rotate(normal, mat);
+            }
+            break;
+        case Model::SkinningOperator::SKINNING_SDEF:
+        case Model::SkinningOperator::SKINNING_BDEF2: default:
+            {
+                const Matrix4f &mat_0 = bone_images[op.GetBDEF2().GetBoneID(0)].skinning_matrix_;
+                const Matrix4f &mat_1 = bone_images[op.GetBDEF2().GetBoneID(1)].skinning_matrix_;
+                Matrix4f mat = Lerp(mat_1, mat_0)[op.GetBDEF2().GetBoneWeight()];
+                pose_image.coordinates[i] = transform(coordinate, mat);
+                pose_image.normals[i] = rotate(normal, mat);
+            }
+            break;
+        case Model::SkinningOperator::SKINNING_BDEF4:
+            {
+                const Matrix4f &mat_0 = bone_images[op.GetBDEF4().GetBoneID(0)].skinning_matrix_;
+                const Matrix4f &mat_1 = bone_images[op.GetBDEF4().GetBoneID(1)].skinning_matrix_;
+                const Matrix4f &mat_2 = bone_images[op.GetBDEF4().GetBoneID(2)].skinning_matrix_;
+                const Matrix4f &mat_3 = bone_images[op.GetBDEF4().GetBoneID(3)].skinning_matrix_;
+                Matrix4f mat = mat_0*op.GetBDEF4().GetBoneWeight(0)+mat_1*op.GetBDEF4().GetBoneWeight(1)+mat_2*op.GetBDEF4().GetBoneWeight(2)+mat_3*op.GetBDEF4().GetBoneWeight(3);
+                pose_image.coordinates[i] = transform(coordinate, mat);
+                pose_image.normals[i] = rotate(normal, mat);
+            }
+            break;
+        //case Model::SkinningOperator::SKINNING_SDEF:
+        //    {
+        //        const Matrix4f &mat_0 = bone_images[op.GetSDEF().GetBoneID(0)].skinning_matrix_;
+        //        const Matrix4f &mat_1 = bone_images[op.GetSDEF().GetBoneID(1)].skinning_matrix_;
+        //        const Vector3f &c = op.GetSDEF().GetC();
+        //        const Vector3f &r0 = op.GetSDEF().GetR0();
+        //        const Vector3f &r1 = op.GetSDEF().GetR1();
+        //        float weight = op.GetSDEF().GetBoneWeight();
+        //        Vector3f rr0 = transform(r0, mat_0);
+        //        Vector3f rr1 = transform(r1, mat_1);
+        //        Vector3f nc0 = transform(c, mat_0);
+        //        Vector3f nc1 = transform(c, mat_1);
+        //        Vector3f lr = Lerp(rr1, rr0)[weight];
+        //        Vector3f nc = Lerp(nc1, nc0)[weight];
+        //        Vector3f rc = lr;
+        //        Matrix4f mat = SLerp(Quaternionf::Identity(), bone_images[op.GetSDEF().GetBoneID(1)].total_rotation_.q)[weight].ToRotateMatrix()*bone_images[op.GetSDEF().GetBoneID(0)].local_matrix_;
+        //        pose_image.coordinates[i] = rotate(coordinate-c, mat)+rc;
+        //        pose_image.normals[i] = rotate(normal, mat);
+        //    }
+        //    break;
+        // UNDONE
+        }
+    }
+}
+
+inline size_t Rig::GetBoneIndex(const std::wstring &name) const {
+    std::map<std::wstring, size_t>::const_iterator i = bone_name_map_.find(name);
+    if(i!=bone_name_map_.end()) {
+        return i->second;
+    }
+    return nil;
+}
+
+inline size_t Rig::GetMorphIndex(const std::wstring &name) const {
+    std::map<std::wstring, size_t>::const_iterator i = morph_name_map_.find(name);
+    if(i!=morph_name_map_.end()) {
+        return i->second;
+    }
+    return nil;
+}
+
+inline size_t Rig::GetIKChainIndex(size_t bone_index) const {
+    return bone_nodes_[bone_index].ik_chain_;
+}
+
+inline size_t Rig::GetIKChainNum() const {
+    return ik_chains_.size();
+}
+
+inline void Rig::SetIKSolver(IKSolverType solver) {
+    for(size_t i=0;i<ik_chains_.size();++i) {
+        SetIKSolver(ik_chains_[i].bone_, solver);
+    }
+}
+
+inline void Rig::SetIKSolver(size_t index, IKSolverType solver) {
+    if(bone_nodes_[index].ik_chain_==nil) {
+        return;
+    }
+    IKChain& chain = ik_chains_[bone_nodes_[index].ik_chain_];
+    const IKLink *links = GetIKLinks(chain);
+    size_t ik_link_num = chain.link_num_;
+    bool chained = ik_link_num>0&&bone_nodes_[chain.target_].parent_==links[0].bone_;
+    bool movable = true;
+    for(size_t i=0;i<ik_link_num;++i) {
+        if(i+1<ik_link_num&&bone_nodes_[links[i].bone_].parent_!=links[i+1].bone_) {
+            chained = false;
+        }
+        if(links[i].fix_type_==IKLink::FIX_ALL) {
+            movable = false;
+        }
+    }
+    bool two_bone = chained&&movable&&ik_link_num==2;
+    bool fabrik = chained&&movable&&ik_link_num>=2;
+    switch(solver) {
+    case IK_SOLVER_TWO_BONE: { chain.solver_ = two_bone?IK_SOLVER_TWO_BONE:IK_SOLVER_CCD; break; }
+    case IK_SOLVER_FABRIK: { chain.solver_ = fabrik?IK_SOLVER_FABRIK:IK_SOLVER_CCD; break; }
+    case IK_SOLVER_AUTO:
+        {
+            if(two_bone) {
+                chain.solver_ = IK_SOLVER_TWO_BONE;
+            } else if(fabrik) {
+                chain.solver_ = IK_SOLVER_FABRIK;
+            } else {
+                chain.solver_ = IK_SOLVER_CCD;
+            }
+            break;
+        }
+    case IK_SOLVER_CCD: default: { chain.solver_ = IK_SOLVER_CCD; break; }
+    }
+}
+
+/** Bones without IK report IK_SOLVER_CCD. **/
+inline Rig::IKSolverType Rig::GetIKSolver(size_t index) const {
+    if(bone_nodes_[index].ik_chain_==nil) {
+        return IK_SOLVER_CCD;
+    }
+    return ik_chains_[bone_nodes_[index].ik_chain_].solver_;
+}
+
+inline const Model& Rig::GetModel() const { return model_; }
+
+inline Rig::BoneNode::BoneNode() : ik_chain_(nil), ik_link_(false) {
+    global_offset_matrix_.MakeIdentity();
+    global_offset_matrix_inv_.MakeIdentity();
+}
+
+inline Rig::BoneNode::TransformOrder::TransformOrder(const Model &model) : model_(&model) {}
+
+inline bool Rig::BoneNode::TransformOrder::operator()(size_t a, size_t b) const {
+    if(model_->GetBone(a).GetTransformLevel()<model_->GetBone(b).GetTransformLevel()) {
+        return true;
+    } else if(model_->GetBone(a).GetTransformLevel()>model_->GetBone(b).GetTransformLevel()) {
+        return false;
+    } else {
+        return a<b;
+    }
+}
+
+inline PoseState::PoseState(const Rig &rig)
+  : ik_warm_start_(false), ik_warm_start_threshold_(1.0f), ik_warm_start_tolerance_(1e-3f) {
+    rig.InitPoseState(*this);
+}
+
+inline void PoseState::SetBonePose(size_t index, const Motion::BonePose& bone_pose) {
+    bone_images_[index].translation_ = bone_pose.GetTranslation();
+    bone_images_[index].rotation_ = bone_pose.GetRotation();
+}
+
+inline void PoseState::SetMorphPose(size_t index, const Motion::MorphPose &morph_pose) {
+    morph_rates_[index] = morph_pose.GetWeight();
+}
+
+inline const PoseState::MaterialImage& PoseState::GetMaterialMulImage(size_t index) const {
+    return material_mul_images_[index];
+}
+
+inline const PoseState::MaterialImage& PoseState::GetMaterialAddImage(size_t index) const {
+    return material_add_images_[index];
+}
+
+inline void PoseState::ClearPoseImageDirty() {
+    pose_image.uv_dirty_begin = pose_image.uv_coords.size();
+    pose_image.uv_dirty_end = 0;
+    for(std::vector<size_t>::iterator i=pose_image.dirty_parts.begin();i!=pose_image.dirty_parts.end();++i) {
+        part_dirty_[*i] = false;
+    }
+    pose_image.dirty_parts.clear();
+}
+
+inline void PoseState::SetIKWarmStart(bool warm_start) {
+    ik_warm_start_ = warm_start;
+    ResetIKWarmStart();
+}
+
+inline bool PoseState::IsIKWarmStart() const {
+    return ik_warm_start_;
+}
+
+inline void PoseState::SetIKWarmStartThreshold(float distance) {
+    ik_warm_start_threshold_ = distance;
+}
+
+inline float PoseState::GetIKWarmStartThreshold() const {
+    return ik_warm_start_threshold_;
+}
+
+inline void PoseState::SetIKWarmStartTolerance(float distance) {
+    ik_warm_start_tolerance_ = distance;
+}
+
+inline float PoseState::GetIKWarmStartTolerance() const {
+    return ik_warm_start_tolerance_;
+}
+
+inline void PoseState::ResetIKWarmStart() {
+    for(std::vector<IKImage>::iterator i=ik_images_.begin();i!=ik_images_.end();++i) {
+        i->warm_valid_ = false;
+    }
+}
+
+inline size_t PoseState::GetIKIterationNum(size_t chain_index) const {
+    return ik_images_[chain_index].iteration_num_;
+}
+
+inline float PoseState::GetIKError(size_t chain_index) const {
+    return ik_images_[chain_index].error_;
+}
+
+inline PoseState::BoneImage::BoneImage() {
+    rotation_.q.MakeIdentity();
+    translation_.MakeZero();
+
+    morph_rotation_.q.MakeIdentity();
+    morph_translation_.MakeZero();
+}
+
+inline PoseState::IKImage::IKImage() : warm_valid_(false), iteration_num_(0), error_(0.0f) {}
+
+inline PoseState::MaterialImage::MaterialImage(float value) {
+    Init(value);
+}
+
+inline void PoseState::MaterialImage::Init(float value) {
+    Vector4f seed;
+    seed.v[0] = seed.v[1] = seed.v[2] = seed.v[3] = shininess_ = edge_size_ = value;
+    diffuse_ = specular_ = ambient_ = edge_color_ = texture_ = sub_texture_ = toon_texture_ = seed;
+}
+
+inline const Vector4f& PoseState::MaterialImage::GetDiffuse() const {
+    return diffuse_;
+}
+
+inline void PoseState::MaterialImage::SetDiffuse(const Vector3f &diffuse) {
+    diffuse_.c = diffuse.c;
+}
+
+inline void PoseState::MaterialImage::SetDiffuse(const Vector4f &diffuse) {
+    diffuse_ = diffuse;
+}
+
+inline const Vector4f& PoseState::MaterialImage::GetSpecular() const {
+    return specular_;
+}
+
+inline void PoseState::MaterialImage::SetSpecular(const Vector3f &specular) {
+    specular_.c = specular.c;
+}
+
+inline void PoseState::MaterialImage::SetSpecular(const Vector4f &specular) {
+    specular_ = specular;
+}
+
+inline const Vector4f& PoseState::MaterialImage::GetAmbient() const {
+    return ambient_;
+}
+
+inline void PoseState::MaterialImage::SetAmbient(const Vector3f &ambient) {
+    ambient_.c = ambient.c;
+}
+
+inline void PoseState::MaterialImage::SetAmbient(const Vector4f &ambient) {
+    ambient_ = ambient;
+}
+
+inline float PoseState::MaterialImage::GetShininess() const {
+    return shininess_;
+}
+
+inline void PoseState::MaterialImage::SetShininess(float shininess) {
+    shininess_ = shininess;
+}
+
+inline const Vector4f& PoseState::MaterialImage::GetEdgeColor() const {
+    return edge_color_;
+}
+
+inline void PoseState::MaterialImage::SetEdgeColor(const Vector3f &edge_color) {
+    edge_color_.c = edge_color.c;
+}
+
+inline void PoseState::MaterialImage::SetEdgeColor(const Vector4f &edge_color) {
+    edge_color_ = edge_color;
+}
+
+inline float PoseState::MaterialImage::GetEdgeSize() const {
+    return edge_size_;
+}
+
+inline void PoseState::MaterialImage::SetEdgeSize(float edge_size) {
+    edge_size_ = edge_size;
+}
+
+inline const Vector4f& PoseState::MaterialImage::GetTexture() const {
+    return texture_;
+}
+
+inline void PoseState::MaterialImage::SetTexture(const Vector3f &texture) {
+    texture_.c = texture.c;
+}
+
+inline void PoseState::MaterialImage::SetTexture(const Vector4f &texture) {
+    texture_ = texture;
+}
+
+inline const Vector4f& PoseState::MaterialImage::GetSubTexture() const {
+    return sub_texture_;
+}
+
+inline void PoseState::MaterialImage::SetSubTexture(const Vector3f &sub_texture) {
+    sub_texture_.c = sub_texture.c;
+}
+
+inline void PoseState::MaterialImage::SetSubTexture(const Vector4f &sub_texture) {
+    sub_texture_ = sub_texture;
+}
+
+inline const Vector4f& PoseState::MaterialImage::GetToonTexture() const {
+    return toon_texture_;
+}
+
+inline void PoseState::MaterialImage::SetToonTexture(const Vector3f &toon_texture) {
+    toon_texture_.c = toon_texture.c;
+}
+
+inline void PoseState::MaterialImage::SetToonTexture(const Vector4f &toon_texture) {
+    toon_texture_ = toon_texture;
+}
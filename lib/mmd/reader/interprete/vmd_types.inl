@@ -41,8 +41,9 @@ namespace mmd {
             float focal_length;
             Vector3f position;
             Vector3f rotation;
+            /* x, y, z, rotation, distance and fov curve as x_0, x_1, y_0, y_1 */
             std::int8_t interpolator[24];
-            float fov;
+            std::uint32_t fov;
             std::uint8_t orthographic;
         };
 
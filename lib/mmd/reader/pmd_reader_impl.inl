@@ -33,8 +33,11 @@ PmdReader::ReadModel(Model &model) {
         model.SetDescription(ShiftJISToUTF16String(header.info.description));
 
         size_t vertex_num = file_.Read<std::uint32_t>();
+        const interprete::pmd_vertex *pvs
+            = file_.ReadSpan<interprete::pmd_vertex>(vertex_num);
+        model.ReserveVertices(vertex_num);
         for(size_t i=0;i<vertex_num;++i) {
-            interprete::pmd_vertex pv = file_.Read<interprete::pmd_vertex>();
+            const interprete::pmd_vertex &pv = pvs[i];
 
             Model::Vertex<ref> vertex = model.NewVertex();
             Model::SkinningOperator &op = vertex.GetSkinningOperator();
@@ -51,10 +54,12 @@ PmdReader::ReadModel(Model &model) {
         }
 
         size_t triangle_num = file_.Read<std::uint32_t>()/3;
+        const std::uint16_t *indices = file_.ReadSpan<std::uint16_t>(triangle_num*3);
+        model.ReserveTriangles(triangle_num);
         for(size_t i=0;i<triangle_num;++i) {
             Vector3D<std::uint32_t> &triangle = model.NewTriangle();
             for(size_t j=0;j<3;++j) {
-                triangle.v[j] = file_.Read<std::uint16_t>();
+                triangle.v[j] = indices[i*3+j];
             }
         }
 
@@ -163,10 +168,9 @@ PmdReader::ReadModel(Model &model) {
         }
 
         size_t bone_num = file_.Read<std::uint16_t>();
-        std::vector<interprete::pmd_bone> raw_bones(bone_num);
-        for(size_t i=0;i<bone_num;++i) {
-            raw_bones[i] = file_.Read<interprete::pmd_bone>();
-        }
+        const interprete::pmd_bone *raw_bone_span
+            = file_.ReadSpan<interprete::pmd_bone>(bone_num);
+        std::vector<interprete::pmd_bone> raw_bones(raw_bone_span, raw_bone_span+bone_num);
 
         // TODO - [1] We need to verify bone topology.
 
@@ -369,11 +373,11 @@ PmdReader::ReadModel(Model &model) {
                 base_morph_index = i;
             }
             morph.SetType(Model::Morph::MORPH_TYPE_VERTEX);
+            const interprete::pmd_face_vertex *fvs
+                = file_.ReadSpan<interprete::pmd_face_vertex>(fp.vertex_num);
+            morph.ReserveVertexMorphs(fp.vertex_num);
             for(size_t j=0;j<fp.vertex_num;++j) {
-                Model::Morph::MorphData::VertexMorph &vertex_morph_data
-                    = morph.NewMorphData().GetVertexMorph();
-                vertex_morph_data.SetVertexIndex(file_.Read<std::uint32_t>());
-                vertex_morph_data.SetOffset(file_.Read<Vector3f>());
+                morph.NewVertexMorph(fvs[j].vertex_index, fvs[j].offset);
             }
         }
 
@@ -385,14 +389,9 @@ PmdReader::ReadModel(Model &model) {
                 }
                 Model::Morph &morph = model.GetMorph(i);
                 for(size_t j=0;j<morph.GetMorphDataNum();++j) {
-                    Model::Morph::MorphData::VertexMorph& vertex_morph_data
-                        = morph.GetMorphData(j).GetVertexMorph();
-                    size_t morph_data_vertex_index
-                        = vertex_morph_data.GetVertexIndex();
-                    vertex_morph_data.SetVertexIndex(
-                        base_morph.GetMorphData(
-                            morph_data_vertex_index
-                        ).GetVertexMorph().GetVertexIndex()
+                    size_t morph_data_vertex_index = morph.GetVertexIndex(j);
+                    morph.SetVertexIndex(
+                        j, base_morph.GetVertexIndex(morph_data_vertex_index)
                     );
                 }
             }
@@ -18,6 +18,11 @@ namespace mmd {
         PmxReader(FileReader &file);
         /*virtual*/ void ReadModel(Model &model);
     private:
+        /* the face section, with indices of byte_size bytes */
+        void ReadTriangles(Model &model, size_t triangle_num, size_t byte_size);
+        template<typename T>
+        static void NewTriangles(Model &model, const T *indices, size_t triangle_num);
+
         FileReader &file_;
     };
 
@@ -13,6 +13,35 @@
 inline
 PmxReader::PmxReader(FileReader &file) : file_(file) {}
 
+template<typename T>
+inline void
+PmxReader::NewTriangles(Model &model, const T *indices, size_t triangle_num) {
+    model.ReserveTriangles(triangle_num);
+    for(size_t i=0;i<triangle_num;++i) {
+        Vector3D<std::uint32_t> &triangle = model.NewTriangle();
+        for(size_t j=0;j<3;++j) {
+            triangle.v[j] = (std::uint32_t)indices[i*3+j];
+        }
+    }
+}
+
+inline void
+PmxReader::ReadTriangles(Model &model, size_t triangle_num, size_t byte_size) {
+    switch(byte_size) {
+    case 1:
+        NewTriangles(model, file_.ReadSpan<std::uint8_t>(triangle_num*3), triangle_num);
+        break;
+    case 2:
+        NewTriangles(model, file_.ReadSpan<std::uint16_t>(triangle_num*3), triangle_num);
+        break;
+    case 4:
+        NewTriangles(model, file_.ReadSpan<std::int32_t>(triangle_num*3), triangle_num);
+        break;
+    default:
+        throw exception(std::string("PmxReader: Invalid byte size"));
+    }
+}
+
 inline void
 PmxReader::ReadModel(Model &model) {
     try {
@@ -48,6 +77,8 @@ PmxReader::ReadModel(Model &model) {
         model.SetDescriptionEn(file_.ReadString(utf8_encoding));
 
         size_t vertex_num = (size_t)file_.Read<std::int32_t>();
+        /* a corrupt count must not reserve more records than the file can hold */
+        model.ReserveVertices(std::min(vertex_num, (size_t)file_.GetRemainedLength()/sizeof(interprete::pmx_vertex_basic)));
         for(size_t i=0;i<vertex_num;++i) {
             interprete::pmx_vertex_basic pv
                 = file_.Read<interprete::pmx_vertex_basic>();
@@ -102,12 +133,7 @@ PmxReader::ReadModel(Model &model) {
         }
 
         size_t triangle_num = (size_t)file_.Read<std::int32_t>()/3;
-        for(size_t i=0;i<triangle_num;++i) {
-            Vector3D<std::uint32_t> &triangle = model.NewTriangle();
-            for(size_t j=0;j<3;++j) {
-                triangle.v[j] = (std::uint32_t)file_.ReadIndex(vertex_index_size);
-            }
-        }
+        ReadTriangles(model, triangle_num, vertex_index_size);
 
         TextureRegistry &registry = MMD::GetMMD().GetTextureRegistry();
         std::wstring model_file_loc = file_.GetLocation();
@@ -280,32 +306,24 @@ PmxReader::ReadModel(Model &model) {
             switch(morph.GetType()) {
             case Model::Morph::MORPH_TYPE_GROUP:
                 for(size_t j=0;j<morph_data_num;++j) {
-                    Model::Morph::MorphData &morph_data = morph.NewMorphData();
-                    morph_data.GetGroupMorph().SetMorphIndex(
-                        file_.ReadIndex(morph_index_size)
-                    );
-                    morph_data.GetGroupMorph().SetMorphRate(file_.Read<float>());
+                    Model::Morph::GroupMorph &group_morph = morph.NewGroupMorph();
+                    group_morph.SetMorphIndex(file_.ReadIndex(morph_index_size));
+                    group_morph.SetMorphRate(file_.Read<float>());
                 }
                 break;
             case Model::Morph::MORPH_TYPE_VERTEX:
+                morph.ReserveVertexMorphs(std::min(morph_data_num, (size_t)file_.GetRemainedLength()/(vertex_index_size+sizeof(Vector3f))));
                 for(size_t j=0;j<morph_data_num;++j) {
-                    Model::Morph::MorphData &morph_data = morph.NewMorphData();
-                    morph_data.GetVertexMorph().SetVertexIndex(
-                        file_.ReadIndex(vertex_index_size)
-                    );
-                    morph_data.GetVertexMorph().SetOffset(file_.Read<Vector3f>());
+                    size_t vertex_index = file_.ReadIndex(vertex_index_size);
+                    morph.NewVertexMorph(vertex_index, file_.Read<Vector3f>());
                 }
                 break;
             case Model::Morph::MORPH_TYPE_BONE:
                 for(size_t j=0;j<morph_data_num;++j) {
-                    Model::Morph::MorphData &morph_data = morph.NewMorphData();
-                    morph_data.GetBoneMorph().SetBoneIndex(
-                        file_.ReadIndex(bone_index_size)
-                    );
-                    morph_data.GetBoneMorph().SetTranslation(
-                        file_.Read<Vector3f>()
-                    );
-                    morph_data.GetBoneMorph().SetRotation(file_.Read<Vector4f>());
+                    Model::Morph::BoneMorph &bone_morph = morph.NewBoneMorph();
+                    bone_morph.SetBoneIndex(file_.ReadIndex(bone_index_size));
+                    bone_morph.SetTranslation(file_.Read<Vector3f>());
+                    bone_morph.SetRotation(file_.Read<Vector4f>());
                 }
                 break;
             case Model::Morph::MORPH_TYPE_UV:
@@ -314,41 +332,40 @@ PmxReader::ReadModel(Model &model) {
             case Model::Morph::MORPH_TYPE_EXT_UV_3:
             case Model::Morph::MORPH_TYPE_EXT_UV_4:
                 for(size_t j=0;j<morph_data_num;++j) {
-                    Model::Morph::MorphData &morph_data = morph.NewMorphData();
-                    morph_data.GetUVMorph().SetVertexIndex(
-                        file_.ReadIndex(vertex_index_size)
-                    );
-                    morph_data.GetUVMorph().SetOffset(file_.Read<Vector4f>());
+                    Model::Morph::UVMorph &uv_morph = morph.NewUVMorph();
+                    uv_morph.SetVertexIndex(file_.ReadIndex(vertex_index_size));
+                    uv_morph.SetOffset(file_.Read<Vector4f>());
                 }
                 break;
             case Model::Morph::MORPH_TYPE_MATERIAL:
                 for(size_t j=0;j<morph_data_num;++j) {
-                    Model::Morph::MorphData &morph_data = morph.NewMorphData();
+                    Model::Morph::MaterialMorph &material_morph
+                        = morph.NewMaterialMorph();
                     size_t mm_index = file_.ReadIndex(material_index_size);
-                    if(mm_index<model.GetBoneNum()) {
-                        morph_data.GetMaterialMorph().SetMaterialIndex(mm_index);
-                        morph_data.GetMaterialMorph().SetGlobal(false);
+                    if(mm_index<model.GetPartNum()) {
+                        material_morph.SetMaterialIndex(mm_index);
+                        material_morph.SetGlobal(false);
                     } else {
-                        morph_data.GetMaterialMorph().SetMaterialIndex(0);
-                        morph_data.GetMaterialMorph().SetGlobal(true);
+                        material_morph.SetMaterialIndex(0);
+                        material_morph.SetGlobal(true);
                     }
                     interprete::pmx_material_morph pmm
                         = file_.Read<interprete::pmx_material_morph>();
-                    morph_data.GetMaterialMorph().SetMethod(
-                        (Model::Morph::MorphData::MaterialMorph::MaterialMorphMethod)
+                    material_morph.SetMethod(
+                        (Model::Morph::MaterialMorph::MaterialMorphMethod)
                             pmm.offset_type
                     );
-                    morph_data.GetMaterialMorph().SetDiffuse(pmm.diffuse);
-                    morph_data.GetMaterialMorph().SetSpecular(pmm.specular);
-                    morph_data.GetMaterialMorph().SetAmbient(pmm.ambient);
-                    morph_data.GetMaterialMorph().SetShininess(pmm.shininess);
-                    morph_data.GetMaterialMorph().SetEdgeColor(pmm.edge_color);
-                    morph_data.GetMaterialMorph().SetEdgeSize(pmm.edge_size);
-                    morph_data.GetMaterialMorph().SetTexture(pmm.texture_shift);
-                    morph_data.GetMaterialMorph().SetSubTexture(
+                    material_morph.SetDiffuse(pmm.diffuse);
+                    material_morph.SetSpecular(pmm.specular);
+                    material_morph.SetAmbient(pmm.ambient);
+                    material_morph.SetShininess(pmm.shininess);
+                    material_morph.SetEdgeColor(pmm.edge_color);
+                    material_morph.SetEdgeSize(pmm.edge_size);
+                    material_morph.SetTexture(pmm.texture_shift);
+                    material_morph.SetSubTexture(
                         pmm.sub_texture_shift
                     );
-                    morph_data.GetMaterialMorph().SetToonTexture(pmm.toon_shift);
+                    material_morph.SetToonTexture(pmm.toon_shift);
                 }
                 break;
             default:
@@ -19,6 +19,34 @@ namespace mmd {
         /*virtual*/ void ReadMotion(Motion &motion);
         /*virtual*/ void ReadCameraMotion(CameraMotion &camera_motion);
     private:
+        /* last raw curve seen on one channel and its id */
+        struct CurveCache {
+            CurveCache();
+            std::int8_t raw_[4];
+            std::uint16_t curve_;
+        };
+
+        template<typename T>
+        struct FrameLess {
+            FrameLess(const T *records) : records_(records) {}
+            bool operator()(size_t a, size_t b) const { return records_[a].nframe<records_[b].nframe; }
+            const T *records_;
+        };
+
+        /**
+          Groups records (stride bytes apart, each starting with a 15-byte
+          name) by name. Group i is order[begins[i], begins[i+1]) in file
+          order and is named names[i].
+        **/
+        static void GroupByName(
+            const void *records, size_t stride, size_t num,
+            std::vector<std::string> &names, std::vector<size_t> &begins,
+            std::vector<size_t> &order
+        );
+        static std::uint16_t InternCurve(
+            Motion &motion, const std::int8_t *interpolator, CurveCache &cache
+        );
+
         FileReader &file_;
         mutable size_t camera_motion_shift_;
         mutable size_t light_motion_shift_;
@@ -6,6 +6,70 @@
             http://www.boost.org/LICENSE_1_0.txt)
 **/
 
+inline VmdReader::CurveCache::CurveCache() : curve_(Motion::LINEAR_CURVE) {
+    /* the raw form of the linear curve */
+    raw_[0] = raw_[1] = 20;
+    raw_[2] = raw_[3] = 107;
+}
+
+inline void VmdReader::GroupByName(
+    const void *records, size_t stride, size_t num,
+    std::vector<std::string> &names, std::vector<size_t> &begins,
+    std::vector<size_t> &order
+) {
+    names.clear();
+    std::vector<size_t> groups(num);
+    std::vector<size_t> counts;
+    std::map<std::string, size_t> group_map;
+    const char *last_name = NULL;
+    for(size_t i=0;i<num;++i) {
+        const char *name = static_cast<const char*>(records)+i*stride;
+        /* records of one name mostly come in runs */
+        if(last_name!=NULL&&std::memcmp(name, last_name, 15)==0) {
+            groups[i] = groups[i-1];
+        } else {
+            const void *end = std::memchr(name, 0, 15);
+            std::string key(name, end!=NULL?static_cast<const char*>(end):name+15);
+            std::map<std::string, size_t>::const_iterator it = group_map.find(key);
+            if(it!=group_map.end()) {
+                groups[i] = it->second;
+            } else {
+                groups[i] = names.size();
+                group_map.insert(std::make_pair(key, names.size()));
+                names.push_back(key);
+                counts.push_back(0);
+            }
+            last_name = name;
+        }
+        ++counts[groups[i]];
+    }
+
+    begins.assign(names.size()+1, 0);
+    for(size_t i=0;i<names.size();++i) {
+        begins[i+1] = begins[i]+counts[i];
+    }
+    order.resize(num);
+    std::vector<size_t> ends(begins.begin(), begins.end()-1);
+    for(size_t i=0;i<num;++i) {
+        order[ends[groups[i]]++] = i;
+    }
+}
+
+inline std::uint16_t VmdReader::InternCurve(Motion &motion, const std::int8_t *interpolator, CurveCache &cache) {
+    std::int8_t raw[4] = { interpolator[0], interpolator[4], interpolator[8], interpolator[12] };
+    if(std::memcmp(raw, cache.raw_, 4)!=0) {
+        const float r = 1.0f/127.0f;
+        Vector2f c_0, c_1;
+        c_0.p.x = raw[0]*r;
+        c_0.p.y = raw[1]*r;
+        c_1.p.x = raw[2]*r;
+        c_1.p.y = raw[3]*r;
+        cache.curve_ = motion.InternCurve(c_0, c_1);
+        std::memcpy(cache.raw_, raw, 4);
+    }
+    return cache.curve_;
+}
+
 inline void VmdReader::ReadMotion(Motion &motion) {
     try {
         file_.Reset();
@@ -22,51 +86,60 @@ inline void VmdReader::ReadMotion(Motion &motion) {
         motion.SetName(ShiftJISToUTF16String(header.name));
 
         size_t bone_motion_num = file_.Read<std::uint32_t>();
+        const interprete::vmd_bone *bones
+            = file_.ReadSpan<interprete::vmd_bone>(bone_motion_num);
 
-        for(size_t i=0;i<bone_motion_num;++i) {
-            interprete::vmd_bone b = file_.Read<interprete::vmd_bone>();
-            Motion::BoneKeyframe &keyframe = motion.GetBoneKeyframe(ShiftJISToUTF16String(b.bone_name), b.nframe);
-            keyframe.SetTranslation(b.translation);
-            keyframe.SetRotation(b.rotation);
-
-            Vector2f c_0, c_1;
-            const float r = 1.0f/127.0f;
-
-            c_0.p.x = b.x_interpolator[0]*r;
-            c_0.p.y = b.x_interpolator[4]*r;
-            c_1.p.x = b.x_interpolator[8]*r;
-            c_1.p.y = b.x_interpolator[12]*r;
-            interpolator &x_interpolator = keyframe.GetXInterpolator();
-            x_interpolator.SetC(c_0, c_1);
-
-            c_0.p.x = b.y_interpolator[0]*r;
-            c_0.p.y = b.y_interpolator[4]*r;
-            c_1.p.x = b.y_interpolator[8]*r;
-            c_1.p.y = b.y_interpolator[12]*r;
-            interpolator &y_interpolator = keyframe.GetYInterpolator();
-            y_interpolator.SetC(c_0, c_1);
-
-            c_0.p.x = b.z_interpolator[0]*r;
-            c_0.p.y = b.z_interpolator[4]*r;
-            c_1.p.x = b.z_interpolator[8]*r;
-            c_1.p.y = b.z_interpolator[12]*r;
-            interpolator &z_interpolator = keyframe.GetZInterpolator();
-            z_interpolator.SetC(c_0, c_1);
-
-            c_0.p.x = b.r_interpolator[0]*r;
-            c_0.p.y = b.r_interpolator[4]*r;
-            c_1.p.x = b.r_interpolator[8]*r;
-            c_1.p.y = b.r_interpolator[12]*r;
-            interpolator &r_interpolator = keyframe.GetRInterpolator();
-            r_interpolator.SetC(c_0, c_1);
+        size_t morph_motion_num = file_.Read<std::uint32_t>();
+        const interprete::vmd_morph *morphs
+            = file_.ReadSpan<interprete::vmd_morph>(morph_motion_num);
+
+        std::vector<std::string> names;
+        std::vector<size_t> begins;
+        std::vector<size_t> order;
+
+        std::vector<std::uint32_t> frames;
+        std::vector<Vector3f> translations;
+        std::vector<Vector4f> rotations;
+        std::vector<float> weights;
+        std::vector<std::uint16_t> curves;
+
+        CurveCache caches[4];
+        GroupByName(bones, sizeof(interprete::vmd_bone), bone_motion_num, names, begins, order);
+        for(size_t i=0;i<names.size();++i) {
+            std::vector<size_t>::iterator first = order.begin()+begins[i], last = order.begin()+begins[i+1];
+            /* stable, so of two keyframes at one frame the later in the file wins */
+            std::stable_sort(first, last, FrameLess<interprete::vmd_bone>(bones));
+            size_t num = last-first;
+            frames.resize(num);
+            translations.resize(num);
+            rotations.resize(num);
+            curves.resize(num*4);
+            for(size_t j=0;j<num;++j) {
+                const interprete::vmd_bone &b = bones[first[j]];
+                frames[j] = b.nframe;
+                translations[j] = b.translation;
+                rotations[j] = b.rotation;
+                curves[j*4] = InternCurve(motion, b.x_interpolator, caches[0]);
+                curves[j*4+1] = InternCurve(motion, b.y_interpolator, caches[1]);
+                curves[j*4+2] = InternCurve(motion, b.z_interpolator, caches[2]);
+                curves[j*4+3] = InternCurve(motion, b.r_interpolator, caches[3]);
+            }
+            motion.SetBoneKeyframes(ShiftJISToUTF16String(names[i]), num, &frames[0], &translations[0], &rotations[0], &curves[0]);
         }
 
-        size_t morph_motion_num = file_.Read<std::uint32_t>();
-        
-        for(size_t i=0;i<morph_motion_num;++i) {
-            interprete::vmd_morph m = file_.Read<interprete::vmd_morph>();
-            Motion::MorphKeyframe &keyframe = motion.GetMorphKeyframe(ShiftJISToUTF16String(m.morph_name), m.nframe);
-            keyframe.SetWeight(m.weight);
+        GroupByName(morphs, sizeof(interprete::vmd_morph), morph_motion_num, names, begins, order);
+        for(size_t i=0;i<names.size();++i) {
+            std::vector<size_t>::iterator first = order.begin()+begins[i], last = order.begin()+begins[i+1];
+            std::stable_sort(first, last, FrameLess<interprete::vmd_morph>(morphs));
+            size_t num = last-first;
+            frames.resize(num);
+            weights.resize(num);
+            curves.assign(num, Motion::LINEAR_CURVE);
+            for(size_t j=0;j<num;++j) {
+                frames[j] = morphs[first[j]].nframe;
+                weights[j] = morphs[first[j]].weight;
+            }
+            motion.SetMorphKeyframes(ShiftJISToUTF16String(names[i]), num, &frames[0], &weights[0], &curves[0]);
         }
 
         camera_motion_shift_ = file_.GetPosition();
@@ -94,11 +167,27 @@ inline void VmdReader::ReadCameraMotion(CameraMotion &camera_motion) {
         for(size_t i=0;i<camera_motion_num;++i) {
             interprete::vmd_camera c = file_.Read<interprete::vmd_camera>();
             CameraMotion::CameraKeyframe &keyframe = camera_motion.GetCameraKeyframe(c.nframe);
-            keyframe.SetFOV(c.fov);
+            keyframe.SetFOV((float)c.fov);
             keyframe.SetFocalLength(c.focal_length);
             keyframe.SetOrthographic(c.orthographic!=0);
             keyframe.SetPosition(c.position);
             keyframe.SetRotation(c.rotation);
+
+            interpolator *curves[6] = {
+                &keyframe.GetXInterpolator(), &keyframe.GetYInterpolator(),
+                &keyframe.GetZInterpolator(), &keyframe.GetRInterpolator(),
+                &keyframe.GetFocalLengthInterpolator(), &keyframe.GetFOVInterpolator()
+            };
+            const float r = 1.0f/127.0f;
+            for(size_t j=0;j<6;++j) {
+                const std::int8_t *p = c.interpolator+j*4;
+                Vector2f c_0, c_1;
+                c_0.p.x = p[0]*r;
+                c_0.p.y = p[2]*r;
+                c_1.p.x = p[1]*r;
+                c_1.p.y = p[3]*r;
+                curves[j]->SetC(c_0, c_1);
+            }
         }
     } catch(std::exception& e) {
         throw exception(std::string("VmdReader::ReadCameraMotion: Exception caught."), e);
@@ -14,6 +14,16 @@ namespace mmd {
     class CameraMotion {
     public:
         class CameraPose {
+        public:
+            CameraPose(
+                float fov, float focal_length, const Vector3f &position,
+                const Vector3f &rotation, bool orthographic
+            );
+            float GetFOV() const;
+            float GetFocalLength() const;
+            const Vector3f &GetPosition() const;
+            const Vector3f &GetRotation() const;
+            bool IsOrthographic() const;
         private:
             float fov_;
             float focal_length_;
@@ -39,6 +49,20 @@ namespace mmd {
             const Vector3f &GetRotation() const;
             void SetRotation(const Vector3f &rotation);
 
+            /** The rotation curve is shared by all three angles. **/
+            const interpolator &GetXInterpolator() const;
+            interpolator &GetXInterpolator();
+            const interpolator &GetYInterpolator() const;
+            interpolator &GetYInterpolator();
+            const interpolator &GetZInterpolator() const;
+            interpolator &GetZInterpolator();
+            const interpolator &GetRInterpolator() const;
+            interpolator &GetRInterpolator();
+            const interpolator &GetFocalLengthInterpolator() const;
+            interpolator &GetFocalLengthInterpolator();
+            const interpolator &GetFOVInterpolator() const;
+            interpolator &GetFOVInterpolator();
+
         private:
             float fov_;
             float focal_length_;
@@ -49,9 +73,9 @@ namespace mmd {
             interpolator x_interpolator_;
             interpolator y_interpolator_;
             interpolator z_interpolator_;
-            interpolator rx_interpolator_;
-            interpolator ry_interpolator_;
-            interpolator rz_interpolator_;
+            interpolator r_interpolator_;
+            interpolator focal_length_interpolator_;
+            interpolator fov_interpolator_;
 
             bool orthographic_;
         };
@@ -59,17 +83,42 @@ namespace mmd {
         CameraMotion();
 
         const CameraKeyframe &GetCameraKeyframe(size_t frame) const;
+        /**
+          Inserts a keyframe if there is none at the frame. The reference
+          is invalidated by the next insertion.
+        **/
         CameraKeyframe &GetCameraKeyframe(size_t frame);
 
+        /**
+          Keyframes are kept sorted by frame in one array, and Locate()
+          is LocateKeyframe() over it, as for Motion::KeyframeTrack.
+        **/
+        size_t GetKeyframeNum() const;
+        size_t GetFrame(size_t index) const;
+        const CameraKeyframe &GetKeyframe(size_t index) const;
+        size_t Locate(size_t frame, size_t &cursor) const;
+
         CameraPose GetCameraPose(size_t frame) const;
         CameraPose GetCameraPose(double time) const;
 
+        /** Sequential sampling, see Locate(). **/
+        CameraPose GetCameraPose(size_t frame, size_t &cursor) const;
+        CameraPose GetCameraPose(double time, size_t &cursor) const;
+
         size_t GetLength() const;
         void Clear();
 
+        /** See Motion::GetFrameRate(). **/
+        double GetFrameRate() const;
+        void SetFrameRate(double frame_rate);
+
     private:
+        CameraPose InterpolateCameraPose(size_t left, float bary_pos) const;
+
         size_t length_;
-        std::map<size_t, CameraKeyframe> camera_motions_;
+        double frame_rate_;
+        std::vector<std::uint32_t> frames_;
+        std::vector<CameraKeyframe> keyframes_;
     };
 
 #include "camera_impl.inl"
@@ -6,6 +6,38 @@
             http://www.boost.org/LICENSE_1_0.txt)
 **/
 
+inline
+CameraMotion::CameraPose::CameraPose(
+    float fov, float focal_length, const Vector3f &position,
+    const Vector3f &rotation, bool orthographic
+) : fov_(fov), focal_length_(focal_length), position_(position),
+    rotation_(rotation), orthographic_(orthographic) {}
+
+inline float
+CameraMotion::CameraPose::GetFOV() const {
+    return fov_;
+}
+
+inline float
+CameraMotion::CameraPose::GetFocalLength() const {
+    return focal_length_;
+}
+
+inline const Vector3f&
+CameraMotion::CameraPose::GetPosition() const {
+    return position_;
+}
+
+inline const Vector3f&
+CameraMotion::CameraPose::GetRotation() const {
+    return rotation_;
+}
+
+inline bool
+CameraMotion::CameraPose::IsOrthographic() const {
+    return orthographic_;
+}
+
 inline float
 CameraMotion::CameraKeyframe::GetFOV() const {
     return fov_;
@@ -56,12 +88,72 @@ CameraMotion::CameraKeyframe::SetRotation(const Vector3f &rotation) {
     rotation_ = rotation;
 }
 
+inline const interpolator&
+CameraMotion::CameraKeyframe::GetXInterpolator() const {
+    return x_interpolator_;
+}
+
+inline interpolator&
+CameraMotion::CameraKeyframe::GetXInterpolator() {
+    return x_interpolator_;
+}
+
+inline const interpolator&
+CameraMotion::CameraKeyframe::GetYInterpolator() const {
+    return y_interpolator_;
+}
+
+inline interpolator&
+CameraMotion::CameraKeyframe::GetYInterpolator() {
+    return y_interpolator_;
+}
+
+inline const interpolator&
+CameraMotion::CameraKeyframe::GetZInterpolator() const {
+    return z_interpolator_;
+}
+
+inline interpolator&
+CameraMotion::CameraKeyframe::GetZInterpolator() {
+    return z_interpolator_;
+}
+
+inline const interpolator&
+CameraMotion::CameraKeyframe::GetRInterpolator() const {
+    return r_interpolator_;
+}
+
+inline interpolator&
+CameraMotion::CameraKeyframe::GetRInterpolator() {
+    return r_interpolator_;
+}
+
+inline const interpolator&
+CameraMotion::CameraKeyframe::GetFocalLengthInterpolator() const {
+    return focal_length_interpolator_;
+}
+
+inline interpolator&
+CameraMotion::CameraKeyframe::GetFocalLengthInterpolator() {
+    return focal_length_interpolator_;
+}
+
+inline const interpolator&
+CameraMotion::CameraKeyframe::GetFOVInterpolator() const {
+    return fov_interpolator_;
+}
+
+inline interpolator&
+CameraMotion::CameraKeyframe::GetFOVInterpolator() {
+    return fov_interpolator_;
+}
+
 inline
-CameraMotion::CameraMotion() : length_(0) {}
+CameraMotion::CameraMotion() : length_(0), frame_rate_(MMD_FRAME_RATE) {}
 
 inline const CameraMotion::CameraKeyframe&
 CameraMotion::GetCameraKeyframe(size_t frame) const {
-    return camera_motions_.find(frame)->second;
+    return keyframes_[std::lower_bound(frames_.begin(), frames_.end(), frame)-frames_.begin()];
 }
 
 inline CameraMotion::CameraKeyframe&
@@ -69,11 +161,138 @@ CameraMotion::GetCameraKeyframe(size_t frame) {
     if(frame>length_) {
         length_ = frame;
     }
-    return camera_motions_[frame];
+    /* keyframes mostly arrive in order, which appends */
+    if(frames_.empty()||frames_.back()<frame) {
+        frames_.push_back(std::uint32_t(frame));
+        keyframes_.push_back(CameraKeyframe());
+        return keyframes_.back();
+    }
+    std::vector<std::uint32_t>::iterator i = std::lower_bound(frames_.begin(), frames_.end(), frame);
+    size_t index = i-frames_.begin();
+    if(*i!=frame) {
+        frames_.insert(i, std::uint32_t(frame));
+        keyframes_.insert(keyframes_.begin()+index, CameraKeyframe());
+    }
+    return keyframes_[index];
+}
+
+inline size_t
+CameraMotion::GetKeyframeNum() const {
+    return frames_.size();
+}
+
+inline size_t
+CameraMotion::GetFrame(size_t index) const {
+    return frames_[index];
+}
+
+inline const CameraMotion::CameraKeyframe&
+CameraMotion::GetKeyframe(size_t index) const {
+    return keyframes_[index];
+}
+
+inline size_t
+CameraMotion::Locate(size_t frame, size_t &cursor) const {
+    return LocateKeyframe(frames_.empty()?NULL:&frames_[0], frames_.size(), frame, cursor);
+}
+
+inline CameraMotion::CameraPose
+CameraMotion::GetCameraPose(size_t frame) const {
+    size_t cursor = nil;
+    return GetCameraPose(frame, cursor);
+}
+
+inline CameraMotion::CameraPose
+CameraMotion::GetCameraPose(double time) const {
+    size_t cursor = nil;
+    return GetCameraPose(time, cursor);
+}
+
+inline CameraMotion::CameraPose
+CameraMotion::GetCameraPose(size_t frame, size_t &cursor) const {
+    size_t n = frames_.size();
+    if(n==0) {
+        Vector3f position, rotation;
+        position.MakeZero();
+        rotation.MakeZero();
+        return CameraPose(30.0f, 0.0f, position, rotation, false);
+    }
+
+    if(frames_[0]>=frame) {
+        return InterpolateCameraPose(0, 0.0f);
+    } else if(frames_[n-1]<=frame) {
+        return InterpolateCameraPose(n-1, 0.0f);
+    } else {
+        size_t left = Locate(frame, cursor);
+        size_t left_frame = frames_[left];
+        size_t right_frame = frames_[left+1];
+        float bary_pos = (
+            (float)(frame-left_frame)/(float)(right_frame-left_frame)
+        );
+        return InterpolateCameraPose(left, bary_pos);
+    }
 }
 
-//inline CameraPose CameraMotion::GetCameraPose(size_t frame) const;
-//inline CameraPose CameraMotion::GetCameraPose(double time) const;
+inline CameraMotion::CameraPose
+CameraMotion::GetCameraPose(double time, size_t &cursor) const {
+    size_t n = frames_.size();
+    if(n==0) {
+        return GetCameraPose(size_t(0), cursor);
+    }
+
+    double dframe = time * frame_rate_;
+
+    if(frames_[0]>=dframe) {
+        return InterpolateCameraPose(0, 0.0f);
+    } else if(frames_[n-1]<=dframe) {
+        return InterpolateCameraPose(n-1, 0.0f);
+    } else {
+        size_t left = Locate(size_t(dframe), cursor);
+        size_t left_frame = frames_[left];
+        size_t right_frame = frames_[left+1];
+        float bary_pos
+            = (float)((dframe-left_frame)/(right_frame-left_frame));
+        return InterpolateCameraPose(left, bary_pos);
+    }
+}
+
+inline CameraMotion::CameraPose
+CameraMotion::InterpolateCameraPose(size_t left, float bary_pos) const {
+    const CameraKeyframe &l = keyframes_[left];
+    if(bary_pos==0.0f) {
+        return CameraPose(
+            l.GetFOV(), l.GetFocalLength(), l.GetPosition(),
+            l.GetRotation(), l.IsOrthographic()
+        );
+    }
+    /* a segment follows the curves of the keyframe it starts from, as in Motion */
+    const CameraKeyframe &r = keyframes_[left+1];
+    const Vector3f &l_position = l.GetPosition();
+    const Vector3f &r_position = r.GetPosition();
+    const Vector3f &l_rotation = l.GetRotation();
+    const Vector3f &r_rotation = r.GetRotation();
+
+    float lambda;
+    Vector3f position, rotation;
+
+    lambda = l.GetXInterpolator()[bary_pos];
+    position.p.x = l_position.p.x*(1-lambda)+r_position.p.x*lambda;
+    lambda = l.GetYInterpolator()[bary_pos];
+    position.p.y = l_position.p.y*(1-lambda)+r_position.p.y*lambda;
+    lambda = l.GetZInterpolator()[bary_pos];
+    position.p.z = l_position.p.z*(1-lambda)+r_position.p.z*lambda;
+
+    lambda = l.GetRInterpolator()[bary_pos];
+    rotation = l_rotation*(1-lambda)+r_rotation*lambda;
+
+    lambda = l.GetFocalLengthInterpolator()[bary_pos];
+    float focal_length = l.GetFocalLength()*(1-lambda)+r.GetFocalLength()*lambda;
+
+    lambda = l.GetFOVInterpolator()[bary_pos];
+    float fov = l.GetFOV()*(1-lambda)+r.GetFOV()*lambda;
+
+    return CameraPose(fov, focal_length, position, rotation, l.IsOrthographic());
+}
 
 inline size_t
 CameraMotion::GetLength() const {
@@ -83,5 +302,17 @@ CameraMotion::GetLength() const {
 inline void
 CameraMotion::Clear() {
     length_ = 0;
-    camera_motions_.clear();
+    frame_rate_ = MMD_FRAME_RATE;
+    frames_.clear();
+    keyframes_.clear();
+}
+
+inline double
+CameraMotion::GetFrameRate() const {
+    return frame_rate_;
+}
+
+inline void
+CameraMotion::SetFrameRate(double frame_rate) {
+    frame_rate_ = frame_rate;
 }
@@ -68,23 +68,33 @@ namespace mmd {
     };
 #include "unpack.inc"
 
+    /**
+      Reads a whole file, from a read-only memory mapping when mapped is
+      set and MMD_USE_MMAP is defined, or else (and when mapping fails)
+      from a heap buffer. ReadSpan() returns the next count values in
+      place, without copying; they stay valid while the reader lives.
+    **/
     class FileReader
     {
     public:
         FileReader();
 
-        FileReader(const std::string &filename);
-        FileReader(const std::wstring &filename);
+        FileReader(const std::string &filename, bool mapped = true);
+        FileReader(const std::wstring &filename, bool mapped = true);
+        ~FileReader();
 
         static bool FileExists(const std::wstring &filename);
 
         template<typename T> T Read();
+        template<typename T> const T *ReadSpan(size_t count);
         size_t ReadIndex(size_t byte_size);
         std::string ReadAnsiString();
         std::wstring ReadString(bool utf8 = false);
 
+        bool IsMapped() const;
+        const std::uint8_t *GetData() const;
+        /** Copies a mapped file into the buffer and unmaps it first. **/
         buffer_type& GetBuffer();
-        const buffer_type& GetBuffer() const;
         void Reset();
 
         const std::wstring& GetPath() const;
@@ -97,17 +107,32 @@ namespace mmd {
         size_t GetPosition() const;
         ptrdiff_t GetRemainedLength() const;
     private:
-        void Initialize();
+        FileReader(const FileReader&);
+        FileReader &operator=(const FileReader&);
+
+        void Initialize(bool mapped);
+        void Unmap();
         std::wstring path_;
         buffer_type buffer_;
+        /* NULL unless the file is mapped */
+        std::uint8_t *mapping_;
+        size_t mapping_length_;
         size_t cursor_;
     };
 
+    /**
+      Text conversions. They keep their converters and locales per thread,
+      so they are safe to call from several threads and never touch the
+      global locale. ASCII text is copied without conversion. The UTF-16
+      strings hold code units and carry no byte order mark.
+    **/
     std::string UTF16ToNativeString(const std::wstring &ws);
     std::wstring NativeToUTF16String(const std::string &s);
     std::wstring UTF8ToUTF16String(const std::string &s);
     std::wstring ShiftJISToUTF16String(const std::string &s);
 
+    bool IsASCIIString(const std::string &s);
+
 #include "dwarf_impl.inl"
 
 } /* End of namespace mmd */
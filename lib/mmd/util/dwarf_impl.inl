@@ -28,7 +28,35 @@ template<size_t length> inline mmd_string<length>::operator std::string () const
     return std::string(buffer);
 }
 
-inline void FileReader::Initialize() {
+inline void FileReader::Initialize(bool mapped) {
+#ifdef MMD_USE_MMAP
+    if(mapped) {
+        int fd = open(UTF16ToNativeString(path_).c_str(), O_RDONLY);
+        if(fd<0) {
+            throw exception(std::string("FileReader: Cannot open file."));
+        }
+        struct stat st;
+        if(fstat(fd, &st)!=0) {
+            close(fd);
+            throw exception(std::string("FileReader: Cannot open file."));
+        }
+        if(st.st_size==0) {
+            close(fd);
+            throw exception(std::string("FileReader: File is empty."));
+        }
+        void *mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(mapping!=MAP_FAILED) {
+            mapping_ = static_cast<std::uint8_t*>(mapping);
+            mapping_length_ = (size_t)st.st_size;
+            return;
+        }
+        /* not mappable (a pipe, say), read it instead */
+    }
+#else
+    _unused(mapped);
+#endif
+
 #ifdef MMD_WINDOWS
     FILE *f = _wfopen(path_.c_str(), L"rb");
 #else
@@ -44,21 +72,40 @@ inline void FileReader::Initialize() {
         throw exception(std::string("FileReader: File is empty."));
     }
     fseek(f, 0, SEEK_SET);
-    buffer_.assign(file_length, 0);
-    fread(&buffer_[0], 1, file_length, f);
+    buffer_.resize(file_length);
+    size_t read_length = fread(&buffer_[0], 1, file_length, f);
     fclose(f);
+    if(read_length!=file_length) {
+        throw exception(std::string("FileReader: Cannot read file."));
+    }
+}
+
+inline void FileReader::Unmap() {
+#ifdef MMD_USE_MMAP
+    if(mapping_!=NULL) {
+        munmap(mapping_, mapping_length_);
+        mapping_ = NULL;
+        mapping_length_ = 0;
+    }
+#endif
 }
 
-inline FileReader::FileReader() : cursor_(0) {}
+inline FileReader::FileReader() : mapping_(NULL), mapping_length_(0), cursor_(0) {}
 
-inline FileReader::FileReader(const std::string &filename) : path_(NativeToUTF16String(filename)), cursor_(0)
+inline FileReader::FileReader(const std::string &filename, bool mapped)
+  : path_(NativeToUTF16String(filename)), mapping_(NULL), mapping_length_(0), cursor_(0)
 {
-    Initialize();
+    Initialize(mapped);
 }
 
-inline FileReader::FileReader(const std::wstring &filename) : path_(filename), cursor_(0)
+inline FileReader::FileReader(const std::wstring &filename, bool mapped)
+  : path_(filename), mapping_(NULL), mapping_length_(0), cursor_(0)
 {
-    Initialize();
+    Initialize(mapped);
+}
+
+inline FileReader::~FileReader() {
+    Unmap();
 }
 
 inline bool FileReader::FileExists(const std::wstring &filename) {
@@ -75,28 +122,38 @@ inline bool FileReader::FileExists(const std::wstring &filename) {
 }
 
 template<typename T> inline T FileReader::Read() {
-    if(cursor_+sizeof(T)>buffer_.size()) {
+    if(cursor_+sizeof(T)>GetLength()) {
         throw exception(std::string("FileReader: Buffer length exceeded"));
     }
-    T t = *reinterpret_cast<T*>(&buffer_[cursor_]);
+    T t = *reinterpret_cast<const T*>(GetData()+cursor_);
     cursor_ += sizeof(T);
     return t;
 }
 
+template<typename T> inline const T *FileReader::ReadSpan(size_t count) {
+    if(count>(GetLength()-cursor_)/sizeof(T)) {
+        throw exception(std::string("FileReader: Buffer length exceeded"));
+    }
+    const T *span = reinterpret_cast<const T*>(GetData()+cursor_);
+    cursor_ += count*sizeof(T);
+    return span;
+}
+
 inline size_t FileReader::ReadIndex(size_t byte_size) {
-    if(cursor_+byte_size>buffer_.size()) {
+    if(cursor_+byte_size>GetLength()) {
         throw exception(std::string("FileReader: Buffer length exceeded"));
     }
+    const std::uint8_t *data = GetData()+cursor_;
     size_t result;
     switch(byte_size) {
     case 1:
-        result = (size_t)(*reinterpret_cast<std::uint8_t*>(&buffer_[cursor_]));
+        result = (size_t)(*reinterpret_cast<const std::uint8_t*>(data));
         break;
     case 2:
-        result = (size_t)(*reinterpret_cast<std::uint16_t*>(&buffer_[cursor_]));
+        result = (size_t)(*reinterpret_cast<const std::uint16_t*>(data));
         break;
     case 4:
-        result = (size_t)(*reinterpret_cast<std::int32_t*>(&buffer_[cursor_]));
+        result = (size_t)(*reinterpret_cast<const std::int32_t*>(data));
         break;
     default:
         throw exception(std::string("FileReader: Invalid byte size"));
@@ -107,32 +164,40 @@ inline size_t FileReader::ReadIndex(size_t byte_size) {
 
 inline std::string FileReader::ReadAnsiString() {
     size_t length = (size_t)Read<std::int32_t>();
-    if(cursor_+length>buffer_.size()) {
-        throw exception(std::string("FileReader: Buffer length exceeded"));
-    }
-    cursor_ += length;
-    return std::string((char*)&buffer_[cursor_-length], length);
+    const char *s = ReadSpan<char>(length);
+    return std::string(s, length);
 }
 
 inline std::wstring FileReader::ReadString(bool utf8) {
     size_t length = (size_t)Read<std::int32_t>();
-    if(cursor_+length>buffer_.size()) {
-        throw exception(std::string("FileReader: Buffer length exceeded"));
-    }
-    cursor_ += length;
+    const std::uint8_t *s = ReadSpan<std::uint8_t>(length);
     if(!utf8) {
 #ifdef MMD_WINDOWS
-        return std::wstring((wchar_t*)&buffer_[cursor_-length], length/sizeof(wchar_t));
+        return std::wstring((const wchar_t*)s, length/sizeof(wchar_t));
 #else
-        return std::wstring((std::uint16_t*)&buffer_[cursor_-length], (std::uint16_t*)&buffer_[cursor_]);
+        return std::wstring((const std::uint16_t*)s, (const std::uint16_t*)(s+length));
 #endif
     } else {
-        return UTF8ToUTF16String(std::string((char*)&buffer_[cursor_-length], length));
+        return UTF8ToUTF16String(std::string((const char*)s, length));
     }
 }
 
-inline buffer_type& FileReader::GetBuffer() { return buffer_; }
-inline const buffer_type& FileReader::GetBuffer() const { return buffer_; }
+inline bool FileReader::IsMapped() const {
+    return mapping_!=NULL;
+}
+
+inline const std::uint8_t *FileReader::GetData() const {
+    return mapping_!=NULL?mapping_:(buffer_.empty()?NULL:&buffer_[0]);
+}
+
+inline buffer_type& FileReader::GetBuffer() {
+    if(mapping_!=NULL) {
+        buffer_.assign(mapping_, mapping_+mapping_length_);
+        Unmap();
+    }
+    return buffer_;
+}
+
 inline void FileReader::Reset() { cursor_ = 0; }
 
 inline const std::wstring& FileReader::GetPath() const {
@@ -156,13 +221,13 @@ inline std::wstring FileReader::GetLocation() const {
 }
 
 inline void FileReader::Seek(size_t position) {
-    if(position<=buffer_.size()) {
+    if(position<=GetLength()) {
         cursor_ = position;
     }
 }
 
 inline size_t FileReader::GetLength() const {
-    return buffer_.size();
+    return mapping_!=NULL?mapping_length_:buffer_.size();
 }
 
 inline size_t FileReader::GetPosition() const {
@@ -170,65 +235,165 @@ inline size_t FileReader::GetPosition() const {
 }
 
 inline ptrdiff_t FileReader::GetRemainedLength() const {
-    return buffer_.size()-cursor_;
+    return GetLength()-cursor_;
 }
 
 
-inline std::wstring s2ws(const std::string &s) {
-    size_t wl = s.size()+1;
-    std::wstring tws(wl, 0);
-    mbstowcs(&tws[0], s.c_str(), wl);
-    return std::wstring(tws.c_str());
+inline bool IsASCIIString(const std::string &s) {
+    for(size_t i=0;i<s.size();++i) {
+        if((unsigned char)s[i]>=0x80) {
+            return false;
+        }
+    }
+    return true;
 }
 
-inline std::string ws2s(const std::wstring &ws) {
+#ifdef MMD_WINDOWS
+/* the environment's locale, created once per thread */
+inline _locale_t GetNativeLocale() {
+    static MMD_THREAD_LOCAL _locale_t locale = NULL;
+    if(locale==NULL) {
+        locale = _create_locale(LC_ALL, "");
+    }
+    return locale;
+}
+#else
+inline locale_t GetNativeLocale() {
+    static MMD_THREAD_LOCAL locale_t locale = (locale_t)0;
+    if(locale==(locale_t)0) {
+        locale = newlocale(LC_ALL_MASK, "", (locale_t)0);
+        if(locale==(locale_t)0) {
+            locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+        }
+    }
+    return locale;
+}
+#endif
+
+inline std::string UTF16ToNativeString(const std::wstring &ws) {
+    bool ascii = true;
+    for(size_t i=0;i<ws.size()&&ascii;++i) {
+        ascii = ((unsigned)ws[i]<0x80);
+    }
+    if(ascii) {
+        return std::string(ws.begin(), ws.end());
+    }
     size_t l = 4*ws.size()+1;
     std::string ts(l, 0);
+#ifdef MMD_WINDOWS
+    _wcstombs_l(&ts[0], ws.c_str(), l, GetNativeLocale());
+#else
+    locale_t previous = uselocale(GetNativeLocale());
     wcstombs(&ts[0], ws.c_str(), l);
+    uselocale(previous);
+#endif
     return std::string(ts.c_str());
 }
 
-inline std::string UTF16ToNativeString(const std::wstring &ws) {
-    std::string c_locale = setlocale(LC_ALL, NULL);
-    setlocale(LC_ALL, "");
-    std::string s = ws2s(ws);
-    setlocale(LC_ALL, c_locale.c_str());
-    return s;
-}
-
 inline std::wstring NativeToUTF16String(const std::string &s) {
-    std::string c_locale = setlocale(LC_ALL, NULL);
-    setlocale(LC_ALL, "");
-    std::wstring ws = s2ws(s);
-    setlocale(LC_ALL, c_locale.c_str());
-    return ws;
+    if(IsASCIIString(s)) {
+        return std::wstring(s.begin(), s.end());
+    }
+    size_t wl = s.size()+1;
+    std::wstring tws(wl, 0);
+#ifdef MMD_WINDOWS
+    _mbstowcs_l(&tws[0], s.c_str(), wl, GetNativeLocale());
+#else
+    locale_t previous = uselocale(GetNativeLocale());
+    mbstowcs(&tws[0], s.c_str(), wl);
+    uselocale(previous);
+#endif
+    return std::wstring(tws.c_str());
 }
 
 inline std::wstring UTF8ToUTF16String(const std::string &s) {
-    std::string c_locale = setlocale(LC_ALL, NULL);
-    setlocale(LC_ALL, "C");
-    std::wstring ws = s2ws(s);
-    setlocale(LC_ALL, c_locale.c_str());
+    if(IsASCIIString(s)) {
+        return std::wstring(s.begin(), s.end());
+    }
+    std::wstring ws;
+    ws.reserve(s.size());
+    size_t i = 0;
+    while(i<s.size()) {
+        unsigned char c = (unsigned char)s[i];
+        size_t length = c<0x80?1:c<0xC2?0:c<0xE0?2:c<0xF0?3:c<0xF5?4:0;
+        std::uint32_t code = length==1?c:length==2?(c&0x1F):length==3?(c&0x0F):(c&0x07);
+        bool valid = length>0&&i+length<=s.size();
+        for(size_t j=1;valid&&j<length;++j) {
+            unsigned char cc = (unsigned char)s[i+j];
+            valid = (cc&0xC0)==0x80;
+            code = (code<<6)|(cc&0x3F);
+        }
+        /* overlong forms, surrogates and code points past U+10FFFF */
+        if(valid&&((length==3&&code<0x800)||(length==4&&(code<0x10000||code>0x10FFFF))||(code>=0xD800&&code<0xE000))) {
+            valid = false;
+        }
+        if(!valid) {
+            ws.push_back(wchar_t(0xFFFD));
+            ++i;
+        } else if(code>=0x10000) {
+            code -= 0x10000;
+            ws.push_back(wchar_t(0xD800+(code>>10)));
+            ws.push_back(wchar_t(0xDC00+(code&0x3FF)));
+            i += length;
+        } else {
+            ws.push_back(wchar_t(code));
+            i += length;
+        }
+    }
     return ws;
 }
 
 inline std::wstring ShiftJISToUTF16String(const std::string &s) {
+    /* Shift-JIS has the yen sign and overline at '\\' and '~' */
+    if(IsASCIIString(s)&&s.find_first_of("\\~")==std::string::npos) {
+        return std::wstring(s.begin(), s.end());
+    }
 #ifdef MMD_WINDOWS
-    std::string c_locale = setlocale(LC_ALL, NULL);
-    setlocale(LC_ALL, "Japanese_Japan.932");
-    std::wstring ws = s2ws(s);
-    setlocale(LC_ALL, c_locale.c_str());
-    return ws;
+    static MMD_THREAD_LOCAL _locale_t locale = NULL;
+    if(locale==NULL) {
+        locale = _create_locale(LC_ALL, "Japanese_Japan.932");
+    }
+    size_t wl = s.size()+1;
+    std::wstring tws(wl, 0);
+    _mbstowcs_l(&tws[0], s.c_str(), wl, locale);
+    return std::wstring(tws.c_str());
 #else
-    iconv_t cd = iconv_open("UTF-16", "SHIFT-JIS");
+    static MMD_THREAD_LOCAL iconv_t cd = (iconv_t)-1;
+    if(cd==(iconv_t)-1) {
+        cd = iconv_open("UTF-16LE", "SHIFT-JIS");
+        if(cd==(iconv_t)-1) {
+            throw exception(std::string("ShiftJISToUTF16String: Shift-JIS is not supported."));
+        }
+    }
+    iconv(cd, NULL, NULL, NULL, NULL);
+
+    /* each byte makes at most one code unit, an invalid one U+FFFD */
     std::vector<char> from_buffer(s.begin(), s.end());
-    std::vector<char> to_buffer(s.size()*4+1, '\0');
+    std::vector<char> to_buffer(s.size()*2);
     char* from_ptr = &from_buffer[0];
     char* to_ptr = &to_buffer[0];
     size_t from_length = s.size();
-    size_t to_length = s.size()*4+1;
-    iconv(cd, &from_ptr, &from_length, &to_ptr, &to_length);
-    iconv_close(cd);
-    return std::wstring((std::uint16_t*)&to_buffer[0], (std::uint16_t*)&to_buffer[s.size()*4-to_length+1]);
+    size_t to_length = to_buffer.size();
+    while(from_length>0) {
+        if(iconv(cd, &from_ptr, &from_length, &to_ptr, &to_length)!=(size_t)-1) {
+            break;
+        }
+        if(errno!=EILSEQ&&errno!=EINVAL) {
+            break;
+        }
+        ++from_ptr;
+        --from_length;
+        *to_ptr++ = '\xFD';
+        *to_ptr++ = '\xFF';
+        to_length -= 2;
+        iconv(cd, NULL, NULL, NULL, NULL);
+    }
+
+    size_t unit_num = (to_buffer.size()-to_length)/2;
+    std::wstring ws(unit_num, 0);
+    for(size_t i=0;i<unit_num;++i) {
+        ws[i] = wchar_t((unsigned char)to_buffer[i*2]|((unsigned char)to_buffer[i*2+1]<<8));
+    }
+    return ws;
 #endif
 }
@@ -22,6 +22,7 @@
 
 #define mmd_math_const_pi 3.141592653589793238462643383279502884
 #define mmd_math_const_eps 1e-7
+#define mmd_math_const_sqrt2 1.414213562373095048801688724209698079
 namespace mmd {
 
     namespace math {
@@ -43,6 +44,9 @@ namespace mmd {
         template <typename T> inline T atan2(T y, T x) {
             return static_cast<T>(std::atan2(static_cast<double>(y), static_cast<double>(x)));
         }
+        template <typename T> inline T abs(T x) {
+            return x<T(0)?-x:x;
+        }
         template <typename T> inline T clamp(T x, T min, T max) {
             return std::min(std::max(x, min), max);
         }
@@ -421,6 +425,13 @@ namespace mmd {
 
     template <typename T> Quaternion<T> AxisToQuaternion(const Vector3D<T>& axis, typename Vector3D<T>::elem_type angle);
 
+    /**
+      q^t for a unit quaternion, taken in the hemisphere of the identity.
+      Equals SLerp(Quaternion<T>::Identity(), q)[t] but costs one atan2
+      and a sin/cos pair, and none for t = 0, t = 1 or a tiny rotation.
+    **/
+    template <typename T> Quaternion<T> QuaternionPower(const Quaternion<T>& q, T t);
+
     template <typename T> Vector3D<T> QuaternionToXYZ(const Quaternion<T>& quaternion);
     template <typename T> Vector3D<T> QuaternionToXZY(const Quaternion<T>& quaternion);
     template <typename T> Vector3D<T> QuaternionToYXZ(const Quaternion<T>& quaternion);
@@ -443,20 +454,32 @@ namespace mmd {
     template <typename T> NLerpProxy<T> NLerp(const T& a, const T& b);
     template <typename T> SLerpProxy<T> SLerp(const T& a, const T& b);
 
-    template <typename T, size_t presample_resolution = 32> class Bezier {
+    /**
+      The timing curve of a keyframe, y(x) for x in [0, 1]. operator()
+      solves x(t)=x with at most iteration_num Newton/bisection steps;
+      operator[] lerps a table of presample_resolution samples taken at
+      construction, or is operator() when presample_resolution is 0.
+      The library-wide defaults are set in macro.inc.
+    **/
+    template <typename T, size_t presample_resolution = MMD_BEZIER_PRESAMPLES, size_t iteration_num = MMD_BEZIER_ITERATIONS> class Bezier {
     public:
         Bezier();
         Bezier(const Vector2D<T>& c_0, const Vector2D<T>& c_1);
         T operator()(T x) const;
         T operator[](T x) const;
 
-        const Vector2D<T>& GetC(size_t i) const;
+        Vector2D<T> GetC(size_t i) const;
         void SetC(const Vector2D<T>& c_0, const Vector2D<T>& c_1);
+        bool IsLinear() const;
+
+        /** The curve at i/(GetPresampleNum()-1), undefined for linear curves (and empty when exact). **/
+        static size_t GetPresampleNum();
+        const T *GetPresamples() const;
     private:
         void presample();
         T interpolate(T x) const;
         bool is_linear_;
-        T presamples_[presample_resolution];
+        T presamples_[presample_resolution>0?presample_resolution:1];
         Vector2D<T> c_0, c_1;
     };
 
@@ -1055,6 +1055,34 @@ template <typename T> inline Quaternion<T> AxisToQuaternion(const Vector3D<T>& a
     }
     return result.q;
 }
+template <typename T> inline Quaternion<T> QuaternionPower(const Quaternion<T>& q, T t) {
+    Quaternion<T> result;
+    if(t==T(0)) {
+        result.MakeIdentity();
+        return result;
+    }
+    T sign = q.e<T(0)?T(-1):T(1);
+    if(t==T(1)) {
+        return q*sign;
+    }
+    T vv = q.i*q.i+q.j*q.j+q.k*q.k;
+    T scale, e;
+    if(vv<T(1e-6)) {
+        /* sin(t*w)/sin(w) and cos(t*w) to second order in w */
+        scale = t*sign;
+        e = T(1)-T(0.5)*t*t*vv;
+    } else {
+        T v = math::sqrt(vv);
+        T omega = math::atan2(v, q.e*sign);
+        scale = math::sin(t*omega)/v*sign;
+        e = math::cos(t*omega);
+    }
+    result.i = q.i*scale;
+    result.j = q.j*scale;
+    result.k = q.k*scale;
+    result.e = e;
+    return result;
+}
 template <typename T> inline Vector3D<T> QuaternionToXYZ(const Quaternion<T>& quaternion) {
     T ii = quaternion.i*quaternion.i;
     T jj = quaternion.j*quaternion.j;
@@ -1346,16 +1374,16 @@ template <typename T> inline NLerpProxy<T> NLerp(const T& a, const T& b) {
 template <typename T> inline SLerpProxy<T> SLerp(const T& a, const T& b) {
     return SLerpProxy<T>(a, b);
 }
-template <typename T, size_t presample_resolution> inline Bezier<T, presample_resolution>::Bezier() {
+template <typename T, size_t presample_resolution, size_t iteration_num> inline Bezier<T, presample_resolution, iteration_num>::Bezier() {
     c_0.p.x = c_0.p.y = T(0);
     c_1.p.x = c_1.p.y = T(3);
     is_linear_ = true;
 }
-template <typename T, size_t presample_resolution> inline Bezier<T, presample_resolution>::Bezier(const Vector2D<T>& c_0, const Vector2D<T>& c_1)
+template <typename T, size_t presample_resolution, size_t iteration_num> inline Bezier<T, presample_resolution, iteration_num>::Bezier(const Vector2D<T>& c_0, const Vector2D<T>& c_1)
     : c_0(T(3)*c_0), c_1(T(3)*c_1) {
     presample();
 }
-template <typename T, size_t presample_resolution> inline T Bezier<T, presample_resolution>::operator()(T x) const {
+template <typename T, size_t presample_resolution, size_t iteration_num> inline T Bezier<T, presample_resolution, iteration_num>::operator()(T x) const {
     if(is_linear_) {
         return x;
     } else {
@@ -1368,10 +1396,13 @@ template <typename T, size_t presample_resolution> inline T Bezier<T, presample_
         }
     }
 }
-template <typename T, size_t presample_resolution> inline T Bezier<T, presample_resolution>::operator[](T x) const {
+template <typename T, size_t presample_resolution, size_t iteration_num> inline T Bezier<T, presample_resolution, iteration_num>::operator[](T x) const {
     if(is_linear_) {
         return x;
     }
+    if(presample_resolution==0) {
+        return (*this)(x);
+    }
     x *= presample_resolution-1;
     size_t ix = (size_t)x;
     T r = x-ix;
@@ -1381,7 +1412,7 @@ template <typename T, size_t presample_resolution> inline T Bezier<T, presample_
         return presamples_[presample_resolution-1];
     }
 }
-template <typename T, size_t presample_resolution> inline const Vector2D<T>& Bezier<T, presample_resolution>::GetC(size_t i) const {
+template <typename T, size_t presample_resolution, size_t iteration_num> inline Vector2D<T> Bezier<T, presample_resolution, iteration_num>::GetC(size_t i) const {
     const T r(T(1)/T(3));
     if(i==0) {
         return c_0*r;
@@ -1389,12 +1420,21 @@ template <typename T, size_t presample_resolution> inline const Vector2D<T>& Bez
         return c_1*r;
     }
 }
-template <typename T, size_t presample_resolution> inline void Bezier<T, presample_resolution>::SetC(const Vector2D<T>& c_0, const Vector2D<T>& c_1) {
+template <typename T, size_t presample_resolution, size_t iteration_num> inline void Bezier<T, presample_resolution, iteration_num>::SetC(const Vector2D<T>& c_0, const Vector2D<T>& c_1) {
     this->c_0 = c_0*T(3);
     this->c_1 = c_1*T(3);
     presample();
 }
-template <typename T, size_t presample_resolution> inline void Bezier<T, presample_resolution>::presample() {
+template <typename T, size_t presample_resolution, size_t iteration_num> inline bool Bezier<T, presample_resolution, iteration_num>::IsLinear() const {
+    return is_linear_;
+}
+template <typename T, size_t presample_resolution, size_t iteration_num> inline size_t Bezier<T, presample_resolution, iteration_num>::GetPresampleNum() {
+    return presample_resolution;
+}
+template <typename T, size_t presample_resolution, size_t iteration_num> inline const T *Bezier<T, presample_resolution, iteration_num>::GetPresamples() const {
+    return presamples_;
+}
+template <typename T, size_t presample_resolution, size_t iteration_num> inline void Bezier<T, presample_resolution, iteration_num>::presample() {
     if((c_0.p.x==c_0.p.y)&&(c_1.p.x==c_1.p.y)) {
         is_linear_ = true;
     } else {
@@ -1405,23 +1445,33 @@ template <typename T, size_t presample_resolution> inline void Bezier<T, presamp
         }
     }
 }
-template <typename T, size_t presample_resolution> inline T Bezier<T, presample_resolution>::interpolate(T x) const {
+template <typename T, size_t presample_resolution, size_t iteration_num> inline T Bezier<T, presample_resolution, iteration_num>::interpolate(T x) const {
+    /* Newton on x(t)=x, falling back to bisection when a step leaves the bracket */
     T l(0);
     T r(1);
-    T m, lm(0), rm;
-    for(size_t i = 0;i<32;++i) {
-        lm = (l+r)*T(0.5);
-        rm = T(1)-lm;
-        m = lm*(rm*(rm*c_0.p.x+lm*c_1.p.x)+lm*lm);
-        if(abs(m-x)<T(mmd_math_const_eps)) {
+    T t(x);
+    T rt;
+    for(size_t i = 0;i<iteration_num;++i) {
+        rt = T(1)-t;
+        T m = t*(rt*(rt*c_0.p.x+t*c_1.p.x)+t*t)-x;
+        if(math::abs(m)<T(mmd_math_const_eps)) {
             break;
         }
-        if(m>x) {
-            r = lm;
+        if(m>T(0)) {
+            r = t;
         } else {
-            l = lm;
+            l = t;
+        }
+        T d = rt*(rt-T(2)*t)*c_0.p.x+t*(T(2)*rt-t)*c_1.p.x+T(3)*t*t;
+        T n = (d>T(0))?t-m/d:l;
+        if(n<=l||n>=r) {
+            n = (l+r)*T(0.5);
+        }
+        if(n==t) {
+            break;
         }
+        t = n;
     }
-    rm = T(1)-lm;
-    return lm*(rm*(rm*c_0.p.y+lm*c_1.p.y)+lm*lm);
+    rt = T(1)-t;
+    return t*(rt*(rt*c_0.p.y+t*c_1.p.y)+t*t);
 }
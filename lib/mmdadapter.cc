@@ -6,6 +6,11 @@
 #include "mmdadapter.h"
 #include "mmd/mmd.hxx"
 #include "bitmap.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <exception>
 #include <unordered_map>
@@ -47,11 +52,160 @@ namespace {
 	}
 };
 
+/*
+ * open() keeps everything the getters hand out in flat arrays, and saves
+ * them next to the model as <model>.cache. A later open() maps that file
+ * and copies the arrays out without parsing anything. The cache records
+ * the size, modification time and checksum of the model and the size and
+ * modification time of each texture, and is rebuilt when any of them
+ * differ, when its version is not kCacheVersion, or when its own checksum
+ * fails.
+ */
+namespace {
+	const char kCacheMagic[8] = { 'M', 'M', 'D', 'C', 'A', 'C', 'H', 'E' };
+	const std::uint32_t kCacheVersion = 1;
+
+	struct CacheHeader {
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t header_size;
+		std::uint64_t source_size;
+		std::int64_t source_mtime;
+		std::uint64_t source_checksum;
+		std::uint64_t payload_size;
+		std::uint64_t payload_checksum;
+	};
+
+	struct CachedJoint {
+		glm::vec3 offset;
+		std::int32_t parent;
+	};
+
+	struct CachedMaterial {
+		glm::vec4 diffuse, ambient, specular;
+		float shininess;
+		std::int32_t texture; // -1 for none
+		std::uint64_t offset;
+		std::uint64_t nfaces;
+	};
+
+	struct CachedTexture {
+		std::int32_t width, height, stride;
+		std::int32_t loaded;
+		// 0 and -1 for a texture that does not exist
+		std::uint64_t source_size;
+		std::int64_t source_mtime;
+	};
+
+	// The arrays are written as their raw bytes.
+	static_assert(sizeof(glm::vec4) == 16 && sizeof(glm::vec2) == 8 &&
+		      sizeof(glm::uvec3) == 12 && sizeof(SparseTuple) == 12,
+		      "unexpected vector layout for the model cache");
+
+	// FNV-1a over 64-bit words, fast enough to run on every start.
+	std::uint64_t checksum(const unsigned char* p, size_t n)
+	{
+		std::uint64_t h = 0xcbf29ce484222325ull ^ n;
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			std::uint64_t w;
+			std::memcpy(&w, p + i, 8);
+			h = (h ^ w) * 0x100000001b3ull;
+		}
+		for (; i < n; i++)
+			h = (h ^ p[i]) * 0x100000001b3ull;
+		return h;
+	}
+
+	bool statFile(const std::string& fn, std::uint64_t& size, std::int64_t& mtime)
+	{
+		struct stat st;
+		if (stat(fn.c_str(), &st) != 0)
+			return false;
+		size = st.st_size;
+		mtime = st.st_mtime;
+		return true;
+	}
+
+	void statTexture(const std::string& fn, std::uint64_t& size, std::int64_t& mtime)
+	{
+		if (!statFile(fn, size, mtime)) {
+			size = 0;
+			mtime = -1;
+		}
+	}
+
+	std::string cachePath(const std::string& fn)
+	{
+		return fn + ".cache";
+	}
+
+	class CacheWriter {
+	public:
+		template<typename T>
+		void put(const T& value)
+		{
+			const unsigned char* p = reinterpret_cast<const unsigned char*>(&value);
+			payload_.insert(payload_.end(), p, p + sizeof(T));
+		}
+
+		// A count, then the elements, padded to 8 bytes.
+		template<typename T>
+		void putArray(const T* data, size_t n)
+		{
+			put(std::uint64_t(n));
+			const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+			payload_.insert(payload_.end(), p, p + n * sizeof(T));
+			payload_.resize((payload_.size() + 7) & ~size_t(7), 0);
+		}
+
+		template<typename T>
+		void putArray(const std::vector<T>& v)
+		{
+			putArray(v.data(), v.size());
+		}
+
+		bool write(const std::string& fn, const CacheHeader& source)
+		{
+			CacheHeader header = source;
+			header.payload_size = payload_.size();
+			header.payload_checksum = checksum(payload_.data(), payload_.size());
+			std::string tmp = fn + ".tmp";
+			{
+				std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+				out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				out.write(reinterpret_cast<const char*>(payload_.data()), payload_.size());
+				if (!out) {
+					out.close();
+					std::remove(tmp.c_str());
+					return false;
+				}
+			}
+			if (std::rename(tmp.c_str(), fn.c_str()) != 0) {
+				std::remove(tmp.c_str());
+				return false;
+			}
+			return true;
+		}
+	private:
+		std::vector<unsigned char> payload_;
+	};
+
+	template<typename T>
+	void getArray(mmd::FileReader& file, std::vector<T>& v)
+	{
+		size_t n = file.Read<std::uint64_t>();
+		const T* data = file.ReadSpan<T>(n);
+		v.assign(data, data + n);
+		file.Seek((file.GetPosition() + 7) & ~size_t(7));
+	}
+};
+
 class MMDAdapter {
-	bool isBoneHasRoot0(int bone_id)
+	bool isBoneHasRoot0(const mmd::Model& model, int bone_id)
 	{
 		do {
-			const auto& bone = model_.GetBone(bone_id);
+			const auto& bone = model.GetBone(bone_id);
 			int parent = bone.GetParentIndex();
 			if (parent < 0)
 				break;
@@ -70,25 +224,27 @@ public:
 
 	bool open(const std::string& fn)
 	{
+		CacheHeader source = {};
+		std::memcpy(source.magic, kCacheMagic, sizeof(kCacheMagic));
+		source.version = kCacheVersion;
+		source.header_size = sizeof(CacheHeader);
 		try {
 			mmd::FileReader file(fn);
-			mmd::PmdReader reader(file);
-			reader.ReadModel(model_);
+			statFile(fn, source.source_size, source.source_mtime);
+			source.source_checksum = checksum(file.GetData(), file.GetLength());
+			if (loadCache(cachePath(fn), source))
+				return true;
 
-			size_t useful_bone_id = 0;
-			for (size_t i = 0; i < model_.GetBoneNum(); i++) {
-				if (!isBoneHasRoot0(i)) {
-					pmd_bone_to_useful_bone_[i] = -1;
-					continue;
-				}
-				useful_bone_to_pmd_bone_[useful_bone_id] = i;
-				pmd_bone_to_useful_bone_[i] = useful_bone_id;
-				useful_bone_id++;
-			}
+			mmd::Model model;
+			mmd::PmdReader reader(file);
+			reader.ReadModel(model);
+			build(model);
 		} catch (std::exception& e) {
 			std::cerr << e.what() << endl;
 			return false;
 		}
+		if (!saveCache(cachePath(fn), source))
+			std::cerr << __func__ << " could not write " << cachePath(fn) << endl;
 		return true;
 	}
 
@@ -97,39 +253,119 @@ public:
 		     std::vector<glm::vec4>& N,
 		     std::vector<glm::vec2>& UV)
 	{
-		size_t nv = model_.GetVertexNum();
-		V.resize(nv);
-		N.resize(nv);
-		UV.resize(nv);
+		V = vertices_;
+		F = faces_;
+		N = normals_;
+		UV = uvs_;
+	}
+
+	void getMaterial(std::vector<Material>& vm)
+	{
+		vm = materials_;
+	}
+
+	bool getJoint(int useful_bone_id, glm::vec3& offset, int& parent)
+	{
+		if (useful_bone_id >= int(joints_.size()) || useful_bone_id < 0)
+			return false;
+		offset = joints_[useful_bone_id].offset;
+		parent = joints_[useful_bone_id].parent;
+		return true;
+	}
+
+	void getJointWeights(std::vector<SparseTuple>& tup)
+	{
+		tup = weights_;
+	}
+
+	bool openCamera(const std::string& fn)
+	{
+		try {
+			mmd::FileReader file(fn);
+			mmd::VmdReader reader(file);
+			reader.ReadCameraMotion(camera_);
+			camera_cursor_ = 0;
+		} catch (std::exception& e) {
+			std::cerr << e.what() << endl;
+			return false;
+		}
+		return camera_.GetKeyframeNum() > 0;
+	}
+
+	void getCamera(double time, glm::vec3& eye, glm::vec3& center,
+		       glm::vec3& up, float& fov)
+	{
+		/*
+		 * The camera orbits its target at the keyframe distance, which is
+		 * negative for a camera in front of the model. Angles are radians.
+		 */
+		mmd::CameraMotion::CameraPose pose = camera_.GetCameraPose(time, camera_cursor_);
+		const mmd::Vector3f& r = pose.GetRotation();
+		glm::mat4 rot = glm::rotate(glm::mat4(1.0f), r.p.y, glm::vec3(0.0f, 1.0f, 0.0f))
+			* glm::rotate(glm::mat4(1.0f), r.p.x, glm::vec3(1.0f, 0.0f, 0.0f))
+			* glm::rotate(glm::mat4(1.0f), r.p.z, glm::vec3(0.0f, 0.0f, 1.0f));
+		center = glm::vec3(conv(pose.GetPosition()));
+		eye = center + glm::vec3(rot * glm::vec4(0.0f, 0.0f, pose.GetFocalLength(), 0.0f));
+		up = glm::vec3(rot * glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
+		fov = pose.GetFOV();
+	}
+private:
+	void build(const mmd::Model& model)
+	{
+		std::unordered_map<int, int> useful_bone_to_pmd_bone, pmd_bone_to_useful_bone;
+		size_t useful_bone_id = 0;
+		for (size_t i = 0; i < model.GetBoneNum(); i++) {
+			if (!isBoneHasRoot0(model, i)) {
+				pmd_bone_to_useful_bone[i] = -1;
+				continue;
+			}
+			useful_bone_to_pmd_bone[useful_bone_id] = i;
+			pmd_bone_to_useful_bone[i] = useful_bone_id;
+			useful_bone_id++;
+		}
+
+		buildMesh(model);
+		buildMaterials(model);
+		buildJoints(model, useful_bone_to_pmd_bone, pmd_bone_to_useful_bone);
+		buildJointWeights(model, pmd_bone_to_useful_bone);
+	}
+
+	void buildMesh(const mmd::Model& model)
+	{
+		size_t nv = model.GetVertexNum();
+		vertices_.resize(nv);
+		normals_.resize(nv);
+		uvs_.resize(nv);
 		for (size_t i = 0; i < nv; i++) {
-			const auto& v = model_.GetVertex(i);
-			V[i] = conv(v.GetCoordinate());
-			N[i] = conv(v.GetNormal());
-			UV[i] = conv(v.GetUVCoordinate());
-			N[i][3] = 0.0f;
-			V[i][3] = 1.0f;
+			const auto& v = model.GetVertex(i);
+			vertices_[i] = conv(v.GetCoordinate());
+			normals_[i] = conv(v.GetNormal());
+			uvs_[i] = conv(v.GetUVCoordinate());
+			normals_[i][3] = 0.0f;
+			vertices_[i][3] = 1.0f;
 		}
-		size_t nf = model_.GetTriangleNum();
-		F.resize(nf);
+		size_t nf = model.GetTriangleNum();
+		faces_.resize(nf);
 		for (size_t i = 0; i < nf; i++) {
-			const auto& f = model_.GetTriangle(i);
-			F[i] = conv(f);
+			const auto& f = model.GetTriangle(i);
+			faces_[i] = conv(f);
 		}
 	}
 
-	void getMaterial(std::vector<Material>& vm)
+	void buildMaterials(const mmd::Model& model)
 	{
 		std::map<std::string, std::shared_ptr<Image>> loaded_tex;
-		vm.resize(model_.GetPartNum());
-		for (size_t i = 0; i < vm.size(); i++) {
-			const auto& part = model_.GetPart(i);
+		materials_.assign(model.GetPartNum(), Material());
+		textures_.clear();
+		for (size_t i = 0; i < materials_.size(); i++) {
+			const auto& part = model.GetPart(i);
 			const auto& material = part.GetMaterial();
-			vm[i].diffuse = conv(material.GetDiffuseColor());
-			vm[i].ambient = conv(material.GetAmbientColor());
-			vm[i].specular = conv(material.GetSpecularColor());
-			vm[i].shininess = material.GetShininess();
-			vm[i].offset = part.GetBaseShift();
-			vm[i].nfaces = part.GetTriangleNum();
+			materials_[i].diffuse = conv(material.GetDiffuseColor());
+			materials_[i].ambient = conv(material.GetAmbientColor());
+			materials_[i].specular = conv(material.GetSpecularColor());
+			materials_[i].shininess = material.GetShininess();
+			materials_[i].offset = part.GetBaseShift();
+			materials_[i].nfaces = part.GetTriangleNum();
 			const mmd::Texture* tex = material.GetTexture();
 			if (!tex)
 				continue;
@@ -138,13 +374,16 @@ public:
 				continue;
 			auto iter = loaded_tex.find(texfn);
 			if (iter != loaded_tex.end()) {
-				vm[i].texture = iter->second;
+				materials_[i].texture = iter->second;
 				continue;
 			}
 			auto image = std::make_shared<Image>();
 			std::cerr << __func__ << " is trying to load texture " << texfn << std::endl;
-			if (!readBMP(texfn.data(), *image))
+			if (!readBMP(texfn.data(), *image)) {
+				// Kept so that the cache notices when it shows up.
+				textures_.emplace_back(texfn, nullptr);
 				continue;
+			}
 			std::cerr << __func__ << " successfully loaded texture " << texfn << std::endl;
 #if 0
 			std::cerr << "\t\ttesting RGB ";
@@ -155,61 +394,67 @@ public:
 			//std::cerr << "\t\ttesting RGB " << int(image->bytes[256]) << ' ' << int(image->bytes[257]) << ' ' << int(image->bytes[258]) << ' ' << std::endl;
 #endif
 			loaded_tex[texfn] = image;
-			vm[i].texture = image;
+			materials_[i].texture = image;
+			textures_.emplace_back(texfn, image);
 		}
 	}
 
-	bool getJoint(int useful_bone_id, glm::vec3& offset, int& parent)
+	void buildJoints(const mmd::Model& model,
+			 std::unordered_map<int, int>& useful_bone_to_pmd_bone,
+			 std::unordered_map<int, int>& pmd_bone_to_useful_bone)
 	{
-		if (useful_bone_id >= int(useful_bone_to_pmd_bone_.size()) || useful_bone_id < 0)
-			return false;
-		int id = useful_bone_to_pmd_bone_[useful_bone_id];
-		const auto& bone = model_.GetBone(id);
-		size_t mmd_parent = bone.GetParentIndex();
-		if (mmd_parent == mmd::nil) {
-			parent = -1;
-			offset = glm::vec3(conv(bone.GetPosition()));
-		} else {
-			parent = pmd_bone_to_useful_bone_[int(mmd_parent)];
-			const auto& parent_bone = model_.GetBone(mmd_parent);
-			offset = glm::vec3(conv(bone.GetPosition() - parent_bone.GetPosition()));
-		}
+		joints_.resize(useful_bone_to_pmd_bone.size());
+		for (size_t useful_bone_id = 0; useful_bone_id < joints_.size(); useful_bone_id++) {
+			int id = useful_bone_to_pmd_bone[useful_bone_id];
+			const auto& bone = model.GetBone(id);
+			size_t mmd_parent = bone.GetParentIndex();
+			CachedJoint& joint = joints_[useful_bone_id];
+			if (mmd_parent == mmd::nil) {
+				joint.parent = -1;
+				joint.offset = glm::vec3(conv(bone.GetPosition()));
+			} else {
+				joint.parent = pmd_bone_to_useful_bone[int(mmd_parent)];
+				const auto& parent_bone = model.GetBone(mmd_parent);
+				joint.offset = glm::vec3(conv(bone.GetPosition() - parent_bone.GetPosition()));
+			}
 #if 0
-		std::cerr << "Joint " << id << " type " << 
-			bone.IsChildUseID() << ' ' << 
-		bone.IsRotatable() << ' ' << 
-		bone.IsMovable() << ' ' << 
-		bone.IsVisible() << ' ' << 
-		bone.IsControllable() << ' ' << 
-		bone.IsHasIK() << ' ' << 
-		bone.IsAppendRotate() << ' ' <<  // Remove these bones
-		bone.IsAppendTranslate() << ' ' << 
-		bone.IsRotAxisFixed() << ' ' << 
-		bone.IsUseLocalAxis() << ' ' << 
-		bone.IsPostPhysics() << ' ' << 
-		bone.IsReceiveTransform() << ' ' << std::endl;
+			std::cerr << "Joint " << id << " type " << 
+				bone.IsChildUseID() << ' ' << 
+			bone.IsRotatable() << ' ' << 
+			bone.IsMovable() << ' ' << 
+			bone.IsVisible() << ' ' << 
+			bone.IsControllable() << ' ' << 
+			bone.IsHasIK() << ' ' << 
+			bone.IsAppendRotate() << ' ' <<  // Remove these bones
+			bone.IsAppendTranslate() << ' ' << 
+			bone.IsRotAxisFixed() << ' ' << 
+			bone.IsUseLocalAxis() << ' ' << 
+			bone.IsPostPhysics() << ' ' << 
+			bone.IsReceiveTransform() << ' ' << std::endl;
 #endif
-		return true;
+		}
 	}
 
-	void getJointWeights(std::vector<SparseTuple>& tup)
+	void buildJointWeights(const mmd::Model& model,
+			       std::unordered_map<int, int>& pmd_bone_to_useful_bone)
 	{
 		constexpr int SKINNING_BDEF1 = mmd::Model::SkinningOperator::SKINNING_BDEF1;
 		constexpr int SKINNING_BDEF2 = mmd::Model::SkinningOperator::SKINNING_BDEF2;
 		constexpr int SKINNING_BDEF4 = mmd::Model::SkinningOperator::SKINNING_BDEF4;
 		constexpr int SKINNING_SDEF = mmd::Model::SkinningOperator::SKINNING_SDEF;
-		size_t nv = model_.GetVertexNum();
+		std::vector<SparseTuple>& tup = weights_;
+		size_t nv = model.GetVertexNum();
 		tup.clear();
 		tup.reserve(nv * 2);
 		for (size_t i = 0; i < nv; i++) {
-			const auto& v = model_.GetVertex(i);
+			const auto& v = model.GetVertex(i);
 			int skt = v.GetSkinningOperator().GetSkinningType();
 			
 			switch (skt) {
 				case SKINNING_BDEF1:
 					{
 						const auto& bdef1 = v.GetSkinningOperator().GetBDEF1();
-						auto bid = pmd_bone_to_useful_bone_[bdef1.GetBoneID()];
+						auto bid = pmd_bone_to_useful_bone[bdef1.GetBoneID()];
 						if (bid >= 0)
 							tup.emplace_back(bid, i, 1.0f);
 					}
@@ -217,8 +462,8 @@ public:
 				case SKINNING_BDEF2:
 					{
 						const auto& bdef2 = v.GetSkinningOperator().GetBDEF2();
-						auto bid0 = pmd_bone_to_useful_bone_[bdef2.GetBoneID(0)];
-						auto bid1 = pmd_bone_to_useful_bone_[bdef2.GetBoneID(1)];
+						auto bid0 = pmd_bone_to_useful_bone[bdef2.GetBoneID(0)];
+						auto bid1 = pmd_bone_to_useful_bone[bdef2.GetBoneID(1)];
 						if (bid0 >= 0 && bid1 >= 0) {
 							tup.emplace_back(bid0, i, bdef2.GetBoneWeight());
 							tup.emplace_back(bid1, i, 1.0f - bdef2.GetBoneWeight());
@@ -229,7 +474,7 @@ public:
 					{
 						const auto& bdef4 = v.GetSkinningOperator().GetBDEF4();
 						for (int i = 0 ; i < 4; i++) {
-							auto bid = pmd_bone_to_useful_bone_[bdef4.GetBoneID(i)];
+							auto bid = pmd_bone_to_useful_bone[bdef4.GetBoneID(i)];
 							if (bid < 0)
 								continue;
 							tup.emplace_back(bid, i, bdef4.GetBoneWeight(i));
@@ -244,9 +489,134 @@ public:
 			//std::cerr << bdef2.GetBoneID(0) << "\t" << bdef2.GetBoneID(1) << "\t" << bdef2.GetBoneWeight() << endl;
 		}
 	}
-private:
-	mmd::Model model_;
-	std::unordered_map<int, int> useful_bone_to_pmd_bone_, pmd_bone_to_useful_bone_;
+
+	bool saveCache(const std::string& cachefn, const CacheHeader& source)
+	{
+		CacheWriter w;
+		w.putArray(vertices_);
+		w.putArray(normals_);
+		w.putArray(uvs_);
+		w.putArray(faces_);
+		w.putArray(joints_);
+		w.putArray(weights_);
+
+		std::vector<CachedTexture> textures(textures_.size());
+		std::map<const Image*, std::int32_t> texture_ids;
+		for (size_t i = 0; i < textures_.size(); i++) {
+			const Image* image = textures_[i].second.get();
+			CachedTexture& t = textures[i];
+			t.width = image ? image->width : 0;
+			t.height = image ? image->height : 0;
+			t.stride = image ? image->stride : 0;
+			t.loaded = image != nullptr;
+			statTexture(textures_[i].first, t.source_size, t.source_mtime);
+			texture_ids[image] = i;
+		}
+		std::vector<CachedMaterial> materials(materials_.size());
+		for (size_t i = 0; i < materials_.size(); i++) {
+			const Material& m = materials_[i];
+			CachedMaterial& c = materials[i];
+			c.diffuse = m.diffuse;
+			c.ambient = m.ambient;
+			c.specular = m.specular;
+			c.shininess = m.shininess;
+			c.texture = m.texture ? texture_ids[m.texture.get()] : -1;
+			c.offset = m.offset;
+			c.nfaces = m.nfaces;
+		}
+		w.putArray(materials);
+		w.putArray(textures);
+		for (size_t i = 0; i < textures_.size(); i++) {
+			w.putArray(textures_[i].first.data(), textures_[i].first.size());
+			if (textures_[i].second)
+				w.putArray(textures_[i].second->bytes);
+			else
+				w.putArray(static_cast<const unsigned char*>(nullptr), 0);
+		}
+		return w.write(cachefn, source);
+	}
+
+	bool loadCache(const std::string& cachefn, const CacheHeader& source)
+	{
+		std::uint64_t size;
+		std::int64_t mtime;
+		if (!statFile(cachefn, size, mtime))
+			return false;
+		try {
+			mmd::FileReader file(cachefn);
+			CacheHeader header = file.Read<CacheHeader>();
+			if (std::memcmp(header.magic, source.magic, sizeof(header.magic)) != 0 ||
+			    header.version != source.version ||
+			    header.header_size != source.header_size ||
+			    header.source_size != source.source_size ||
+			    header.source_mtime != source.source_mtime ||
+			    header.source_checksum != source.source_checksum ||
+			    header.payload_size != file.GetLength() - sizeof(header) ||
+			    header.payload_checksum != checksum(file.GetData() + sizeof(header), header.payload_size))
+				return false;
+
+			getArray(file, vertices_);
+			getArray(file, normals_);
+			getArray(file, uvs_);
+			getArray(file, faces_);
+			getArray(file, joints_);
+			getArray(file, weights_);
+			std::vector<CachedMaterial> materials;
+			std::vector<CachedTexture> textures;
+			getArray(file, materials);
+			getArray(file, textures);
+
+			textures_.resize(textures.size());
+			for (size_t i = 0; i < textures.size(); i++) {
+				const CachedTexture& t = textures[i];
+				std::vector<char> name;
+				getArray(file, name);
+				textures_[i].first.assign(name.begin(), name.end());
+				std::uint64_t tex_size;
+				std::int64_t tex_mtime;
+				statTexture(textures_[i].first, tex_size, tex_mtime);
+				if (tex_size != t.source_size || tex_mtime != t.source_mtime)
+					return false;
+				auto image = std::make_shared<Image>();
+				getArray(file, image->bytes);
+				if (!t.loaded) {
+					textures_[i].second = nullptr;
+					continue;
+				}
+				image->width = t.width;
+				image->height = t.height;
+				image->stride = t.stride;
+				textures_[i].second = image;
+			}
+
+			materials_.resize(materials.size());
+			for (size_t i = 0; i < materials.size(); i++) {
+				const CachedMaterial& c = materials[i];
+				Material& m = materials_[i];
+				m.diffuse = c.diffuse;
+				m.ambient = c.ambient;
+				m.specular = c.specular;
+				m.shininess = c.shininess;
+				m.texture = c.texture >= 0 ? textures_.at(c.texture).second : nullptr;
+				m.offset = c.offset;
+				m.nfaces = c.nfaces;
+			}
+		} catch (std::exception& e) {
+			std::cerr << cachefn << ": " << e.what() << endl;
+			return false;
+		}
+		return true;
+	}
+
+	std::vector<glm::vec4> vertices_, normals_;
+	std::vector<glm::vec2> uvs_;
+	std::vector<glm::uvec3> faces_;
+	std::vector<Material> materials_;
+	std::vector<std::pair<std::string, std::shared_ptr<Image>>> textures_;
+	std::vector<CachedJoint> joints_;
+	std::vector<SparseTuple> weights_;
+	mmd::CameraMotion camera_;
+	size_t camera_cursor_ = 0;
 };
 
 MMDReader::MMDReader()
@@ -285,3 +655,14 @@ void MMDReader::getJointWeights(std::vector<SparseTuple>& tup)
 {
 	d_->getJointWeights(tup);
 }
+
+bool MMDReader::openCamera(const std::string& fn)
+{
+	return d_->openCamera(fn);
+}
+
+void MMDReader::getCamera(double time, glm::vec3& eye, glm::vec3& center,
+		glm::vec3& up, float& fov)
+{
+	d_->getCamera(time, eye, center, up, fov);
+}
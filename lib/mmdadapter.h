@@ -40,6 +40,9 @@ public:
 	 *      true: file opened successfully
 	 *      false: file failed to open
 	 * Note: We don't test your robustness for invalid input.
+	 *       The parsed model and its textures are saved to fn + ".cache"
+	 *       and read back from there while the model and textures are
+	 *       unchanged.
 	 */
 	bool open(const std::string& fn);
 	/*
@@ -83,6 +86,24 @@ public:
 	 * See SparseTuple for more details
 	 */
 	void getJointWeights(std::vector<SparseTuple>& tup);
+	/*
+	 * Open the camera path of a VMD motion file.
+	 * Input
+	 *      fn: file name
+	 * Return:
+	 *      true: the file has camera keyframes
+	 *      false: the file failed to open or has no camera keyframes
+	 */
+	bool openCamera(const std::string& fn);
+	/*
+	 * Sample the camera path at a time in seconds. Playing forward is
+	 * cheap, the path is only searched again after a jump.
+	 * Output:
+	 *      eye, center, up: arguments for glm::lookAt
+	 *      fov: vertical field of view in degrees
+	 */
+	void getCamera(double time, glm::vec3& eye, glm::vec3& center,
+		       glm::vec3& up, float& fov);
 private:
 	std::unique_ptr<MMDAdapter> d_;
 };
@@ -147,6 +147,13 @@ void GUI::assignMesh(Mesh* mesh)
 	center_ = mesh_->getCenter();
 }
 
+void GUI::assignCamera(MMDReader* camera_path)
+{
+	camera_path_ = camera_path;
+	playback_ = true;
+	playback_start_ = glfwGetTime();
+}
+
 void GUI::keyCallback(int key, int scancode, int action, int mods)
 {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
@@ -194,6 +201,9 @@ void GUI::keyCallback(int key, int scancode, int action, int mods)
 			current_bone_ = 1;
 	} else if (key == GLFW_KEY_T && action != GLFW_RELEASE) {
 		transparent_ = !transparent_;
+	} else if (key == GLFW_KEY_P && action == GLFW_RELEASE && camera_path_) {
+		playback_ = !playback_;
+		playback_start_ = glfwGetTime();
 	}
 }
 
@@ -290,12 +300,20 @@ void GUI::updateMatrices()
 	else
 		eye_ = center_ - camera_distance_ * look_;
 
-	view_matrix_ = glm::lookAt(eye_, center_, up_);
-	light_position_ = glm::vec4(eye_, 1.0f);
+	fov_ = kFov;
+	if (playback_) {
+		glm::vec3 center, up;
+		camera_path_->getCamera(glfwGetTime() - playback_start_,
+				playback_eye_, center, up, fov_);
+		view_matrix_ = glm::lookAt(playback_eye_, center, up);
+	} else {
+		view_matrix_ = glm::lookAt(eye_, center_, up_);
+	}
+	light_position_ = glm::vec4(getCamera(), 1.0f);
 
 	aspect_ = static_cast<float>(window_width_) / window_height_;
 	projection_matrix_ =
-		glm::perspective((float)(kFov * (M_PI / 180.0f)), aspect_, kNear, kFar);
+		glm::perspective((float)(fov_ * (M_PI / 180.0f)), aspect_, kNear, kFar);
 	model_matrix_ = glm::mat4(1.0f);
 }
 
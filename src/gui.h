@@ -6,6 +6,7 @@
 #include <GLFW/glfw3.h>
 
 class Mesh;
+class MMDReader;
 
 /*
  * Hint: call glUniformMatrix4fv on thest pointers
@@ -19,6 +20,10 @@ public:
 	GUI(GLFWwindow*);
 	~GUI();
 	void assignMesh(Mesh*);
+	/*
+	 * Play a VMD camera path, P toggles between it and the free camera.
+	 */
+	void assignCamera(MMDReader*);
 
 	void keyCallback(int key, int scancode, int action, int mods);
 	void mousePosCallback(double mouse_x, double mouse_y);
@@ -31,7 +36,7 @@ public:
 	static void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 
 	glm::vec3 getCenter() const { return center_; }
-	const glm::vec3& getCamera() const { return eye_; }
+	const glm::vec3& getCamera() const { return playback_ ? playback_eye_ : eye_; }
 	bool isPoseDirty() const { return pose_changed_; }
 	void clearPose() { pose_changed_ = false; }
 	const float* getLightPositionPtr() const { return &light_position_[0]; }
@@ -43,6 +48,7 @@ public:
 private:
 	GLFWwindow* window_;
 	Mesh* mesh_;
+	MMDReader* camera_path_ = nullptr;
 
 	int window_width_, window_height_;
 
@@ -50,6 +56,8 @@ private:
 	bool fps_mode_ = false;
 	bool pose_changed_ = true;
 	bool transparent_ = false;
+	bool playback_ = false;
+	double playback_start_ = 0.0;
 	int current_bone_ = -1;
 	int current_button_ = -1;
 	float roll_speed_ = 0.1;
@@ -67,6 +75,8 @@ private:
 	glm::vec3 center_ = eye_ - camera_distance_ * look_;
 	glm::mat3 orientation_ = glm::mat3(tangent_, up_, look_);
 	glm::vec4 light_position_;
+	glm::vec3 playback_eye_;
+	float fov_;
 
 	glm::mat4 view_matrix_ = glm::lookAt(eye_, center_, up_);
 	glm::mat4 projection_matrix_;
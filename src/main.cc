@@ -90,7 +90,7 @@ int main(int argc, char* argv[])
 	int last_bone = -1;
 	if (argc < 2) {
 		std::cerr << "Input model file is missing" << std::endl;
-		std::cerr << "Usage: " << argv[0] << " <PMD file>" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " <PMD file> [VMD camera file]" << std::endl;
 		return -1;
 	}
 	GLFWwindow *window = init_glefw();
@@ -127,6 +127,14 @@ int main(int argc, char* argv[])
 	 */
 	gui.assignMesh(&mesh);
 
+	MMDReader camera_path;
+	if (argc > 2) {
+		if (camera_path.openCamera(argv[2]))
+			gui.assignCamera(&camera_path);
+		else
+			std::cerr << "No camera path in " << argv[2] << std::endl;
+	}
+
 	glm::vec4 light_position = glm::vec4(0.0f, 100.0f, 0.0f, 1.0f);
 	MatrixPointers mats; // Define MatrixPointers here for lambda to capture
 	